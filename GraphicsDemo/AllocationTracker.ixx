@@ -0,0 +1,123 @@
+// AllocationTracker.ixx
+
+module;
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+export module AllocationTracker;
+
+import Log;
+
+export struct AllocationCounts
+{
+	std::uint64_t m_allocation_count{ 0 };
+	std::uint64_t m_allocated_bytes{ 0 };
+};
+
+// Counts the heap allocations made through operator new, see AllocationHooks.cpp, per thread and for the whole process.
+// The render loop brackets each frame with BeginFrame() and EndFrame() to get what that frame allocated on its thread.
+// With the frame check enabled, a frame past the warm-up that allocates is reported, and asserts in debug builds.
+export class AllocationTracker
+{
+public:
+	// Called by the operator new hooks, must not allocate
+	static void RecordAllocation(std::size_t bytes);
+
+	static AllocationCounts GetThreadCounts(); // since the calling thread started
+	static AllocationCounts GetTotalCounts(); // every thread since the process started
+
+	static void BeginFrame();
+	static AllocationCounts EndFrame(); // allocated by the calling thread since BeginFrame()
+	static AllocationCounts GetLastFrame();
+
+	// Frames allocate until every cache and scratch buffer has grown to its steady size, they are not checked
+	static void EnableFrameCheck(int warmup_frame_count);
+	static void RestartWarmup(); // e.g. after the swap chain was recreated
+};
+
+namespace
+{
+	thread_local AllocationCounts g_thread_counts;
+	thread_local AllocationCounts g_frame_begin_counts;
+
+	std::atomic<std::uint64_t> g_total_allocation_count{ 0 };
+	std::atomic<std::uint64_t> g_total_allocated_bytes{ 0 };
+
+	// only touched by the thread running the frame loop
+	AllocationCounts g_last_frame;
+	bool g_frame_check_enabled{ false };
+	int g_warmup_frame_count{ 0 };
+	int g_frames_since_warmup{ 0 };
+
+	void check_frame(AllocationCounts const & frame)
+	{
+		if (g_frames_since_warmup++ < g_warmup_frame_count || frame.m_allocation_count == 0)
+			return;
+
+		// rate limited by the logger, a loop that allocates every frame doesn't flood the console
+		LogWarning("AllocationTracker: a steady-state frame made {} heap allocations, {} bytes",
+			frame.m_allocation_count, frame.m_allocated_bytes);
+
+		assert(frame.m_allocation_count == 0 && "the frame loop allocated after the warm-up");
+	}
+}
+
+void AllocationTracker::RecordAllocation(std::size_t bytes)
+{
+	++g_thread_counts.m_allocation_count;
+	g_thread_counts.m_allocated_bytes += bytes;
+
+	g_total_allocation_count.fetch_add(1, std::memory_order_relaxed);
+	g_total_allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+AllocationCounts AllocationTracker::GetThreadCounts()
+{
+	return g_thread_counts;
+}
+
+AllocationCounts AllocationTracker::GetTotalCounts()
+{
+	return AllocationCounts{
+		.m_allocation_count = g_total_allocation_count.load(std::memory_order_relaxed),
+		.m_allocated_bytes = g_total_allocated_bytes.load(std::memory_order_relaxed)
+	};
+}
+
+void AllocationTracker::BeginFrame()
+{
+	g_frame_begin_counts = g_thread_counts;
+}
+
+AllocationCounts AllocationTracker::EndFrame()
+{
+	g_last_frame = AllocationCounts{
+		.m_allocation_count = g_thread_counts.m_allocation_count - g_frame_begin_counts.m_allocation_count,
+		.m_allocated_bytes = g_thread_counts.m_allocated_bytes - g_frame_begin_counts.m_allocated_bytes
+	};
+
+	if (g_frame_check_enabled)
+		check_frame(g_last_frame);
+
+	return g_last_frame;
+}
+
+AllocationCounts AllocationTracker::GetLastFrame()
+{
+	return g_last_frame;
+}
+
+void AllocationTracker::EnableFrameCheck(int warmup_frame_count)
+{
+	g_frame_check_enabled = true;
+	g_warmup_frame_count = warmup_frame_count;
+	RestartWarmup();
+}
+
+void AllocationTracker::RestartWarmup()
+{
+	g_frames_since_warmup = 0;
+}
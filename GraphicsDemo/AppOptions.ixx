@@ -0,0 +1,300 @@
+// AppOptions.ixx
+
+module;
+
+#include <charconv>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+
+export module AppOptions;
+
+// Replaces the demo objects with many randomly placed and animated copies of the same assets
+export struct StressSceneOptions
+{
+	int m_sword_count{ 0 };
+	int m_gem_count{ 0 };
+	int m_quad_count{ 0 };
+	int m_light_count{ 3 }; // only the three nearest the camera are passed to the shaders each frame
+	int m_pipeline_copies{ 1 }; // copies of each pipeline, objects are spread across them
+	std::uint32_t m_seed{ 1 };
+};
+
+// A frame is a hitch when it takes longer than m_median_factor times the median of the recent frames, or than m_budget_ms.
+// The cpu zones, gpu timings and renderer counters around each hitch are written as a chrome trace
+export struct HitchOptions
+{
+	std::string m_output_dir; // enables the monitor and the cpu profiler when set
+	double m_median_factor{ 2.5 };
+	double m_budget_ms{ 100.0 }; // 0 only compares against the median
+	double m_capture_before_s{ 2.0 };
+	double m_capture_after_s{ 1.0 };
+	int m_max_captures{ 10 }; // per run, so a stuttering app doesn't fill the disk
+};
+
+export enum class PresentMode
+{
+	FIFO, // waits for the vertical blank, never tears
+	MAILBOX, // waits for the vertical blank, a newer frame replaces the queued one
+	IMMEDIATE // doesn't wait, may tear
+};
+
+// Trades throughput for latency: fewer frames queued ahead of the display means the one shown is more recent,
+// at the cost of the cpu and gpu waiting on each other more often
+export struct FramePacingOptions
+{
+	constexpr static int m_max_frames_in_flight = 3;
+
+	int m_frames_in_flight{ 2 }; // vulkan, 1 to m_max_frames_in_flight
+	PresentMode m_present_mode{ PresentMode::MAILBOX }; // vulkan, falls back on fifo when the surface doesn't support it
+	int m_swap_interval{ 1 }; // opengl, vertical blanks to wait for on each swap, 0 doesn't wait
+	double m_max_fps{ 0.0 }; // windowed only, 0 doesn't limit the frame rate
+	bool m_render_on_demand{ false }; // windowed only, draws a frame only when the scene changed or an event arrived
+};
+
+export char const * GetPresentModeName(PresentMode mode)
+{
+	switch (mode)
+	{
+	case PresentMode::FIFO: return "fifo";
+	case PresentMode::MAILBOX: return "mailbox";
+	case PresentMode::IMMEDIATE: return "immediate";
+	default: return "unknown";
+	}
+}
+
+export struct AppOptions
+{
+	int m_width{ 1920 };
+	int m_height{ 1080 };
+
+	bool m_headless{ false };
+	int m_frame_count{ 300 }; // headless only, the windowed app runs until the window is closed
+	std::string m_capture_path; // headless only, writes the last frame as a binary ppm when set
+
+	bool m_benchmark{ false }; // implies headless, m_frame_count frames are measured after the warm-up
+	int m_warmup_frame_count{ 60 };
+	std::string m_benchmark_json_path; // the json report goes to stdout when empty
+
+	std::optional<StressSceneOptions> m_stress_scene;
+
+	double m_simulation_rate{ 60.0 }; // fixed steps per second, headless runs step once per frame
+
+	FramePacingOptions m_pacing;
+
+	std::string m_record_path; // logs the delta time and key state of every simulation step
+	std::string m_replay_path; // replaces the wall clock and live input with a recording, headless runs use its frame count
+
+	std::string m_trace_path; // enables the cpu profiler and writes a chrome trace on exit when set
+
+	HitchOptions m_hitch;
+
+	double m_memory_budget_mb{ 0.0 }; // warns when the tracked gpu memory goes over it, 0 disables it
+
+	bool m_verbose{ false }; // also logs verbose messages, e.g. OpenGL's debug notifications
+
+	bool m_alloc_check{ false }; // reports frames that heap allocate after m_warmup_frame_count frames, asserts in debug builds
+};
+
+export enum class GraphicsBackend
+{
+	VULKAN,
+	OPENGL
+};
+
+// backend rejects the options it can't honor, --in-flight for opengl
+export std::optional<AppOptions> ParseAppOptions(int argc, char ** argv, GraphicsBackend backend);
+
+namespace
+{
+	void print_usage(char const * exe_name)
+	{
+		std::cout << "Usage: " << exe_name << " [options]\n"
+			<< "  --width <pixels>      width of the window or offscreen image\n"
+			<< "  --height <pixels>     height of the window or offscreen image\n"
+			<< "  --headless            render offscreen without a window, surface or swap chain\n"
+			<< "  --frames <count>      number of frames to render when headless\n"
+			<< "  --capture <file.ppm>  write the last headless frame to an image\n"
+			<< "  --benchmark           headless run that reports frame time percentiles\n"
+			<< "  --warmup <count>      number of unmeasured frames before a benchmark\n"
+			<< "  --json <file.json>    write the benchmark report to a file instead of stdout\n"
+			<< "  --stress <count>      stress scene with count objects split between swords, gems and quads\n"
+			<< "  --swords <count>      number of swords in the stress scene\n"
+			<< "  --gems <count>        number of gems in the stress scene\n"
+			<< "  --quads <count>       number of textured quads in the stress scene\n"
+			<< "  --lights <count>      number of moving point lights in the stress scene\n"
+			<< "  --pipelines <count>   copies of each pipeline in the stress scene\n"
+			<< "  --seed <value>        random seed for the stress scene\n"
+			<< "  --in-flight <count>   frames the cpu may queue ahead of the gpu, 1 to 3 (vulkan)\n"
+			<< "  --present-mode <mode> fifo, mailbox or immediate (vulkan)\n"
+			<< "  --swap-interval <n>   vertical blanks to wait for on each swap, 0 doesn't wait (opengl)\n"
+			<< "  --max-fps <fps>       limit the frame rate of the window, 0 doesn't limit it\n"
+			<< "  --on-demand           draw only when something changed, P pauses the animation\n"
+			<< "  --sim-rate <hz>       fixed simulation steps per second, the frames interpolate between them\n"
+			<< "  --record <file>       record the delta time and key state of every simulation step\n"
+			<< "  --replay <file>       replay a recording instead of the clock and live input\n"
+			<< "  --trace <file.json>   profile cpu zones and write a chrome trace on exit\n"
+			<< "  --hitch-dir <dir>     write a trace of the seconds around every frame hitch to dir\n"
+			<< "  --hitch-factor <x>    a frame slower than x times the median is a hitch\n"
+			<< "  --hitch-budget <ms>   a frame slower than this is a hitch, 0 disables it\n"
+			<< "  --memory-budget <MB>  warn when the tracked gpu memory goes over this\n"
+			<< "  --alloc-check         report frames that allocate on the heap after the warm-up\n"
+			<< "  --verbose             log verbose messages too" << std::endl;
+	}
+
+	bool parse_int(std::string_view arg, int min_value, int & out_value)
+	{
+		int value = 0;
+		auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), value);
+		if (ec != std::errc{} || ptr != arg.data() + arg.size() || value < min_value)
+			return false;
+
+		out_value = value;
+		return true;
+	}
+
+	bool parse_positive_int(std::string_view arg, int & out_value)
+	{
+		return parse_int(arg, 1, out_value);
+	}
+
+	bool parse_double(std::string_view arg, double min_value, double & out_value)
+	{
+		double value = 0.0;
+		auto [ptr, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), value);
+		if (ec != std::errc{} || ptr != arg.data() + arg.size() || value < min_value)
+			return false;
+
+		out_value = value;
+		return true;
+	}
+
+	bool parse_present_mode(std::string_view arg, PresentMode & out_mode)
+	{
+		for (PresentMode mode : { PresentMode::FIFO, PresentMode::MAILBOX, PresentMode::IMMEDIATE })
+		{
+			if (arg == GetPresentModeName(mode))
+			{
+				out_mode = mode;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	StressSceneOptions & stress_scene(AppOptions & options)
+	{
+		if (!options.m_stress_scene.has_value())
+			options.m_stress_scene = StressSceneOptions{};
+		return options.m_stress_scene.value();
+	}
+}
+
+std::optional<AppOptions> ParseAppOptions(int argc, char ** argv, GraphicsBackend backend)
+{
+	AppOptions options;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string_view const arg{ argv[i] };
+		bool const has_value = i + 1 < argc;
+
+		bool valid = true;
+		if (arg == "--headless")
+			options.m_headless = true;
+		else if (arg == "--width")
+			valid = has_value && parse_positive_int(argv[++i], options.m_width);
+		else if (arg == "--height")
+			valid = has_value && parse_positive_int(argv[++i], options.m_height);
+		else if (arg == "--frames")
+			valid = has_value && parse_positive_int(argv[++i], options.m_frame_count);
+		else if (arg == "--capture" && has_value)
+			options.m_capture_path = argv[++i];
+		else if (arg == "--benchmark")
+			options.m_benchmark = true;
+		else if (arg == "--warmup")
+			valid = has_value && parse_int(argv[++i], 0, options.m_warmup_frame_count);
+		else if (arg == "--json" && has_value)
+			options.m_benchmark_json_path = argv[++i];
+		else if (arg == "--stress" && has_value)
+		{
+			int object_count = 0;
+			valid = parse_int(argv[++i], 0, object_count);
+			StressSceneOptions & stress = stress_scene(options);
+			stress.m_sword_count = object_count / 3;
+			stress.m_gem_count = object_count / 3;
+			stress.m_quad_count = object_count - 2 * (object_count / 3);
+		}
+		else if (arg == "--swords")
+			valid = has_value && parse_int(argv[++i], 0, stress_scene(options).m_sword_count);
+		else if (arg == "--gems")
+			valid = has_value && parse_int(argv[++i], 0, stress_scene(options).m_gem_count);
+		else if (arg == "--quads")
+			valid = has_value && parse_int(argv[++i], 0, stress_scene(options).m_quad_count);
+		else if (arg == "--lights")
+			valid = has_value && parse_int(argv[++i], 0, stress_scene(options).m_light_count);
+		else if (arg == "--pipelines")
+			valid = has_value && parse_positive_int(argv[++i], stress_scene(options).m_pipeline_copies);
+		else if (arg == "--in-flight")
+		{
+			// opengl has no control over how many frames the driver queues
+			valid = backend == GraphicsBackend::VULKAN && has_value
+				&& parse_positive_int(argv[++i], options.m_pacing.m_frames_in_flight)
+				&& options.m_pacing.m_frames_in_flight <= FramePacingOptions::m_max_frames_in_flight;
+		}
+		else if (arg == "--present-mode")
+			valid = has_value && parse_present_mode(argv[++i], options.m_pacing.m_present_mode);
+		else if (arg == "--swap-interval")
+			valid = has_value && parse_int(argv[++i], 0, options.m_pacing.m_swap_interval);
+		else if (arg == "--max-fps")
+			valid = has_value && parse_double(argv[++i], 0.0, options.m_pacing.m_max_fps);
+		else if (arg == "--on-demand")
+			options.m_pacing.m_render_on_demand = true;
+		else if (arg == "--sim-rate")
+			valid = has_value && parse_double(argv[++i], 1.0, options.m_simulation_rate);
+		else if (arg == "--record" && has_value)
+			options.m_record_path = argv[++i];
+		else if (arg == "--replay" && has_value)
+			options.m_replay_path = argv[++i];
+		else if (arg == "--trace" && has_value)
+			options.m_trace_path = argv[++i];
+		else if (arg == "--hitch-dir" && has_value)
+			options.m_hitch.m_output_dir = argv[++i];
+		else if (arg == "--hitch-factor")
+			valid = has_value && parse_double(argv[++i], 1.0, options.m_hitch.m_median_factor);
+		else if (arg == "--hitch-budget")
+			valid = has_value && parse_double(argv[++i], 0.0, options.m_hitch.m_budget_ms);
+		else if (arg == "--memory-budget")
+			valid = has_value && parse_double(argv[++i], 0.0, options.m_memory_budget_mb);
+		else if (arg == "--verbose")
+			options.m_verbose = true;
+		else if (arg == "--alloc-check")
+			options.m_alloc_check = true;
+		else if (arg == "--seed")
+		{
+			int seed = 0;
+			valid = has_value && parse_int(argv[++i], 0, seed);
+			stress_scene(options).m_seed = static_cast<std::uint32_t>(seed);
+		}
+		else
+			valid = false;
+
+		if (!valid)
+		{
+			std::cout << "Invalid command line argument: " << arg << std::endl;
+			print_usage(argv[0]);
+			return std::nullopt;
+		}
+	}
+
+	if (options.m_benchmark)
+		options.m_headless = true;
+
+	if (!options.m_capture_path.empty() && !options.m_headless)
+		std::cout << "--capture is only supported with --headless, ignoring it" << std::endl;
+
+	return options;
+}
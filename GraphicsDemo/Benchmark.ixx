@@ -0,0 +1,339 @@
+// Benchmark.ixx
+
+module;
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+export module Benchmark;
+
+import Json;
+import MemoryLedger;
+
+// Gpu cost of one pipeline in one frame, the counters are only there on backends with pipeline statistics
+export struct GpuPipelineSample
+{
+	std::uint32_t m_pipeline_index{ 0 };
+	double m_time_ms{ 0.0 };
+	std::optional<std::uint64_t> m_vertex_shader_invocations;
+	std::optional<std::uint64_t> m_clipping_primitives;
+	std::optional<std::uint64_t> m_fragment_shader_invocations;
+};
+
+// Collects per-frame timings of a benchmark run and reports percentiles as a table and as JSON
+export class BenchmarkReport
+{
+public:
+	BenchmarkReport(std::string backend, std::string device, int width, int height, int warmup_frame_count)
+		: m_backend(std::move(backend))
+		, m_device(std::move(device))
+		, m_width(width)
+		, m_height(height)
+		, m_warmup_frame_count(warmup_frame_count)
+	{}
+
+	void AddFrame(double cpu_update_ms, double cpu_render_submit_ms, std::optional<double> gpu_ms);
+	// For backends whose gpu results arrive separately from the cpu frame they belong to
+	void AddGpuFrame(double gpu_ms) { m_gpu_ms.push_back(gpu_ms); }
+	void AddGpuPipelineSamples(std::vector<GpuPipelineSample> const & samples);
+	void SetWallTime(double wall_time_ms) { m_wall_time_ms = wall_time_ms; }
+
+	// Takes the memory ledger's usage and peaks along with the device heaps, call at the end of the run
+	void CaptureMemory(std::vector<MemoryHeapBudget> heaps);
+
+	void PrintTable() const;
+	std::string ToJson() const;
+	bool WriteJson(std::string const & path) const;
+
+private:
+	struct Summary
+	{
+		std::size_t m_count{ 0 };
+		double m_mean{ 0.0 };
+		double m_p50{ 0.0 };
+		double m_p95{ 0.0 };
+		double m_p99{ 0.0 };
+		double m_max{ 0.0 };
+	};
+
+	struct PipelineSamples
+	{
+		std::vector<double> m_time_ms;
+		std::size_t m_statistics_count{ 0 };
+		std::uint64_t m_vertex_shader_invocations{ 0 }; // sums over m_statistics_count frames
+		std::uint64_t m_clipping_primitives{ 0 };
+		std::uint64_t m_fragment_shader_invocations{ 0 };
+	};
+
+	static Summary summarize(std::vector<double> samples);
+	static std::string summary_to_json(Summary const & summary);
+	static std::string pipeline_to_json(std::uint32_t pipeline_index, PipelineSamples const & samples);
+	static std::string usage_to_json(MemoryUsage const & usage);
+	std::string memory_to_json() const;
+
+	double frames_per_second() const;
+
+private:
+	std::string m_backend;
+	std::string m_device;
+	int m_width{ 0 };
+	int m_height{ 0 };
+	int m_warmup_frame_count{ 0 };
+
+	double m_wall_time_ms{ 0.0 };
+
+	std::vector<double> m_cpu_update_ms;
+	std::vector<double> m_cpu_render_submit_ms;
+	std::vector<double> m_gpu_ms; // may have fewer samples, gpu timings arrive a few frames late or not at all
+	std::map<std::uint32_t, PipelineSamples> m_gpu_pipelines;
+
+	bool m_memory_captured{ false };
+	MemoryUsage m_memory_total;
+	std::array<MemoryUsage, static_cast<std::size_t>(MemoryCategory::COUNT)> m_memory_categories;
+	std::vector<AssetMemoryUsage> m_memory_assets;
+	std::uint64_t m_memory_budget{ 0 };
+	std::vector<MemoryHeapBudget> m_memory_heaps;
+};
+
+void BenchmarkReport::AddFrame(double cpu_update_ms, double cpu_render_submit_ms, std::optional<double> gpu_ms)
+{
+	m_cpu_update_ms.push_back(cpu_update_ms);
+	m_cpu_render_submit_ms.push_back(cpu_render_submit_ms);
+	if (gpu_ms.has_value())
+		m_gpu_ms.push_back(gpu_ms.value());
+}
+
+void BenchmarkReport::AddGpuPipelineSamples(std::vector<GpuPipelineSample> const & samples)
+{
+	for (GpuPipelineSample const & sample : samples)
+	{
+		PipelineSamples & pipeline = m_gpu_pipelines[sample.m_pipeline_index];
+		pipeline.m_time_ms.push_back(sample.m_time_ms);
+
+		if (sample.m_vertex_shader_invocations.has_value())
+		{
+			++pipeline.m_statistics_count;
+			pipeline.m_vertex_shader_invocations += sample.m_vertex_shader_invocations.value();
+			pipeline.m_clipping_primitives += sample.m_clipping_primitives.value_or(0);
+			pipeline.m_fragment_shader_invocations += sample.m_fragment_shader_invocations.value_or(0);
+		}
+	}
+}
+
+BenchmarkReport::Summary BenchmarkReport::summarize(std::vector<double> samples)
+{
+	Summary summary;
+	if (samples.empty())
+		return summary;
+
+	std::ranges::sort(samples);
+
+	// nearest-rank percentile, the smallest sample with at least p percent of them at or below it
+	auto percentile = [&samples](double p)
+		{
+			std::size_t rank = static_cast<std::size_t>(std::ceil(p / 100.0 * static_cast<double>(samples.size())));
+			rank = std::clamp<std::size_t>(rank, 1, samples.size());
+			return samples[rank - 1];
+		};
+
+	double sum = 0.0;
+	for (double sample : samples)
+		sum += sample;
+
+	summary.m_count = samples.size();
+	summary.m_mean = sum / static_cast<double>(samples.size());
+	summary.m_p50 = percentile(50.0);
+	summary.m_p95 = percentile(95.0);
+	summary.m_p99 = percentile(99.0);
+	summary.m_max = samples.back();
+	return summary;
+}
+
+void BenchmarkReport::CaptureMemory(std::vector<MemoryHeapBudget> heaps)
+{
+	m_memory_captured = true;
+	m_memory_total = MemoryLedger::GetTotalUsage();
+	for (std::size_t category = 0; category < m_memory_categories.size(); ++category)
+		m_memory_categories[category] = MemoryLedger::GetUsage(static_cast<MemoryCategory>(category));
+	m_memory_assets = MemoryLedger::GetAssetUsage();
+	m_memory_budget = MemoryLedger::GetBudget();
+	m_memory_heaps = std::move(heaps);
+}
+
+double BenchmarkReport::frames_per_second() const
+{
+	if (m_wall_time_ms <= 0.0)
+		return 0.0;
+
+	return static_cast<double>(m_cpu_update_ms.size()) * 1000.0 / m_wall_time_ms;
+}
+
+void BenchmarkReport::PrintTable() const
+{
+	std::cout << std::format("Benchmark: {} on {}, {}x{}, {} warm-up + {} measured frames\n",
+		m_backend, m_device, m_width, m_height, m_warmup_frame_count, m_cpu_update_ms.size());
+	std::cout << std::format("{:<20} {:>8} {:>10} {:>10} {:>10} {:>10} {:>10}\n",
+		"(ms)", "samples", "mean", "p50", "p95", "p99", "max");
+
+	auto print_row = [](char const * name, Summary const & s)
+		{
+			if (s.m_count == 0)
+			{
+				std::cout << std::format("{:<20} {:>8}\n", name, "n/a");
+				return;
+			}
+			std::cout << std::format("{:<20} {:>8} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}\n",
+				name, s.m_count, s.m_mean, s.m_p50, s.m_p95, s.m_p99, s.m_max);
+		};
+
+	print_row("cpu update", summarize(m_cpu_update_ms));
+	print_row("cpu render+submit", summarize(m_cpu_render_submit_ms));
+	print_row("gpu frame", summarize(m_gpu_ms));
+	for (auto const & [pipeline_index, samples] : m_gpu_pipelines)
+		print_row(std::format("gpu pipeline {}", pipeline_index).c_str(), summarize(samples.m_time_ms));
+
+	std::cout << std::format("Throughput: {:.1f} fps ({:.1f} ms wall time)", frames_per_second(), m_wall_time_ms) << std::endl;
+
+	if (!m_memory_captured)
+		return;
+
+	auto to_mb = [](std::uint64_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); };
+
+	std::cout << std::format("{:<20} {:>10} {:>10}\n", "memory (MB)", "current", "peak");
+	std::cout << std::format("{:<20} {:>10.2f} {:>10.2f}\n", "total", to_mb(m_memory_total.m_current_bytes), to_mb(m_memory_total.m_peak_bytes));
+	for (std::size_t category = 0; category < m_memory_categories.size(); ++category)
+	{
+		MemoryUsage const & usage = m_memory_categories[category];
+		std::cout << std::format("{:<20} {:>10.2f} {:>10.2f}\n", MemoryLedger::GetCategoryName(static_cast<MemoryCategory>(category)),
+			to_mb(usage.m_current_bytes), to_mb(usage.m_peak_bytes));
+	}
+	for (std::size_t heap = 0; heap < m_memory_heaps.size(); ++heap)
+	{
+		MemoryHeapBudget const & h = m_memory_heaps[heap];
+		std::cout << std::format("heap {}{}: {:.1f} MB", heap, h.m_device_local ? " (device local)" : "", to_mb(h.m_size));
+		if (h.m_budget.has_value() && h.m_usage.has_value())
+			std::cout << std::format(", {:.1f} MB used of a {:.1f} MB budget", to_mb(h.m_usage.value()), to_mb(h.m_budget.value()));
+		std::cout << '\n';
+	}
+	std::cout << std::flush;
+}
+
+std::string BenchmarkReport::summary_to_json(Summary const & s)
+{
+	if (s.m_count == 0)
+		return "null";
+
+	return std::format(R"({{ "samples": {}, "mean": {:.4f}, "p50": {:.4f}, "p95": {:.4f}, "p99": {:.4f}, "max": {:.4f} }})",
+		s.m_count, s.m_mean, s.m_p50, s.m_p95, s.m_p99, s.m_max);
+}
+
+std::string BenchmarkReport::pipeline_to_json(std::uint32_t pipeline_index, PipelineSamples const & samples)
+{
+	// per frame averages of the counters
+	auto mean_counter = [&samples](std::uint64_t sum)
+		{
+			if (samples.m_statistics_count == 0)
+				return std::string{ "null" };
+			return std::format("{:.1f}", static_cast<double>(sum) / static_cast<double>(samples.m_statistics_count));
+		};
+
+	return std::format(R"({{ "pipeline": {}, "time_ms": {}, "vertex_shader_invocations": {}, "clipping_primitives": {}, "fragment_shader_invocations": {} }})",
+		pipeline_index, summary_to_json(summarize(samples.m_time_ms)),
+		mean_counter(samples.m_vertex_shader_invocations),
+		mean_counter(samples.m_clipping_primitives),
+		mean_counter(samples.m_fragment_shader_invocations));
+}
+
+std::string BenchmarkReport::usage_to_json(MemoryUsage const & usage)
+{
+	return std::format(R"({{ "current_bytes": {}, "peak_bytes": {}, "allocations": {} }})",
+		usage.m_current_bytes, usage.m_peak_bytes, usage.m_allocation_count);
+}
+
+std::string BenchmarkReport::memory_to_json() const
+{
+	if (!m_memory_captured)
+		return "null";
+
+	auto optional_to_json = [](std::optional<std::uint64_t> const & value)
+		{
+			return value.has_value() ? std::format("{}", value.value()) : std::string{ "null" };
+		};
+
+	std::string json = "{\n";
+	json += std::format("\t\t\"budget_bytes\": {},\n", m_memory_budget);
+	json += std::format("\t\t\"total\": {},\n", usage_to_json(m_memory_total));
+	json += "\t\t\"categories\": {";
+	for (std::size_t category = 0; category < m_memory_categories.size(); ++category)
+	{
+		json += std::format("{}\n\t\t\t\"{}\": {}", category == 0 ? "" : ",",
+			MemoryLedger::GetCategoryName(static_cast<MemoryCategory>(category)), usage_to_json(m_memory_categories[category]));
+	}
+	json += "\n\t\t},\n";
+	json += "\t\t\"assets\": [";
+	for (std::size_t i = 0; i < m_memory_assets.size(); ++i)
+	{
+		AssetMemoryUsage const & asset = m_memory_assets[i];
+		std::string const asset_json = std::format(R"({{ "category": "{}", "name": "{}", "usage": {} }})",
+			MemoryLedger::GetCategoryName(asset.m_category), EscapeJson(asset.m_name), usage_to_json(asset.m_usage));
+		json += std::format("{}\n\t\t\t{}", i == 0 ? "" : ",", asset_json);
+	}
+	json += m_memory_assets.empty() ? "],\n" : "\n\t\t],\n";
+	json += "\t\t\"heaps\": [";
+	for (std::size_t heap = 0; heap < m_memory_heaps.size(); ++heap)
+	{
+		MemoryHeapBudget const & h = m_memory_heaps[heap];
+		std::string const heap_json = std::format(R"({{ "size_bytes": {}, "device_local": {}, "budget_bytes": {}, "usage_bytes": {} }})",
+			h.m_size, h.m_device_local ? "true" : "false", optional_to_json(h.m_budget), optional_to_json(h.m_usage));
+		json += std::format("{}\n\t\t\t{}", heap == 0 ? "" : ",", heap_json);
+	}
+	json += m_memory_heaps.empty() ? "]\n" : "\n\t\t]\n";
+	json += "\t}";
+	return json;
+}
+
+std::string BenchmarkReport::ToJson() const
+{
+	std::string json = "{\n";
+	json += std::format("\t\"backend\": \"{}\",\n", m_backend);
+	json += std::format("\t\"device\": \"{}\",\n", EscapeJson(m_device));
+	json += std::format("\t\"width\": {},\n", m_width);
+	json += std::format("\t\"height\": {},\n", m_height);
+	json += std::format("\t\"warmup_frames\": {},\n", m_warmup_frame_count);
+	json += std::format("\t\"measured_frames\": {},\n", m_cpu_update_ms.size());
+	json += std::format("\t\"wall_time_ms\": {:.4f},\n", m_wall_time_ms);
+	json += std::format("\t\"fps\": {:.4f},\n", frames_per_second());
+	json += std::format("\t\"cpu_update_ms\": {},\n", summary_to_json(summarize(m_cpu_update_ms)));
+	json += std::format("\t\"cpu_render_submit_ms\": {},\n", summary_to_json(summarize(m_cpu_render_submit_ms)));
+	json += std::format("\t\"gpu_frame_ms\": {},\n", summary_to_json(summarize(m_gpu_ms)));
+	json += "\t\"gpu_pipelines\": [";
+	bool first_pipeline = true;
+	for (auto const & [pipeline_index, samples] : m_gpu_pipelines)
+	{
+		json += std::format("{}\n\t\t{}", first_pipeline ? "" : ",", pipeline_to_json(pipeline_index, samples));
+		first_pipeline = false;
+	}
+	json += m_gpu_pipelines.empty() ? "],\n" : "\n\t],\n";
+	json += std::format("\t\"memory\": {}\n", memory_to_json());
+	json += "}\n";
+	return json;
+}
+
+bool BenchmarkReport::WriteJson(std::string const & path) const
+{
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	file << ToJson();
+	return file.good();
+}
@@ -2,19 +2,99 @@
 
 module;
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <span>
+#include <stop_token>
 #include <thread>
+#include <vector>
+
+#include <glad/glad.h>
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
 module GLApp;
 
+import AllocationTracker;
+import Benchmark;
+import FixedStepThread;
+import FrameLimiter;
 import GraphicsApi;
+import HeadlessContext;
+import HitchMonitor;
+import Hud;
+import Input;
+import InputRecording;
+import Log;
+import MemoryLedger;
+import Profiler;
+import RenderStats;
+import RenderTarget;
 import Scene;
 
-GLApp::GLApp(WindowSize window_size, std::string title)
+namespace
+{
+	bool write_ppm(std::string const & path, int width, int height, std::vector<std::uint8_t> const & rgba_pixels)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		file << "P6\n" << width << " " << height << "\n255\n";
+		for (size_t i = 0; i < rgba_pixels.size(); i += 4)
+			file.write(reinterpret_cast<char const *>(&rgba_pixels[i]), 3);
+
+		return file.good();
+	}
+
+	std::vector<GpuPipelineSample> to_pipeline_samples(std::vector<GpuPipelineTiming> const & timings)
+	{
+		std::vector<GpuPipelineSample> samples;
+		for (GpuPipelineTiming const & timing : timings)
+		{
+			samples.push_back(GpuPipelineSample{
+				.m_pipeline_index = timing.m_pipeline_index,
+				.m_time_ms = timing.m_time_ms
+				});
+		}
+		return samples;
+	}
+}
+
+GLApp::GLApp(AppOptions const & options, std::string title)
+	: m_options(options)
 {
+	// Enabled before anything else so loading and the first frames show up in the trace too
+	if (!options.m_trace_path.empty() || !options.m_hitch.m_output_dir.empty())
+	{
+		Profiler::SetEnabled(true);
+		Profiler::SetThreadName("main");
+	}
+
+	MemoryLedger::SetBudget(static_cast<std::uint64_t>(options.m_memory_budget_mb * 1024.0 * 1024.0));
+
+	if (options.m_alloc_check)
+		AllocationTracker::EnableFrameCheck(options.m_warmup_frame_count);
+
+	WindowSize window_size{ options.m_width, options.m_height };
+
+	// Headless runs create their own EGL context in Run(), glfw is only needed as a fallback
+	if (options.m_headless)
+	{
+		if (!HeadlessContext::IsCompiledIn())
+		{
+			LogError("--headless needs EGL, which this build doesn't include. Build with the EGL headers and link libEGL");
+			return;
+		}
+
+		m_intialized = true;
+		return;
+	}
+
 	glfwSetErrorCallback([](int error, const char * description)
 		{
 			std::cout << "GLFW Error: " << error << " " << description;
@@ -43,57 +123,401 @@ GLApp::GLApp(WindowSize window_size, std::string title)
 			GLApp * app = static_cast<GLApp *>(glfwGetWindowUserPointer(window));
 			app->OnKeyEvent(key, scan_code, action, mods);
 		});
+	glfwSetWindowRefreshCallback(m_window, [](GLFWwindow * window)
+		{
+			GLApp * app = static_cast<GLApp *>(glfwGetWindowUserPointer(window));
+			app->OnWindowRefresh();
+		});
 
 	OnWindowResize(window_size);
 }
 
 GLApp::~GLApp()
 {
-	if (IsInitialized())
+	// Run() has joined the render thread by now, so no zone is being recorded while the trace is written
+	if (!m_options.m_trace_path.empty())
+	{
+		Profiler::SetEnabled(false);
+		if (Profiler::WriteChromeTrace(m_options.m_trace_path))
+			std::cout << "Wrote trace: " << m_options.m_trace_path << std::endl;
+		else
+			std::cout << "Failed to write trace: " << m_options.m_trace_path << std::endl;
+	}
+
+	// the scene and its gl objects only live inside Run(), anything still in the ledger was never freed
+	MemoryLedger::ReportLeaks();
+
+	if (IsInitialized() && !IsHeadless())
 		glfwTerminate();
 }
 
 void GLApp::Run()
 {
+	if (IsInitialized() && IsHeadless())
+	{
+		run_headless();
+		return;
+	}
+
 	if (!IsInitialized() || !HasWindow())
 		return;
 
-	std::jthread update_render_loop([&window = m_window, &new_window_size = m_new_window_size, &input = m_input](std::stop_token s_token)
+	std::jthread update_render_loop([&window = m_window, &new_window_size = m_new_window_size, &key_events = m_key_events, &live_keys = m_live_keys, &redraw = m_redraw, &show_hud = m_show_hud, &options = m_options](std::stop_token s_token)
 		{
+			Profiler::SetThreadName("render");
 			glfwMakeContextCurrent(window);
+			glfwSwapInterval(options.m_pacing.m_swap_interval); // the driver's default varies, it may even be forced off
 
 			GraphicsApi graphics_api{ reinterpret_cast<GraphicsApi::LoadProcFn *>(glfwGetProcAddress) };
 
-			Scene scene;
-			scene;
-			scene.Init();
+			Scene scene{ graphics_api };
+			scene.Init(options.m_stress_scene);
+
+			Hud hud{ graphics_api, "shaders" };
+			scene.SetOverlayCallback([&hud]() { hud.Render(); });
 
+			using Clock = std::chrono::steady_clock;
+			using Milliseconds = std::chrono::duration<double, std::milli>;
+			double cpu_time_ms = 0.0; // interpolating and rendering the previous frame, shown by the hud
+
+			std::optional<HitchMonitor> hitch_monitor;
+			if (!options.m_hitch.m_output_dir.empty())
+				hitch_monitor.emplace(options.m_hitch);
+
+			std::optional<InputRecorder> recorder;
+			if (!options.m_record_path.empty())
+				recorder.emplace(options.m_record_path);
+
+			std::optional<InputReplayer> replayer;
+			Input replay_input;
+			if (!options.m_replay_path.empty())
+				replayer.emplace(options.m_replay_path);
+
+			// The simulation steps at a fixed rate on its own thread while this one renders, the frames are placed in
+			// between its snapshots so the animation stays smooth whatever the frame rate
+			Input input; // the key state as of the last step
+			FixedStepThread simulation{ options.m_simulation_rate, glfwGetTime,
+				[&](double step_time, double delta_time)
+				{
+					// the main thread only queues key events, a replay uses its own copy so the keyboard can't interfere
+					key_events.ApplyUntil(step_time, input);
+					Input const * step_input = &input;
+					if (replayer.has_value() && replayer->IsValid())
+					{
+						if (replayer->IsFinished())
+						{
+							glfwSetWindowShouldClose(window, true);
+							glfwPostEmptyEvent(); // wakes the main thread
+							return;
+						}
+						delta_time = replayer->NextFrame(replay_input);
+						step_input = &replay_input;
+					}
+
+					if (recorder.has_value())
+						recorder->RecordFrame(delta_time, *step_input);
+
+					if (scene.Simulate(step_time, delta_time, *step_input).Any())
+						redraw.Request();
+				} };
+
+			// The camera is moved with the keys held right now rather than waiting for the simulation to step with them,
+			// once when the frame is extracted and again just before it's drawn. A replay shows the recorded camera
+			bool const predict_camera = !replayer.has_value() || !replayer->IsValid();
+
+			// a step behind the simulation, so the frame falls between the last two snapshots
+			Clock::time_point sample_time; // when the frame sampled the simulation or the input, its latency starts there
+			auto prepare_frame = [&scene, &simulation, &sample_time, &live_keys, predict_camera]()
+				{
+					sample_time = Clock::now();
+					scene.Interpolate(glfwGetTime() - simulation.GetStepDuration());
+					if (predict_camera)
+						scene.PredictCamera(glfwGetTime(), live_keys.Load());
+					scene.Extract();
+				};
+			bool frame_prepared = false;
+
+			FrameLimiter frame_limiter{ options.m_pacing.m_max_fps };
 			double last_update_time = glfwGetTime();
 
+			// On demand, a frame where nothing changed ends the drawing until something asks for a new one
+			bool const render_on_demand = options.m_pacing.m_render_on_demand;
+			bool scene_changed = true;
+			std::uint64_t drawn_redraw_requests = redraw.GetRequestCount();
+			std::stop_callback wake_on_stop{ s_token, [&redraw]() { redraw.Request(); } };
+			if (render_on_demand)
+				LogInfo("Rendering on demand, P pauses the animation");
+
 			while (!s_token.stop_requested())
 			{
+				if (render_on_demand && !scene_changed && redraw.GetRequestCount() == drawn_redraw_requests)
+				{
+					{
+						ProfileZone idle_zone{ "wait for changes" };
+						redraw.Wait(drawn_redraw_requests);
+					}
+					frame_prepared = false; // prepared before the wait, it's out of date now
+					last_update_time = glfwGetTime();
+					if (hitch_monitor.has_value())
+						hitch_monitor->RestartFrameClock();
+					continue;
+				}
+				drawn_redraw_requests = redraw.GetRequestCount();
+
+				// before the frame samples the scene, so the wait doesn't add to its latency
+				if (frame_limiter.IsEnabled())
+				{
+					ProfileZone limiter_zone{ "frame limiter" };
+					FrameStats::Current().m_limiter_wait_us += static_cast<std::uint64_t>(frame_limiter.Wait() * 1000.0);
+				}
+
+				ProfileZone frame_zone{ "frame" };
+				AllocationTracker::BeginFrame();
+				graphics_api.GetFrameArena().Reset();
+
 				std::optional<WindowSize> size = new_window_size.exchange(std::nullopt);
 				if (size.has_value())
+				{
 					scene.OnViewportResized(size->m_width, size->m_height);
+					AllocationTracker::RestartWarmup(); // the first frames at the new size fill caches again
+					frame_prepared = false; // culled with the old projection
+				}
 
 				double cur_time = glfwGetTime();
 				double delta_time = cur_time - last_update_time;
 				last_update_time = cur_time;
 
-				scene.Update(delta_time, input);
+				hud.SetVisible(show_hud.load());
+				hud.Update(delta_time * 1000.0, cpu_time_ms, scene.GetRenderer().GetPipelineCount());
+
+				Clock::time_point const update_start = Clock::now();
+				if (!frame_prepared)
+					prepare_frame();
+
+				// the per-frame constants are set while drawing, this is the latest the camera can still move
+				if (predict_camera)
+				{
+					ProfileZone late_latch_zone{ "late latch" };
+					sample_time = Clock::now();
+					scene.PredictCamera(glfwGetTime(), live_keys.Load());
+				}
+				scene_changed = scene.ConsumeChanges().Any();
+
+				graphics_api.BeginFrameTimer();
 				scene.Render();
+				graphics_api.EndFrameTimer();
+				Clock::time_point const rendered_sample_time = sample_time;
+
+				// the next frame is extracted while the gpu works through this one, before the swap waits for it.
+				// With the limiter on it's prepared after the limiter's wait instead, the wait would add to its latency
+				if (!frame_limiter.IsEnabled())
+				{
+					prepare_frame();
+					frame_prepared = true;
+				}
+				cpu_time_ms = Milliseconds(Clock::now() - update_start).count();
+
+				{
+					ProfileZone swap_zone{ "glfwSwapBuffers" };
+					Clock::time_point const swap_start = Clock::now();
+					glfwSwapBuffers(window);
+					FrameStats::Current().m_present_wait_us += static_cast<std::uint64_t>(
+						std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - swap_start).count());
+				}
+				// without the late latch, the frame was sampled before the previous one swapped, when it was prepared ahead
+				FrameStats::Current().m_latency_us = static_cast<std::uint64_t>(
+					std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - rendered_sample_time).count());
 
-				glfwSwapBuffers(window);
+				FrameStats::EndFrame();
+				AllocationTracker::EndFrame();
+
+				if (hitch_monitor.has_value())
+					hitch_monitor->EndFrame(graphics_api.GetLastGpuFrameTime());
 			}
 		});
 
+	// Sleeps until an event arrives instead of spinning a core, the simulation thread posts an empty one when a replay finishes
 	while (!glfwWindowShouldClose(m_window))
-		glfwPollEvents(); // must only be called from main thread
+		glfwWaitEvents(); // must only be called from main thread
+}
+
+void GLApp::run_headless()
+{
+	HeadlessContext headless_context;
+	GLFWwindow * hidden_window = nullptr;
+
+	GraphicsApi::LoadProcFn * load_proc_fn = nullptr;
+	if (headless_context.MakeCurrent())
+	{
+		load_proc_fn = &HeadlessContext::GetProcAddress;
+	}
+	else
+	{
+		// EGL is compiled in but has no working driver, an invisible window still provides a context given a display
+		std::cout << "EGL context unavailable, falling back to a hidden glfw window" << std::endl;
+		if (!glfwInit())
+			return;
+
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+		hidden_window = glfwCreateWindow(1, 1, "", nullptr, nullptr);
+		if (!hidden_window)
+		{
+			glfwTerminate();
+			return;
+		}
+
+		glfwMakeContextCurrent(hidden_window);
+		load_proc_fn = reinterpret_cast<GraphicsApi::LoadProcFn *>(glfwGetProcAddress);
+	}
+
+	std::optional<InputRecorder> recorder;
+	if (!m_options.m_record_path.empty())
+		recorder.emplace(m_options.m_record_path);
+
+	std::optional<InputReplayer> replayer;
+	if (!m_options.m_replay_path.empty())
+		replayer.emplace(m_options.m_replay_path);
+
+	// a replay renders every recorded frame and nothing more
+	int const frame_count = replayer.has_value() ? replayer->GetFrameCount() : m_options.m_frame_count;
+
+	if (!replayer.has_value() || replayer->IsValid())
+	{ // everything holding gl objects must be destroyed while the context is still current
+		GraphicsApi graphics_api{ load_proc_fn };
+
+		RenderTarget render_target{ m_options.m_width, m_options.m_height };
+		if (render_target.IsValid())
+		{
+			Scene scene{ graphics_api };
+			scene.Init(m_options.m_stress_scene);
+			scene.OnViewportResized(m_options.m_width, m_options.m_height);
+
+			render_target.Bind();
+
+			// A fixed timestep keeps the rendered frames identical between runs, whatever the speed of the device.
+			// The simulation steps once per frame on this thread, the same step the windowed app runs at
+			double const fixed_delta_time = 1.0 / m_options.m_simulation_rate;
+
+			std::optional<HitchMonitor> hitch_monitor;
+			if (!m_options.m_hitch.m_output_dir.empty())
+				hitch_monitor.emplace(m_options.m_hitch);
+
+			using Clock = std::chrono::steady_clock;
+			using Milliseconds = std::chrono::duration<double, std::milli>;
+
+			int const warmup_frame_count = m_options.m_benchmark ? m_options.m_warmup_frame_count : 0;
+			BenchmarkReport report{ "OpenGL", graphics_api.GetRendererName(),
+				m_options.m_width, m_options.m_height, warmup_frame_count };
+
+			Clock::time_point start_time = Clock::now();
+
+			for (int frame = 0; frame < warmup_frame_count + frame_count; ++frame)
+			{
+				ProfileZone frame_zone{ "frame", frame };
+				AllocationTracker::BeginFrame();
+				graphics_api.GetFrameArena().Reset();
+
+				if (frame == warmup_frame_count)
+					start_time = Clock::now();
+
+				bool const is_warmup = frame < warmup_frame_count;
+
+				// warm-up frames of a replay don't advance the scene, so the replay starts from the initial state
+				double delta_time = fixed_delta_time;
+				if (replayer.has_value())
+					delta_time = is_warmup ? 0.0 : replayer->NextFrame(m_input);
+
+				if (recorder.has_value() && !is_warmup)
+					recorder->RecordFrame(delta_time, m_input);
+
+				Clock::time_point const update_start = Clock::now();
+				scene.Update(delta_time, m_input);
+				Clock::time_point const render_start = Clock::now();
+
+				graphics_api.BeginFrameTimer();
+				scene.Render();
+				graphics_api.EndFrameTimer();
+				glFlush(); // nothing swaps buffers offscreen, so make sure the frame is actually submitted
+				Clock::time_point const render_end = Clock::now();
+				FrameStats::EndFrame();
+				AllocationTracker::EndFrame();
+
+				// the queries finish a few frames late and not one per frame, so take each result exactly once
+				std::span<GpuFrameTiming const> const gpu_frames = graphics_api.TakeCompletedGpuFrames();
+
+				if (hitch_monitor.has_value())
+					hitch_monitor->EndFrame(gpu_frames.empty() ? std::nullopt : std::optional{ gpu_frames.back().m_time_ms });
+
+				if (!is_warmup)
+				{
+					report.AddFrame(
+						Milliseconds(render_start - update_start).count(),
+						Milliseconds(render_end - render_start).count(),
+						std::nullopt);
+					for (GpuFrameTiming const & gpu_frame : gpu_frames)
+					{
+						report.AddGpuFrame(gpu_frame.m_time_ms);
+						report.AddGpuPipelineSamples(to_pipeline_samples(gpu_frame.m_pipelines));
+					}
+				}
+			}
+
+			// the last few frames are still in flight, they are measured ones unless the whole run was warm-up
+			glFinish();
+			if (frame_count > 0)
+			{
+				for (GpuFrameTiming const & gpu_frame : graphics_api.TakeCompletedGpuFrames())
+				{
+					report.AddGpuFrame(gpu_frame.m_time_ms);
+					report.AddGpuPipelineSamples(to_pipeline_samples(gpu_frame.m_pipelines));
+				}
+			}
+
+			Milliseconds const elapsed = Clock::now() - start_time;
+			report.SetWallTime(elapsed.count());
+			report.CaptureMemory(graphics_api.GetMemoryHeapBudgets());
+
+			if (m_options.m_benchmark)
+			{
+				report.PrintTable();
+				if (m_options.m_benchmark_json_path.empty())
+					std::cout << report.ToJson();
+				else if (!report.WriteJson(m_options.m_benchmark_json_path))
+					std::cout << "Failed to write benchmark report: " << m_options.m_benchmark_json_path << std::endl;
+			}
+			else
+			{
+				std::cout << "Rendered " << frame_count << " frames in " << elapsed.count() << " ms ("
+					<< elapsed.count() / std::max(frame_count, 1) << " ms/frame)" << std::endl;
+			}
+
+			if (!m_options.m_capture_path.empty())
+			{
+				std::vector<std::uint8_t> pixels;
+				render_target.ReadPixels(pixels);
+				if (write_ppm(m_options.m_capture_path, render_target.GetWidth(), render_target.GetHeight(), pixels))
+					std::cout << "Wrote capture: " << m_options.m_capture_path << std::endl;
+				else
+					std::cout << "Failed to write capture: " << m_options.m_capture_path << std::endl;
+			}
+		}
+	}
+
+	if (hidden_window)
+	{
+		glfwDestroyWindow(hidden_window);
+		glfwTerminate();
+	}
 }
 
 void GLApp::OnWindowResize(WindowSize size)
 {
 	m_new_window_size.store(size);
+	m_redraw.Request();
 }
 
 void GLApp::OnKeyEvent(int key, int /*scan_code*/, int action, int /*mods*/)
@@ -101,8 +525,16 @@ void GLApp::OnKeyEvent(int key, int /*scan_code*/, int action, int /*mods*/)
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(m_window, true);
 
-	if (action == GLFW_PRESS)
-		m_input.SetKey(key, true /*pressed*/);
-	else if (action == GLFW_RELEASE)
-		m_input.SetKey(key, false /*pressed*/);
+	if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
+		m_show_hud.store(!m_show_hud.load()); // only the main thread writes it
+
+	if (action != GLFW_PRESS && action != GLFW_RELEASE)
+		return; // repeats don't change the key state
+
+	m_live_keys.SetKey(key, action == GLFW_PRESS);
+	m_redraw.Request();
+
+	KeyEvent const event{ .m_time = glfwGetTime(), .m_key = key, .m_pressed = action == GLFW_PRESS };
+	if (!m_key_events.Push(event))
+		LogWarning("Key event queue full, the simulation thread is not keeping up. Dropped key {}", key);
 }
@@ -11,7 +11,9 @@ import <atomic>;
 import <optional>;
 import <string>;
 
+import AppOptions;
 import Input;
+import RedrawSignal;
 
 export struct WindowSize
 {
@@ -22,21 +24,32 @@ export struct WindowSize
 export class GLApp
 {
 public:
-	GLApp(WindowSize window_size, std::string title);
+	GLApp(AppOptions const & options, std::string title);
 	~GLApp();
 
 	void Run();
 
 	bool IsInitialized() const { return m_intialized; }
 	bool HasWindow() const { return m_window != nullptr; }
+	bool IsHeadless() const { return m_options.m_headless; }
 
 	void OnWindowResize(WindowSize size);
 	void OnKeyEvent(int key, int scan_code, int action, int mods);
+	void OnWindowRefresh() { m_redraw.Request(); } // the window was uncovered, or the system lost its contents
 
 private:
+	void run_headless();
+
+private:
+	AppOptions m_options;
+
 	bool m_intialized{ false };
 	GLFWwindow * m_window{ nullptr };
 
 	std::atomic<std::optional<WindowSize>> m_new_window_size;
-	Input m_input;
+	Input m_input; // headless only, the windowed render loop keeps its own snapshot
+	KeyEventQueue m_key_events; // from the main thread to the simulation thread
+	LiveKeyState m_live_keys; // from the main thread to the render thread, which moves the camera with them
+	RedrawSignal m_redraw; // wakes the render thread when it renders on demand
+	std::atomic<bool> m_show_hud{ false }; // toggled with F1
 };
@@ -4,7 +4,27 @@ module;
 
 export module GraphicsApi;
 
+import <array>;
+import <cstdint>;
+import <optional>;
+import <span>;
 import <string>;
+import <vector>;
+
+import FrameArena;
+import MemoryLedger;
+
+export struct GpuPipelineTiming
+{
+	std::uint32_t m_pipeline_index{ 0 };
+	double m_time_ms{ 0.0 };
+};
+
+export struct GpuFrameTiming
+{
+	double m_time_ms{ 0.0 };
+	std::vector<GpuPipelineTiming> m_pipelines; // same as GetLastGpuPipelineTimings() for that frame
+};
 
 export class GraphicsApi
 {
@@ -13,4 +33,58 @@ public:
 
 	GraphicsApi(LoadProcFn * load_proc_fn);
 	~GraphicsApi();
+
+	std::string GetRendererName() const;
+
+	// Brackets a frame's commands with gpu timestamps, results are picked up a few frames later without stalling
+	void BeginFrameTimer();
+	void EndFrameTimer();
+
+	// Times one pipeline's draws with a GL_TIME_ELAPSED query, only between BeginFrameTimer() and EndFrameTimer()
+	void BeginPipelineTimer(std::uint32_t pipeline_index);
+	void EndPipelineTimer();
+
+	// Gpu time of the most recently completed frame
+	std::optional<double> GetLastGpuFrameTime() const { return m_last_gpu_frame_time_ms; }
+
+	// Per pipeline results of the same frame as GetLastGpuFrameTime(), in the order they were recorded
+	std::vector<GpuPipelineTiming> const & GetLastGpuPipelineTimings() const { return m_last_gpu_pipeline_timings; }
+
+	// Every frame completed since the previous call, oldest first, so each result is handed out exactly once.
+	// The span stays valid until the next BeginFrameTimer() or TakeCompletedGpuFrames().
+	std::span<GpuFrameTiming const> TakeCompletedGpuFrames();
+
+	// Scratch memory for the current frame, the frame loop rewinds it at the start of every frame
+	FrameArena & GetFrameArena() const { return m_frame_arena; }
+
+	// OpenGL has no portable query, only NVIDIA's GL_NVX_gpu_memory_info reports the dedicated memory as one heap
+	std::vector<MemoryHeapBudget> GetMemoryHeapBudgets() const;
+
+private:
+	void collect_frame_timers(bool wait_for_oldest);
+	void collect_frame_timer(std::size_t timer);
+
+private:
+	constexpr static std::size_t m_frame_timer_count = 4; // frames that can be in flight before a result is needed
+
+	std::array<std::array<unsigned int, 2>, m_frame_timer_count> m_timer_queries{};
+	std::array<bool, m_frame_timer_count> m_timer_pending{};
+	std::size_t m_cur_timer{ 0 };
+	bool m_frame_timer_open{ false };
+
+	std::array<std::vector<unsigned int>, m_frame_timer_count> m_pipeline_queries; // grown as needed, one per timed pipeline
+	std::array<std::vector<std::uint32_t>, m_frame_timer_count> m_pipeline_timer_indices; // pipeline of each query used
+	bool m_pipeline_timer_open{ false };
+
+	std::array<std::int64_t, m_frame_timer_count> m_gpu_to_trace_ns{}; // offset from the gpu clock to the profiler's
+
+	std::optional<double> m_last_gpu_frame_time_ms;
+	std::vector<GpuPipelineTiming> m_last_gpu_pipeline_timings;
+	// one collect can pick up every pair in flight plus the frame that just ended, the oldest is dropped if nobody takes them
+	std::array<GpuFrameTiming, 2 * m_frame_timer_count> m_completed_gpu_frames;
+	std::size_t m_completed_gpu_frame_count{ 0 };
+
+	mutable FrameArena m_frame_arena;
+
+	bool m_nvx_memory_info_supported{ false };
 };
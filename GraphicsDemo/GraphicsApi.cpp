@@ -2,16 +2,40 @@
 
 module;
 
-#include <format>
+#include <algorithm>
 #include <iostream>
+#include <span>
+#include <string_view>
+#include <utility>
 
 #include <glad/glad.h>
 
 module GraphicsApi;
 
+import Log;
+import Profiler;
+
 namespace
 {
-	std::string type_to_string(GLenum type)
+	// GL_NVX_gpu_memory_info, in kB
+	constexpr GLenum g_gpu_memory_info_dedicated_vidmem_nvx = 0x9047;
+	constexpr GLenum g_gpu_memory_info_total_available_memory_nvx = 0x9048;
+	constexpr GLenum g_gpu_memory_info_current_available_vidmem_nvx = 0x9049;
+
+	bool extension_is_supported(std::string_view extension)
+	{
+		GLint extension_count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+		for (GLint i = 0; i < extension_count; ++i)
+		{
+			GLubyte const * name = glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i));
+			if (name != nullptr && extension == reinterpret_cast<char const *>(name))
+				return true;
+		}
+		return false;
+	}
+
+	char const * type_to_string(GLenum type)
 	{
 		switch (type) {
 		case GL_DEBUG_TYPE_ERROR: return "ERROR";
@@ -24,14 +48,14 @@ namespace
 		}
 	}
 
-	std::string severity_to_string(GLenum severity)
+	LogLevel severity_to_log_level(GLenum severity)
 	{
 		switch (severity) {
-		case GL_DEBUG_SEVERITY_NOTIFICATION: return "NOTIFICATION";
-		case GL_DEBUG_SEVERITY_LOW: return "LOW";
-		case GL_DEBUG_SEVERITY_MEDIUM: return "MEDIUM";
-		case GL_DEBUG_SEVERITY_HIGH: return "HIGH";
-		default: return "UNKNOWN";
+		case GL_DEBUG_SEVERITY_NOTIFICATION: return LogLevel::VERBOSE;
+		case GL_DEBUG_SEVERITY_LOW: return LogLevel::INFO;
+		case GL_DEBUG_SEVERITY_MEDIUM: return LogLevel::WARNING;
+		case GL_DEBUG_SEVERITY_HIGH: return LogLevel::ERROR;
+		default: return LogLevel::WARNING;
 		}
 	}
 
@@ -47,8 +71,8 @@ namespace
 		if (id == 131185) // ignore notification about using GL_STATIC_DRAW
 			return;
 
-		std::cout << std::format("OpenGL {3}: type - {1}, id - {2}\nMessage: {0}\n\n",
-			message, type_to_string(type), id, severity_to_string(severity));
+		// a driver can report the same problem for every draw, the logger's rate limit keeps that off the frame time
+		LogMessage(severity_to_log_level(severity), "OpenGL {}: id - {}\nMessage: {}", type_to_string(type), id, message);
 	}
 }
 
@@ -62,8 +86,187 @@ GraphicsApi::GraphicsApi(LoadProcFn * load_proc_fn)
 
 	glEnable(GL_DEBUG_OUTPUT);
 	glDebugMessageCallback(debug_message_callback, 0);
+
+	for (auto & queries : m_timer_queries)
+		glGenQueries(static_cast<GLsizei>(queries.size()), queries.data());
+
+	m_nvx_memory_info_supported = extension_is_supported("GL_NVX_gpu_memory_info");
 }
 
 GraphicsApi::~GraphicsApi()
 {
+	if (m_timer_queries[0][0] == 0) // the context never loaded
+		return;
+
+	for (auto & queries : m_timer_queries)
+		glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+	for (auto & queries : m_pipeline_queries)
+		glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+}
+
+std::string GraphicsApi::GetRendererName() const
+{
+	GLubyte const * renderer = glGetString(GL_RENDERER);
+	return renderer != nullptr ? reinterpret_cast<char const *>(renderer) : "unknown";
+}
+
+std::vector<MemoryHeapBudget> GraphicsApi::GetMemoryHeapBudgets() const
+{
+	if (!m_nvx_memory_info_supported)
+		return {};
+
+	GLint dedicated_kb = 0;
+	GLint total_available_kb = 0;
+	GLint current_available_kb = 0;
+	glGetIntegerv(g_gpu_memory_info_dedicated_vidmem_nvx, &dedicated_kb);
+	glGetIntegerv(g_gpu_memory_info_total_available_memory_nvx, &total_available_kb);
+	glGetIntegerv(g_gpu_memory_info_current_available_vidmem_nvx, &current_available_kb);
+
+	std::uint64_t const kb = 1024;
+	return { MemoryHeapBudget{
+		.m_size = static_cast<std::uint64_t>(dedicated_kb) * kb,
+		.m_budget = static_cast<std::uint64_t>(total_available_kb) * kb,
+		.m_usage = static_cast<std::uint64_t>(std::max(total_available_kb - current_available_kb, 0)) * kb,
+		.m_device_local = true
+		} };
+}
+
+void GraphicsApi::BeginFrameTimer()
+{
+	if (m_timer_queries[0][0] == 0)
+		return;
+
+	// Only block if the gpu is so far behind that the query pair is needed again before its result arrived
+	collect_frame_timers(m_timer_pending[m_cur_timer] /*wait_for_oldest*/);
+
+	if (Profiler::IsEnabled())
+	{
+		// Reads the gpu clock without waiting for queued commands, close enough to line the gpu zones up with the cpu ones
+		GLint64 gpu_now_ns = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpu_now_ns);
+		m_gpu_to_trace_ns[m_cur_timer] = Profiler::Now() - gpu_now_ns;
+	}
+
+	m_pipeline_timer_indices[m_cur_timer].clear();
+	m_frame_timer_open = true;
+
+	glQueryCounter(m_timer_queries[m_cur_timer][0], GL_TIMESTAMP);
+}
+
+void GraphicsApi::EndFrameTimer()
+{
+	if (!m_frame_timer_open)
+		return;
+	m_frame_timer_open = false;
+
+	glQueryCounter(m_timer_queries[m_cur_timer][1], GL_TIMESTAMP);
+	m_timer_pending[m_cur_timer] = true;
+	m_cur_timer = (m_cur_timer + 1) % m_frame_timer_count;
+}
+
+void GraphicsApi::BeginPipelineTimer(std::uint32_t pipeline_index)
+{
+	m_pipeline_timer_open = m_frame_timer_open;
+	if (!m_pipeline_timer_open)
+		return;
+
+	std::vector<unsigned int> & queries = m_pipeline_queries[m_cur_timer];
+	std::vector<std::uint32_t> & indices = m_pipeline_timer_indices[m_cur_timer];
+	if (indices.size() == queries.size())
+	{
+		queries.push_back(0);
+		glGenQueries(1, &queries.back());
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, queries[indices.size()]);
+	indices.push_back(pipeline_index);
+}
+
+void GraphicsApi::EndPipelineTimer()
+{
+	if (!m_pipeline_timer_open)
+		return;
+	m_pipeline_timer_open = false;
+
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+std::span<GpuFrameTiming const> GraphicsApi::TakeCompletedGpuFrames()
+{
+	// picks up whatever finished since the last BeginFrameTimer(), after a glFinish() that is every frame still pending
+	if (m_timer_queries[0][0] != 0)
+		collect_frame_timers(false /*wait_for_oldest*/);
+
+	return std::span<GpuFrameTiming const>{ m_completed_gpu_frames.data(), std::exchange(m_completed_gpu_frame_count, 0) };
+}
+
+void GraphicsApi::collect_frame_timers(bool wait_for_oldest)
+{
+	// m_cur_timer is the oldest pair, results become available in submission order
+	for (std::size_t i = 0; i < m_frame_timer_count; ++i)
+	{
+		std::size_t const timer = (m_cur_timer + i) % m_frame_timer_count;
+		if (!m_timer_pending[timer])
+			continue;
+
+		GLint available = GL_FALSE;
+		if (!(wait_for_oldest && i == 0))
+		{
+			glGetQueryObjectiv(m_timer_queries[timer][1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available == GL_FALSE)
+				break;
+		}
+
+		collect_frame_timer(timer);
+		m_timer_pending[timer] = false;
+	}
+}
+
+void GraphicsApi::collect_frame_timer(std::size_t timer)
+{
+	GLuint64 begin_ns = 0;
+	GLuint64 end_ns = 0;
+	glGetQueryObjectui64v(m_timer_queries[timer][0], GL_QUERY_RESULT, &begin_ns);
+	glGetQueryObjectui64v(m_timer_queries[timer][1], GL_QUERY_RESULT, &end_ns);
+
+	m_last_gpu_frame_time_ms = static_cast<double>(end_ns - begin_ns) / 1'000'000.0;
+
+	// The pipeline queries ended before the frame's end timestamp, so their results are in as well
+	std::vector<std::uint32_t> const & indices = m_pipeline_timer_indices[timer];
+	m_last_gpu_pipeline_timings.clear();
+	std::span<GLuint64> const elapsed_ns = m_frame_arena.Allocate<GLuint64>(indices.size());
+	for (std::size_t i = 0; i < indices.size(); ++i)
+	{
+		glGetQueryObjectui64v(m_pipeline_queries[timer][i], GL_QUERY_RESULT, &elapsed_ns[i]);
+		m_last_gpu_pipeline_timings.push_back(GpuPipelineTiming{
+			.m_pipeline_index = indices[i],
+			.m_time_ms = static_cast<double>(elapsed_ns[i]) / 1'000'000.0
+			});
+	}
+
+	if (m_completed_gpu_frame_count == m_completed_gpu_frames.size())
+	{
+		std::rotate(m_completed_gpu_frames.begin(), m_completed_gpu_frames.begin() + 1, m_completed_gpu_frames.end());
+		--m_completed_gpu_frame_count;
+	}
+	// copy assignment reuses the slot's capacity, after the first few frames this doesn't allocate
+	GpuFrameTiming & completed = m_completed_gpu_frames[m_completed_gpu_frame_count++];
+	completed.m_time_ms = m_last_gpu_frame_time_ms.value();
+	completed.m_pipelines = m_last_gpu_pipeline_timings;
+
+	if (Profiler::IsEnabled())
+	{
+		std::int64_t const offset_ns = m_gpu_to_trace_ns[timer];
+		std::int64_t const frame_begin_ns = static_cast<std::int64_t>(begin_ns) + offset_ns;
+		Profiler::RecordGpuZone("gpu frame", -1, frame_begin_ns, static_cast<std::int64_t>(end_ns) + offset_ns);
+
+		// Elapsed time queries have no start time, the pipelines are laid out back to back from the start of the frame
+		std::int64_t pipeline_begin_ns = frame_begin_ns;
+		for (std::size_t i = 0; i < indices.size(); ++i)
+		{
+			std::int64_t const pipeline_end_ns = pipeline_begin_ns + static_cast<std::int64_t>(elapsed_ns[i]);
+			Profiler::RecordGpuZone("gpu pipeline", static_cast<int>(indices[i]), pipeline_begin_ns, pipeline_end_ns);
+			pipeline_begin_ns = pipeline_end_ns;
+		}
+	}
 }
@@ -1,15 +1,27 @@
 // GraphicsDemo.cpp
 
 #include <iostream>
+#include <optional>
 
+import AppOptions;
 import GLApp;
+import Log;
 
-int main()
+int main(int argc, char ** argv)
 {
+	std::optional<AppOptions> options = ParseAppOptions(argc, argv, GraphicsBackend::OPENGL);
+	if (!options.has_value())
+		return -1;
+
+	// destroyed last, so the app's destructor can still log
+	LogWriter log_writer;
+	if (options->m_verbose)
+		Log::SetMinLevel(LogLevel::VERBOSE);
+
 	std::cout << "Initializing app..." << std::endl;
 
-	GLApp app(WindowSize{ 1920, 1080 }, "Graphics Demo");
-	if (!app.IsInitialized() || !app.HasWindow())
+	GLApp app(options.value(), "Graphics Demo");
+	if (!app.IsInitialized() || (!app.IsHeadless() && !app.HasWindow()))
 		return -1;
 
 	std::cout << "Running app..." << std::endl;
@@ -3,22 +3,34 @@
 module;
 
 #include <fstream>
-#include <iostream>
+#include <string>
+#include <string_view>
 
 #include <glad/glad.h>
 
 module GraphicsPipeline;
 
+import Log;
+import Profiler;
+import RenderStats;
+
 GraphicsPipeline::GraphicsPipeline(
 	unsigned int vert_shader_id,
 	unsigned int frag_shader_id,
 	DepthTestOptions const & depth_options,
+	BlendOptions const & blend_options,
 	PerFrameConstantsCallback per_frame_constants_callback,
-	PerObjectConstantsCallback per_object_constants_callback)
+	DrawObjectsFn draw_objects,
+	std::vector<std::string_view> const & per_object_uniform_labels,
+	std::vector<Texture> const * textures)
 	: m_depth_test_options(depth_options)
+	, m_blend_options(blend_options)
 	, m_per_frame_constants_callback(per_frame_constants_callback)
-	, m_per_object_constants_callback(per_object_constants_callback)
+	, m_draw_objects(draw_objects)
+	, m_textures(textures)
 {
+	ProfileZone zone{ "link shader program" }; // many drivers compile the shaders here or even at the first draw
+
 	m_program_id = glCreateProgram();
 	glAttachShader(m_program_id, vert_shader_id);
 	glAttachShader(m_program_id, frag_shader_id);
@@ -30,8 +42,11 @@ GraphicsPipeline::GraphicsPipeline(
 	{
 		char info_log[512];
 		glGetProgramInfoLog(m_program_id, 512, nullptr, info_log);
-		std::cout << "Failed to link shader program:\n" << info_log << std::endl;
+		LogError("Failed to link shader program:\n{}", info_log);
 	}
+
+	for (std::string_view label : per_object_uniform_labels)
+		get_uniform_location(label);
 }
 
 GraphicsPipeline::~GraphicsPipeline()
@@ -43,6 +58,7 @@ void GraphicsPipeline::destroy_pipeline()
 {
 	glDeleteProgram(m_program_id);
 	m_program_id = 0;
+	m_uniform_locations.clear();
 }
 
 GraphicsPipeline::GraphicsPipeline(GraphicsPipeline && other)
@@ -59,13 +75,19 @@ GraphicsPipeline & GraphicsPipeline::operator=(GraphicsPipeline && other)
 
 	m_program_id = other.m_program_id;
 	m_depth_test_options = other.m_depth_test_options;
+	m_blend_options = other.m_blend_options;
 	m_per_frame_constants_callback = other.m_per_frame_constants_callback;
-	m_per_object_constants_callback = other.m_per_object_constants_callback;
+	m_draw_objects = other.m_draw_objects;
+	m_textures = other.m_textures;
+	m_uniform_locations = std::move(other.m_uniform_locations);
 
 	other.m_program_id = 0;
 	other.m_depth_test_options = DepthTestOptions{};
+	other.m_blend_options = BlendOptions{};
 	other.m_per_frame_constants_callback = nullptr;
-	other.m_per_object_constants_callback = nullptr;
+	other.m_draw_objects = MakeDrawObjectsFn();
+	other.m_textures = nullptr;
+	other.m_uniform_locations.clear();
 
 	return *this;
 }
@@ -74,7 +96,7 @@ void GraphicsPipeline::Activate() const
 {
 	if (m_program_id == 0)
 	{
-		std::cout << "Activating invalid shader program" << std::endl;
+		LogError("Activating invalid shader program");
 		return;
 	}
 
@@ -91,7 +113,18 @@ void GraphicsPipeline::Activate() const
 		glDisable(GL_DEPTH_TEST);
 	}
 
+	if (m_blend_options.m_enable_alpha_blending)
+	{
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	}
+	else
+	{
+		glDisable(GL_BLEND);
+	}
+
 	glUseProgram(m_program_id);
+	FrameStats::Current().m_pipeline_binds += 1;
 }
 
 void GraphicsPipeline::UpdatePerFrameConstants() const
@@ -100,8 +133,18 @@ void GraphicsPipeline::UpdatePerFrameConstants() const
 		m_per_frame_constants_callback(*this);
 }
 
-void GraphicsPipeline::UpdatePerObjectConstants(RenderObject const & obj) const
+auto GraphicsPipeline::get_uniform_location(std::string_view label) const -> UniformLocation &
 {
-	if (m_per_object_constants_callback)
-		m_per_object_constants_callback(*this, obj);
+	for (UniformLocation & uniform : m_uniform_locations)
+	{
+		if (uniform.m_label == label)
+			return uniform;
+	}
+
+	std::string name{ label };
+	GLint const location = glGetUniformLocation(m_program_id, name.c_str());
+	if (location == -1)
+		LogWarning("Uniform not found: {}", label);
+
+	return m_uniform_locations.emplace_back(UniformLocation{ .m_label = std::move(name), .m_location = location });
 }
@@ -2,9 +2,15 @@
 
 module;
 
+#include <concepts>
+#include <cstdint>
 #include <filesystem>
 #include <functional>
-#include <iostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include <glad/glad.h>
 
@@ -13,7 +19,10 @@ module;
 
 export module GraphicsPipeline;
 
-import RenderObject;
+import Mesh;
+import RenderPacket;
+import RenderStats;
+import Texture;
 
 export enum class DepthCompareOp
 {
@@ -34,18 +43,37 @@ export struct DepthTestOptions
 	DepthCompareOp m_depth_compare_op{ DepthCompareOp::LESS };
 };
 
+export struct BlendOptions
+{
+	bool m_enable_alpha_blending{ false }; // src * src_alpha + dst * (1 - src_alpha)
+};
+
+// A per-object uniform, m_label names it in the shader and FromDraw() reads its value from a draw
+export template <typename T>
+concept PerObjectUniform = requires(DrawPacket const & draw)
+{
+	{ T::m_label } -> std::convertible_to<std::string_view>;
+	T::FromDraw(draw);
+};
+
 export class GraphicsPipeline
 {
 public:
 	using PerFrameConstantsCallback = std::function<void(GraphicsPipeline const & pipeline)>;
-	using PerObjectConstantsCallback = std::function<void(GraphicsPipeline const & pipeline, RenderObject const &)>;
+
+	// Sets each draw's per-object uniforms and texture and draws its mesh. Generated from the pipeline's uniform types,
+	// see MakeDrawObjectsFn(), so there's one indirect call per pipeline rather than one per object
+	using DrawObjectsFn = void (*)(GraphicsPipeline const & pipeline, std::span<DrawPacket const> draws, std::span<Mesh const> meshes);
 
 	GraphicsPipeline(
 		unsigned int vert_shader_id,
 		unsigned int frag_shader_id,
 		DepthTestOptions const & depth_options,
+		BlendOptions const & blend_options,
 		PerFrameConstantsCallback per_frame_constants_callback,
-		PerObjectConstantsCallback per_object_constants_callback);
+		DrawObjectsFn draw_objects,
+		std::vector<std::string_view> const & per_object_uniform_labels, // in the order of the DrawObjectsFn's types
+		std::vector<Texture> const * textures); // indexed by DrawPacket::m_tex_id, may be null
 	~GraphicsPipeline();
 
 	GraphicsPipeline(GraphicsPipeline && other);
@@ -58,43 +86,120 @@ public:
 
 	void Activate() const;
 	void UpdatePerFrameConstants() const;
-	void UpdatePerObjectConstants(RenderObject const & obj) const;
+	void DrawObjects(std::span<DrawPacket const> draws, std::span<Mesh const> meshes) const { m_draw_objects(*this, draws, meshes); }
+
+	template <PerObjectUniform... Uniforms>
+	static DrawObjectsFn MakeDrawObjectsFn() { return &draw_objects<Uniforms...>; }
 
 	template <typename T>
-	void SetUniform(std::string const & label, T const & data) const;
+	void SetUniform(std::string_view label, T const & data) const;
+
+	// Skips the upload when the program already holds this version of the data, see VersionedBlock
+	template <typename T>
+	void SetUniform(std::string_view label, T const & data, std::uint64_t version) const;
 
 private:
+	struct UniformLocation
+	{
+		std::string m_label;
+		GLint m_location{ -1 }; // -1 when the program has no such uniform, it's only reported once
+		std::uint64_t m_version{ 0 }; // of the data last uploaded, 0 when unknown
+	};
+
 	void destroy_pipeline();
 
+	// glGetUniformLocation wants a null terminated copy of the label and is slow on some drivers, so ask once per label
+	UniformLocation & get_uniform_location(std::string_view label) const;
+
+	template <typename T>
+	static void upload_uniform(GLint location, T const & data);
+
+	template <typename T>
+	static void set_uniform(UniformLocation & uniform, T const & data, std::uint64_t version);
+
+	template <PerObjectUniform... Uniforms>
+	static void draw_objects(GraphicsPipeline const & pipeline, std::span<DrawPacket const> draws, std::span<Mesh const> meshes);
+
 private:
 	unsigned int m_program_id{ 0 };
 
 	DepthTestOptions m_depth_test_options;
+	BlendOptions m_blend_options;
 
 	PerFrameConstantsCallback m_per_frame_constants_callback;
-	PerObjectConstantsCallback m_per_object_constants_callback;
+	DrawObjectsFn m_draw_objects{ MakeDrawObjectsFn() };
+	std::vector<Texture> const * m_textures{ nullptr };
+
+	// a handful per pipeline, a linear search beats a map. The per-object ones come first, draw_objects() indexes them
+	mutable std::vector<UniformLocation> m_uniform_locations;
 };
 
 template <typename T>
-void GraphicsPipeline::SetUniform(std::string const & label, T const & data) const
+void GraphicsPipeline::SetUniform(std::string_view label, T const & data) const
 {
-	GLint uniform_loc = glGetUniformLocation(m_program_id, label.c_str());
-	if (uniform_loc == -1)
-	{
-		std::cout << "Uniform not found: " << label << std::endl;
+	UniformLocation & uniform = get_uniform_location(label);
+	uniform.m_version = 0;
+	upload_uniform(uniform.m_location, data);
+}
+
+template <typename T>
+void GraphicsPipeline::SetUniform(std::string_view label, T const & data, std::uint64_t version) const
+{
+	set_uniform(get_uniform_location(label), data, version);
+}
+
+template <typename T>
+void GraphicsPipeline::upload_uniform(GLint location, T const & data)
+{
+	if (location == -1)
 		return;
-	}
 
 	if constexpr (std::same_as<T, float>)
-		glUniform1fv(uniform_loc, 1, &data);
+		glUniform1fv(location, 1, &data);
 	else if constexpr (std::same_as<T, glm::vec2>)
-		glUniform2fv(uniform_loc, 1, glm::value_ptr(data));
+		glUniform2fv(location, 1, glm::value_ptr(data));
 	else if constexpr (std::same_as<T, glm::vec3>)
-		glUniform3fv(uniform_loc, 1, glm::value_ptr(data));
+		glUniform3fv(location, 1, glm::value_ptr(data));
 	else if constexpr (std::same_as<T, glm::vec4>)
-		glUniform4fv(uniform_loc, 1, glm::value_ptr(data));
+		glUniform4fv(location, 1, glm::value_ptr(data));
 	else if constexpr (std::same_as<T, glm::mat4>)
-		glUniformMatrix4fv(uniform_loc, 1, GL_FALSE, glm::value_ptr(data));
+		glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(data));
 	else
 		static_assert(false, "Unsupported uniform type");
+
+	FrameStats::Current().m_constant_bytes += sizeof(T);
+}
+
+template <typename T>
+void GraphicsPipeline::set_uniform(UniformLocation & uniform, T const & data, std::uint64_t version)
+{
+	// uniforms are state of the program, they keep their value from one frame to the next
+	if (uniform.m_version == version)
+		return;
+
+	upload_uniform(uniform.m_location, data);
+	uniform.m_version = version;
+}
+
+template <PerObjectUniform... Uniforms>
+void GraphicsPipeline::draw_objects(GraphicsPipeline const & pipeline, std::span<DrawPacket const> draws, std::span<Mesh const> meshes)
+{
+	int bound_tex_id = -1;
+
+	for (DrawPacket const & draw : draws)
+	{
+		[&]<std::size_t... Indices>(std::index_sequence<Indices...>)
+		{
+			(set_uniform(pipeline.m_uniform_locations[Indices], Uniforms::FromDraw(draw), draw.m_constants_version), ...);
+		}(std::index_sequence_for<Uniforms...>{});
+
+		// the draws come sorted by mesh, objects that share one tend to share the texture too
+		if (pipeline.m_textures != nullptr && draw.m_tex_id != -1 && draw.m_tex_id != bound_tex_id)
+		{
+			pipeline.m_textures->at(draw.m_tex_id).Bind();
+			bound_tex_id = draw.m_tex_id;
+		}
+
+		meshes[draw.m_mesh_id].Render(draw.m_draw_wireframe);
+	}
 }
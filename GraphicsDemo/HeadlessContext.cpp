@@ -0,0 +1,185 @@
+// HeadlessContext.cpp
+
+module;
+
+#include <iostream>
+#include <string_view>
+
+#if __has_include(<EGL/egl.h>)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define HEADLESS_CONTEXT_HAS_EGL 1
+#else
+#define HEADLESS_CONTEXT_HAS_EGL 0
+#endif
+
+module HeadlessContext;
+
+#if HEADLESS_CONTEXT_HAS_EGL
+
+namespace
+{
+	bool has_extension(char const * extensions, std::string_view extension)
+	{
+		if (extensions == nullptr)
+			return false;
+
+		std::string_view const all{ extensions };
+		for (size_t pos = all.find(extension); pos != std::string_view::npos; pos = all.find(extension, pos + 1))
+		{
+			size_t const end = pos + extension.size();
+			bool const starts_word = pos == 0 || all[pos - 1] == ' ';
+			bool const ends_word = end == all.size() || all[end] == ' ';
+			if (starts_word && ends_word)
+				return true;
+		}
+		return false;
+	}
+
+	EGLDisplay get_display()
+	{
+		// The surfaceless platform doesn't touch X11 or Wayland at all, so prefer it when Mesa provides it
+		char const * client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if (get_platform_display != nullptr && has_extension(client_extensions, "EGL_MESA_platform_surfaceless"))
+		{
+			EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+			if (display != EGL_NO_DISPLAY)
+				return display;
+		}
+
+		return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+}
+
+HeadlessContext::HeadlessContext()
+{
+	EGLDisplay display = get_display();
+	if (display == EGL_NO_DISPLAY)
+	{
+		std::cout << "HeadlessContext: failed to get an EGL display" << std::endl;
+		return;
+	}
+
+	EGLint major = 0;
+	EGLint minor = 0;
+	if (!eglInitialize(display, &major, &minor))
+	{
+		std::cout << "HeadlessContext: failed to initialize EGL" << std::endl;
+		return;
+	}
+	m_display = display;
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cout << "HeadlessContext: EGL display doesn't support desktop OpenGL" << std::endl;
+		return;
+	}
+
+	bool const surfaceless = has_extension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+	EGLint const config_attribs[] = {
+		EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+
+	EGLConfig config = nullptr;
+	EGLint config_count = 0;
+	if (!eglChooseConfig(display, config_attribs, &config, 1, &config_count) || config_count == 0)
+	{
+		std::cout << "HeadlessContext: no suitable EGL config" << std::endl;
+		return;
+	}
+
+	if (!surfaceless)
+	{
+		// Everything is rendered into framebuffer objects, the pbuffer only exists to make the context current
+		EGLint const pbuffer_attribs[] = {
+			EGL_WIDTH, 1,
+			EGL_HEIGHT, 1,
+			EGL_NONE
+		};
+
+		m_surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+		if (m_surface == EGL_NO_SURFACE)
+		{
+			std::cout << "HeadlessContext: failed to create pbuffer surface" << std::endl;
+			m_surface = nullptr;
+			return;
+		}
+	}
+
+	// Same version and profile as the windowed context GLApp asks glfw for
+	EGLint const context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+	if (context == EGL_NO_CONTEXT)
+	{
+		std::cout << "HeadlessContext: failed to create OpenGL 3.3 core context" << std::endl;
+		return;
+	}
+	m_context = context;
+
+	std::cout << "HeadlessContext: EGL " << major << "." << minor
+		<< (surfaceless ? " surfaceless" : " pbuffer") << " context" << std::endl;
+}
+
+HeadlessContext::~HeadlessContext()
+{
+	if (m_display == nullptr)
+		return;
+
+	eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (m_context != nullptr)
+		eglDestroyContext(m_display, m_context);
+	if (m_surface != nullptr)
+		eglDestroySurface(m_display, m_surface);
+	eglTerminate(m_display);
+}
+
+bool HeadlessContext::MakeCurrent() const
+{
+	if (!IsValid())
+		return false;
+
+	EGLSurface surface = m_surface != nullptr ? m_surface : EGL_NO_SURFACE;
+	return eglMakeCurrent(m_display, surface, surface, m_context) == EGL_TRUE;
+}
+
+void * HeadlessContext::GetProcAddress(char const * name)
+{
+	return reinterpret_cast<void *>(eglGetProcAddress(name));
+}
+
+#else // no EGL on this platform, GLApp refuses --headless
+
+HeadlessContext::HeadlessContext()
+{
+}
+
+HeadlessContext::~HeadlessContext()
+{
+}
+
+bool HeadlessContext::MakeCurrent() const
+{
+	return false;
+}
+
+void * HeadlessContext::GetProcAddress(char const * /*name*/)
+{
+	return nullptr;
+}
+
+#endif
+
+bool HeadlessContext::IsCompiledIn()
+{
+	return HEADLESS_CONTEXT_HAS_EGL != 0;
+}
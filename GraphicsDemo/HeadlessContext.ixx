@@ -0,0 +1,32 @@
+// HeadlessContext.ixx
+
+module;
+
+export module HeadlessContext;
+
+// An OpenGL 3.3 core context with no window, created through EGL so it also works on machines without a display
+// or gpu (e.g. Mesa llvmpipe). Uses a surfaceless context when supported, otherwise a 1x1 pbuffer.
+// EGL is only compiled in where its headers are found, the Visual Studio project doesn't link libEGL.
+export class HeadlessContext
+{
+public:
+	HeadlessContext();
+	~HeadlessContext();
+
+	static bool IsCompiledIn(); // false when this build has no EGL, every context is then invalid
+
+	HeadlessContext(HeadlessContext &) = delete;
+	HeadlessContext & operator=(HeadlessContext &) = delete;
+
+	bool IsValid() const { return m_context != nullptr; }
+	bool MakeCurrent() const;
+
+	// Matches GraphicsApi::LoadProcFn
+	static void * GetProcAddress(char const * name);
+
+private:
+	// EGL handles, kept opaque so EGL headers are only needed by the implementation
+	void * m_display{ nullptr };
+	void * m_surface{ nullptr }; // stays null for surfaceless contexts
+	void * m_context{ nullptr };
+};
@@ -0,0 +1,174 @@
+// HitchMonitor.ixx
+
+module;
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+export module HitchMonitor;
+
+import AllocationTracker;
+import AppOptions;
+import Log;
+import Profiler;
+import RenderStats;
+
+// Watches the frame times in the render loop and writes a chrome trace of the seconds around every hitch, so stalls
+// that only happen now and then can be looked at after the fact. Relies on the profiler being enabled.
+export class HitchMonitor
+{
+public:
+	explicit HitchMonitor(HitchOptions const & options);
+	~HitchMonitor();
+
+	HitchMonitor(HitchMonitor const &) = delete;
+	HitchMonitor & operator=(HitchMonitor const &) = delete;
+
+	// Call once per frame after FrameStats::EndFrame(). gpu_time_ms lags a few frames behind, it's only recorded
+	void EndFrame(std::optional<double> gpu_time_ms);
+
+	// Call when the render loop sat idle on purpose, so the next frame isn't timed from before the wait
+	void RestartFrameClock() { m_last_frame_end_ns = Profiler::Now(); }
+
+private:
+	constexpr static std::size_t m_window_size = 240; // frames the median is taken over
+
+	struct Capture
+	{
+		std::int64_t m_begin_ns{ 0 };
+		std::int64_t m_end_ns{ 0 };
+		std::uint64_t m_frame{ 0 };
+	};
+
+	void record_counters(double frame_time_ms, std::optional<double> gpu_time_ms) const;
+	double median_frame_time();
+	void write_capture(Capture const & capture);
+
+private:
+	HitchOptions m_options;
+
+	std::int64_t m_last_frame_end_ns{ 0 };
+	std::uint64_t m_frame{ 0 };
+
+	std::array<double, m_window_size> m_frame_times{};
+	std::size_t m_frame_time_count{ 0 };
+	std::size_t m_frame_time_next{ 0 };
+	std::vector<double> m_sorted_frame_times; // scratch for the median
+
+	std::optional<Capture> m_pending_capture; // waiting for the seconds after the hitch to be recorded
+	int m_capture_count{ 0 };
+
+	std::jthread m_writer; // writes the last capture without stalling the render loop
+};
+
+HitchMonitor::HitchMonitor(HitchOptions const & options)
+	: m_options(options)
+	, m_last_frame_end_ns(Profiler::Now())
+{
+	m_sorted_frame_times.reserve(m_window_size);
+
+	std::error_code error;
+	std::filesystem::create_directories(m_options.m_output_dir, error);
+	if (error)
+		LogError("HitchMonitor: failed to create {}: {}", m_options.m_output_dir, error.message());
+}
+
+HitchMonitor::~HitchMonitor()
+{
+	// the app is closing, keep whatever was recorded after the hitch
+	if (m_pending_capture.has_value())
+		write_capture(m_pending_capture.value());
+}
+
+void HitchMonitor::EndFrame(std::optional<double> gpu_time_ms)
+{
+	std::int64_t const frame_begin_ns = m_last_frame_end_ns;
+	std::int64_t const frame_end_ns = Profiler::Now();
+	m_last_frame_end_ns = frame_end_ns;
+	++m_frame;
+
+	double const frame_time_ms = static_cast<double>(frame_end_ns - frame_begin_ns) / 1'000'000.0;
+	record_counters(frame_time_ms, gpu_time_ms);
+
+	if (m_pending_capture.has_value() && frame_end_ns >= m_pending_capture->m_end_ns)
+	{
+		write_capture(m_pending_capture.value());
+		m_pending_capture.reset();
+	}
+
+	// the first frames load and warm up caches, a median needs some history to mean anything
+	bool const has_history = m_frame_time_count >= m_window_size / 4;
+	double const median_ms = has_history ? median_frame_time() : 0.0;
+
+	m_frame_times[m_frame_time_next] = frame_time_ms;
+	m_frame_time_next = (m_frame_time_next + 1) % m_window_size;
+	m_frame_time_count = std::min(m_frame_time_count + 1, m_window_size);
+
+	if (!has_history || m_pending_capture.has_value() || m_capture_count >= m_options.m_max_captures)
+		return;
+
+	bool const over_median = frame_time_ms > m_options.m_median_factor * median_ms;
+	bool const over_budget = m_options.m_budget_ms > 0.0 && frame_time_ms > m_options.m_budget_ms;
+	if (!over_median && !over_budget)
+		return;
+
+	LogWarning("Hitch: frame {} took {:.2f} ms, the median is {:.2f} ms", m_frame, frame_time_ms, median_ms);
+
+	m_pending_capture = Capture{
+		.m_begin_ns = frame_begin_ns - static_cast<std::int64_t>(m_options.m_capture_before_s * 1e9),
+		.m_end_ns = frame_end_ns + static_cast<std::int64_t>(m_options.m_capture_after_s * 1e9),
+		.m_frame = m_frame
+	};
+	++m_capture_count;
+}
+
+void HitchMonitor::record_counters(double frame_time_ms, std::optional<double> gpu_time_ms) const
+{
+	Profiler::RecordCounter("frame ms", frame_time_ms);
+	if (gpu_time_ms.has_value())
+		Profiler::RecordCounter("gpu ms", gpu_time_ms.value());
+
+	RenderStats const stats = FrameStats::GetLast();
+	Profiler::RecordCounter("draw calls", static_cast<double>(stats.m_draw_calls));
+	Profiler::RecordCounter("triangles", static_cast<double>(stats.m_triangles));
+	Profiler::RecordCounter("pipeline binds", static_cast<double>(stats.m_pipeline_binds));
+	Profiler::RecordCounter("texture binds", static_cast<double>(stats.m_texture_binds));
+	Profiler::RecordCounter("constant bytes", static_cast<double>(stats.m_constant_bytes));
+	Profiler::RecordCounter("upload bytes", static_cast<double>(stats.m_upload_bytes));
+	Profiler::RecordCounter("objects culled", static_cast<double>(stats.m_objects_culled));
+	Profiler::RecordCounter("latency ms", static_cast<double>(stats.m_latency_us) / 1000.0);
+	Profiler::RecordCounter("present wait ms", static_cast<double>(stats.m_present_wait_us) / 1000.0);
+	Profiler::RecordCounter("limiter wait ms", static_cast<double>(stats.m_limiter_wait_us) / 1000.0);
+	Profiler::RecordCounter("heap allocations", static_cast<double>(AllocationTracker::GetLastFrame().m_allocation_count));
+}
+
+double HitchMonitor::median_frame_time()
+{
+	m_sorted_frame_times.assign(m_frame_times.begin(), m_frame_times.begin() + m_frame_time_count);
+	auto middle = m_sorted_frame_times.begin() + m_sorted_frame_times.size() / 2;
+	std::nth_element(m_sorted_frame_times.begin(), middle, m_sorted_frame_times.end());
+	return *middle;
+}
+
+void HitchMonitor::write_capture(Capture const & capture)
+{
+	if (m_writer.joinable())
+		m_writer.join(); // only when hitches come faster than a trace can be written
+
+	std::filesystem::path const path = std::filesystem::path(m_options.m_output_dir) / std::format("hitch_{:06}.json", capture.m_frame);
+	m_writer = std::jthread([path, capture]()
+		{
+			if (Profiler::WriteChromeTrace(path.string(), capture.m_begin_ns, capture.m_end_ns))
+				LogInfo("Wrote hitch trace: {}", path.string());
+			else
+				LogError("Failed to write hitch trace: {}", path.string());
+		});
+}
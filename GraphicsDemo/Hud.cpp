@@ -0,0 +1,454 @@
+// Hud.cpp
+
+module;
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+module Hud;
+
+import AllocationTracker;
+import MemoryLedger;
+import PipelineBuilder;
+import Profiler;
+import RenderStats;
+
+namespace
+{
+	// 5x7 glyphs, one byte per row with the leftmost pixel in bit 4. Lower case is drawn as upper case
+	constexpr std::string_view g_glyph_chars = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.,:%/-+=()[]_?<>";
+	constexpr std::uint32_t g_glyph_width = 5;
+	constexpr std::uint32_t g_glyph_height = 7;
+	constexpr std::array<std::array<std::uint8_t, g_glyph_height>, g_glyph_chars.size()> g_glyphs{ {
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+		{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // 0
+		{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 1
+		{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // 2
+		{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // 3
+		{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // 4
+		{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // 5
+		{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // 6
+		{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+		{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // 8
+		{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // 9
+		{ 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // A
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // B
+		{ 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // C
+		{ 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // D
+		{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // E
+		{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // F
+		{ 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // G
+		{ 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // H
+		{ 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // I
+		{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // J
+		{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+		{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // L
+		{ 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+		{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+		{ 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // O
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // P
+		{ 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // Q
+		{ 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // R
+		{ 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // S
+		{ 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // U
+		{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // V
+		{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // W
+		{ 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // X
+		{ 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 }, // Y
+		{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // Z
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // .
+		{ 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, // ,
+		{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // :
+		{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+		{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+		{ 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // -
+		{ 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // +
+		{ 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, // =
+		{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+		{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+		{ 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E }, // [
+		{ 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E }, // ]
+		{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F }, // _
+		{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ?
+		{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // <
+		{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // >
+	} };
+
+	// The atlas is a grid of 8x8 cells, one per glyph followed by a solid and a translucent cell for rectangles
+	constexpr std::uint32_t g_cell_size = 8;
+	constexpr std::uint32_t g_atlas_columns = 16;
+	constexpr std::size_t g_solid_cell = g_glyphs.size();
+	constexpr std::size_t g_translucent_cell = g_glyphs.size() + 1;
+	constexpr std::uint32_t g_atlas_width = g_atlas_columns * g_cell_size;
+	constexpr std::uint32_t g_atlas_height = (static_cast<std::uint32_t>(g_translucent_cell) / g_atlas_columns + 1) * g_cell_size;
+	constexpr std::uint8_t g_translucent_alpha = 176;
+
+	// Layout in pixels, glyphs are drawn at twice their size
+	constexpr float g_scale = 2.0f;
+	constexpr float g_char_advance = (g_glyph_width + 1) * g_scale;
+	constexpr float g_line_height = (g_glyph_height + 2) * g_scale;
+	constexpr float g_margin = 8.0f;
+	constexpr float g_padding = 8.0f;
+	constexpr float g_bar_width = 3.0f;
+	constexpr float g_graph_width = g_bar_width * Hud::m_history_size;
+	constexpr float g_graph_height = 40.0f;
+	constexpr float g_text_columns = 34;
+	constexpr float g_panel_width = std::max(g_graph_width, g_text_columns * g_char_advance) + 2.0f * g_padding;
+	constexpr std::size_t g_max_pipeline_rows = 8;
+
+	constexpr float g_budget_ms = 1000.0f / 60.0f;
+	constexpr float g_graph_max_ms = 2.0f * g_budget_ms;
+
+	glm::vec3 const g_text_color{ 1.0f, 1.0f, 1.0f };
+	glm::vec3 const g_label_color{ 0.6f, 0.6f, 0.6f };
+	glm::vec3 const g_panel_color{ 0.05f, 0.05f, 0.05f };
+	glm::vec3 const g_good_color{ 0.3f, 0.9f, 0.3f };
+	glm::vec3 const g_warning_color{ 1.0f, 0.8f, 0.2f };
+	glm::vec3 const g_bad_color{ 1.0f, 0.3f, 0.3f };
+	glm::vec3 const g_gpu_color{ 0.3f, 0.7f, 1.0f };
+
+	glm::vec2 cell_origin(std::size_t cell)
+	{
+		return glm::vec2{
+			static_cast<float>(cell % g_atlas_columns * g_cell_size),
+			static_cast<float>(cell / g_atlas_columns * g_cell_size) };
+	}
+
+	glm::vec2 to_uv(glm::vec2 texel)
+	{
+		return texel / glm::vec2{ g_atlas_width, g_atlas_height };
+	}
+
+	std::size_t glyph_index(char c)
+	{
+		std::size_t const index = g_glyph_chars.find(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+		return index != std::string_view::npos ? index : g_glyph_chars.find('?');
+	}
+
+	// White texels, the glyph coverage is in the alpha channel and the vertex color tints it
+	std::vector<std::uint8_t> create_font_atlas()
+	{
+		std::vector<std::uint8_t> pixels(std::size_t{ 4 } * g_atlas_width * g_atlas_height, 255);
+		auto set_alpha = [&pixels](glm::vec2 texel, std::uint8_t alpha)
+			{
+				std::size_t const x = static_cast<std::size_t>(texel.x);
+				std::size_t const y = static_cast<std::size_t>(texel.y);
+				pixels[4 * (y * g_atlas_width + x) + 3] = alpha;
+			};
+
+		for (std::size_t cell = 0; cell < g_atlas_width / g_cell_size * (g_atlas_height / g_cell_size); ++cell)
+		{
+			glm::vec2 const origin = cell_origin(cell);
+			for (std::uint32_t y = 0; y < g_cell_size; ++y)
+			{
+				for (std::uint32_t x = 0; x < g_cell_size; ++x)
+				{
+					std::uint8_t alpha = 0;
+					if (cell == g_solid_cell)
+						alpha = 255;
+					else if (cell == g_translucent_cell)
+						alpha = g_translucent_alpha;
+					else if (cell < g_glyphs.size() && x < g_glyph_width && y < g_glyph_height && (g_glyphs[cell][y] & (0x10 >> x)))
+						alpha = 255;
+
+					set_alpha(origin + glm::vec2{ x, y }, alpha);
+				}
+			}
+		}
+
+		return pixels;
+	}
+
+	std::array<OverlayVertex, 6> make_quad(glm::vec2 pos, glm::vec2 size, glm::vec2 uv_min, glm::vec2 uv_max, glm::vec3 const & color)
+	{
+		// Counter clockwise on screen, two triangles per quad
+		OverlayVertex const top_left{ .m_pos{ pos, 0.0f }, .m_tex_coord{ uv_min }, .m_color{ color } };
+		OverlayVertex const bottom_left{ .m_pos{ pos.x, pos.y + size.y, 0.0f }, .m_tex_coord{ uv_min.x, uv_max.y }, .m_color{ color } };
+		OverlayVertex const bottom_right{ .m_pos{ pos + size, 0.0f }, .m_tex_coord{ uv_max }, .m_color{ color } };
+		OverlayVertex const top_right{ .m_pos{ pos.x + size.x, pos.y, 0.0f }, .m_tex_coord{ uv_max.x, uv_min.y }, .m_color{ color } };
+		return { top_left, bottom_left, bottom_right, top_left, bottom_right, top_right };
+	}
+
+	std::array<OverlayVertex, 6> make_rect(glm::vec2 pos, glm::vec2 size, glm::vec3 const & color, bool translucent)
+	{
+		// the middle of the cell, away from the neighbouring glyphs
+		glm::vec2 const origin = cell_origin(translucent ? g_translucent_cell : g_solid_cell);
+		return make_quad(pos, size, to_uv(origin + 2.0f), to_uv(origin + 6.0f), color);
+	}
+}
+
+Hud::Hud(GraphicsApi const & graphics_api, std::filesystem::path const & shaders_path)
+	: m_graphics_api(graphics_api)
+	, m_font_atlas(g_atlas_width, g_atlas_height, create_font_atlas())
+{
+	m_vertices.reserve(m_max_quads * 6);
+
+	if (!m_font_atlas.IsValid())
+		return;
+
+	PipelineBuilder builder;
+	builder.LoadShaders(shaders_path / "hud_vs.txt", shaders_path / "hud_fs.txt");
+	builder.SetDepthTestOptions(DepthTestOptions{ .m_enable_depth_test = false, .m_enable_depth_write = false });
+	builder.SetBlendOptions(BlendOptions{ .m_enable_alpha_blending = true });
+	m_pipeline = builder.CreatePipeline();
+	if (!m_pipeline.has_value())
+	{
+		std::cout << "Hud() Failed to create pipeline, the hud is disabled" << std::endl;
+		return;
+	}
+
+	glGenBuffers(1, &m_vbo_id);
+	glGenVertexArrays(1, &m_vao_id);
+
+	glBindVertexArray(m_vao_id);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_id);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(OverlayVertex) * m_max_quads * 6, nullptr, GL_STREAM_DRAW);
+	Vertex::SetAttributes<OverlayVertex>();
+	glBindVertexArray(0);
+	m_vertex_allocation = TrackedAllocation{ MemoryCategory::DYNAMIC, "hud vertices", sizeof(OverlayVertex) * m_max_quads * 6 };
+}
+
+Hud::~Hud()
+{
+	if (m_vao_id != 0)
+		glDeleteVertexArrays(1, &m_vao_id);
+	if (m_vbo_id != 0)
+		glDeleteBuffers(1, &m_vbo_id);
+}
+
+void Hud::Update(double frame_time_ms, double cpu_time_ms, int overlay_pipeline_index)
+{
+	ProfileZone zone{ "Hud::Update" };
+
+	std::optional<double> const gpu_time_ms = m_graphics_api.GetLastGpuFrameTime();
+
+	m_frame_times[m_history_next] = static_cast<float>(frame_time_ms);
+	m_cpu_times[m_history_next] = static_cast<float>(cpu_time_ms);
+	m_gpu_times[m_history_next] = static_cast<float>(gpu_time_ms.value_or(0.0));
+	m_history_next = (m_history_next + 1) % m_history_size;
+	m_history_count = std::min(m_history_count + 1, m_history_size);
+
+	m_vertices.clear();
+	if (!m_visible || !IsValid())
+		return;
+
+	m_vertices.resize(6); // the panel, written last once its height is known
+	glm::vec2 pen{ g_margin + g_padding };
+
+	// The text shows averages over the history to be readable, the graphs show every frame
+	double const average_frame_ms = average(m_frame_times);
+	m_line.clear();
+	std::format_to(std::back_inserter(m_line), "FPS {:.0f}  FRAME {:.2f} MS",
+		average_frame_ms > 0.0 ? 1000.0 / average_frame_ms : 0.0, average_frame_ms);
+	add_text(pen, m_line, g_text_color);
+	pen.y += g_line_height;
+
+	m_line.clear();
+	std::format_to(std::back_inserter(m_line), "CPU {:.2f} MS  ", average(m_cpu_times));
+	if (gpu_time_ms.has_value())
+		std::format_to(std::back_inserter(m_line), "GPU {:.2f} MS", average(m_gpu_times));
+	else
+		m_line += "GPU --";
+	add_text(pen, m_line, g_text_color);
+	pen.y += g_line_height;
+
+	// how old the scene is once presented, then the time blocked on the display and gpu and in the frame limiter
+	m_line.clear();
+	std::format_to(std::back_inserter(m_line), "LATENCY {:.2f} MS",
+		FrameStats::GetAverage(&RenderStats::m_latency_us) / 1000.0);
+	add_text(pen, m_line, g_text_color);
+	pen.y += g_line_height;
+
+	m_line.clear();
+	std::format_to(std::back_inserter(m_line), "PRESENT {:.2f}  LIMITER {:.2f} MS",
+		FrameStats::GetAverage(&RenderStats::m_present_wait_us) / 1000.0, FrameStats::GetAverage(&RenderStats::m_limiter_wait_us) / 1000.0);
+	add_text(pen, m_line, g_text_color);
+	pen.y += g_line_height * 1.5f;
+
+	add_text(pen, "FRAME TIME, LINE AT 60 FPS", g_label_color);
+	pen.y += g_line_height;
+	add_graph(pen, m_frame_times, true /*budget_colors*/, g_good_color);
+	pen.y += g_graph_height + g_padding;
+
+	add_text(pen, "GPU TIME", g_label_color);
+	pen.y += g_line_height;
+	add_graph(pen, m_gpu_times, false /*budget_colors*/, g_gpu_color);
+	pen.y += g_graph_height + g_padding;
+
+	RenderStats const stats = FrameStats::GetLast();
+
+	m_line.clear();
+	std::format_to(std::back_inserter(m_line), "DRAWS {}  TRIS {}", stats.m_draw_calls, stats.m_triangles);
+	add_text(pen, m_line, g_text_color);
+	pen.y += g_line_height;
+
+	m_line.clear();
+	std::format_to(std::back_inserter(m_line), "PIPELINES {}  TEXTURES {}", stats.m_pipeline_binds, stats.m_texture_binds);
+	add_text(pen, m_line, g_text_color);
+	pen.y += g_line_height;
+
+	m_line.clear();
+	std::format_to(std::back_inserter(m_line), "VISIBLE {}  CULLED {}", stats.m_objects_visible, stats.m_objects_culled);
+	add_text(pen, m_line, g_text_color);
+	pen.y += g_line_height;
+
+	m_line.clear();
+	std::format_to(std::back_inserter(m_line), "CONSTANTS {:.1f} KB  UPLOAD {:.1f} KB",
+		static_cast<double>(stats.m_constant_bytes) / 1024.0, static_cast<double>(stats.m_upload_bytes) / 1024.0);
+	add_text(pen, m_line, g_text_color);
+	pen.y += g_line_height;
+
+	MemoryUsage const memory = MemoryLedger::GetTotalUsage();
+	m_line.clear();
+	std::format_to(std::back_inserter(m_line), "MEMORY {:.1f} MB  PEAK {:.1f} MB",
+		static_cast<double>(memory.m_current_bytes) / (1024.0 * 1024.0), static_cast<double>(memory.m_peak_bytes) / (1024.0 * 1024.0));
+	add_text(pen, m_line, g_text_color);
+	pen.y += g_line_height;
+
+	AllocationCounts const allocations = AllocationTracker::GetLastFrame();
+	m_line.clear();
+	std::format_to(std::back_inserter(m_line), "ALLOCS {}  ALLOC {:.1f} KB",
+		allocations.m_allocation_count, static_cast<double>(allocations.m_allocated_bytes) / 1024.0);
+	add_text(pen, m_line, allocations.m_allocation_count == 0 ? g_text_color : g_warning_color);
+	pen.y += g_line_height * 1.5f;
+
+	std::vector<GpuPipelineTiming> const & timings = m_graphics_api.GetLastGpuPipelineTimings();
+	if (!timings.empty())
+	{
+		add_text(pen, "GPU PER PIPELINE", g_label_color);
+		pen.y += g_line_height;
+	}
+	for (std::size_t i = 0; i < std::min(timings.size(), g_max_pipeline_rows); ++i)
+	{
+		GpuPipelineTiming const & timing = timings[i];
+		m_line.clear();
+		if (static_cast<int>(timing.m_pipeline_index) == overlay_pipeline_index)
+			std::format_to(std::back_inserter(m_line), "HUD          {:6.3f} MS", timing.m_time_ms);
+		else
+			std::format_to(std::back_inserter(m_line), "PIPELINE {:<3} {:6.3f} MS", timing.m_pipeline_index, timing.m_time_ms);
+		add_text(pen, m_line, g_text_color);
+		pen.y += g_line_height;
+	}
+	if (timings.size() > g_max_pipeline_rows)
+	{
+		m_line.clear();
+		std::format_to(std::back_inserter(m_line), "+{} MORE", timings.size() - g_max_pipeline_rows);
+		add_text(pen, m_line, g_label_color);
+		pen.y += g_line_height;
+	}
+
+	glm::vec2 const panel_size{ g_panel_width, pen.y - g_margin + g_padding - (g_line_height - g_glyph_height * g_scale) };
+	std::ranges::copy(make_rect(glm::vec2{ g_margin }, panel_size, g_panel_color, true /*translucent*/), m_vertices.begin());
+}
+
+void Hud::Render() const
+{
+	if (!IsValid() || m_vertices.empty())
+		return;
+
+	ProfileZone zone{ "Hud::Render" };
+
+	GLint viewport[4]{};
+	glGetIntegerv(GL_VIEWPORT, viewport); // whatever the scene was drawn with
+
+	m_pipeline->Activate();
+	m_pipeline->SetUniform("viewport_size", glm::vec2{ viewport[2], viewport[3] });
+	m_font_atlas.Bind();
+
+	glBindVertexArray(m_vao_id);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo_id);
+
+	// Orphaning the previous storage lets the driver hand out fresh memory instead of waiting for the gpu to read it
+	GLsizeiptr const upload_size = static_cast<GLsizeiptr>(sizeof(OverlayVertex) * m_vertices.size());
+	glBufferData(GL_ARRAY_BUFFER, sizeof(OverlayVertex) * m_max_quads * 6, nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, upload_size, m_vertices.data());
+
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); // a wireframe object may have left it on lines
+	glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(m_vertices.size()));
+	glBindVertexArray(0);
+
+	RenderStats & stats = FrameStats::Current();
+	stats.m_draw_calls += 1;
+	stats.m_instances += 1;
+	stats.m_triangles += m_vertices.size() / 3;
+	stats.m_upload_bytes += static_cast<std::uint64_t>(upload_size);
+}
+
+void Hud::add_quad(glm::vec2 pos, glm::vec2 size, glm::vec2 uv_min, glm::vec2 uv_max, glm::vec3 const & color)
+{
+	if (m_vertices.size() + 6 > m_max_quads * 6)
+		return;
+
+	std::array<OverlayVertex, 6> const quad = make_quad(pos, size, uv_min, uv_max, color);
+	m_vertices.insert(m_vertices.end(), quad.begin(), quad.end());
+}
+
+void Hud::add_rect(glm::vec2 pos, glm::vec2 size, glm::vec3 const & color, bool translucent /*= false*/)
+{
+	if (m_vertices.size() + 6 > m_max_quads * 6)
+		return;
+
+	std::array<OverlayVertex, 6> const quad = make_rect(pos, size, color, translucent);
+	m_vertices.insert(m_vertices.end(), quad.begin(), quad.end());
+}
+
+void Hud::add_text(glm::vec2 pos, std::string_view text, glm::vec3 const & color)
+{
+	glm::vec2 const glyph_size = glm::vec2{ g_glyph_width, g_glyph_height } * g_scale;
+	for (char c : text)
+	{
+		if (c != ' ')
+		{
+			glm::vec2 const origin = cell_origin(glyph_index(c));
+			add_quad(pos, glyph_size, to_uv(origin), to_uv(origin + glm::vec2{ g_glyph_width, g_glyph_height }), color);
+		}
+		pos.x += g_char_advance;
+	}
+}
+
+void Hud::add_graph(glm::vec2 pos, History const & history, bool budget_colors, glm::vec3 const & color)
+{
+	// Newest sample on the right, the graph fills up from there
+	for (std::size_t i = 0; i < m_history_count; ++i)
+	{
+		std::size_t const sample = (m_history_next + m_history_size - m_history_count + i) % m_history_size;
+		float const time_ms = history[sample];
+		float const height = std::clamp(time_ms / g_graph_max_ms, 0.0f, 1.0f) * g_graph_height;
+
+		glm::vec3 bar_color = color;
+		if (budget_colors)
+			bar_color = time_ms <= g_budget_ms ? g_good_color : (time_ms <= 2.0f * g_budget_ms ? g_warning_color : g_bad_color);
+
+		float const x = pos.x + static_cast<float>(m_history_size - m_history_count + i) * g_bar_width;
+		add_rect(glm::vec2{ x, pos.y + g_graph_height - height }, glm::vec2{ g_bar_width - 1.0f, height }, bar_color);
+	}
+
+	float const budget_y = pos.y + g_graph_height * (1.0f - g_budget_ms / g_graph_max_ms);
+	add_rect(glm::vec2{ pos.x, budget_y }, glm::vec2{ g_graph_width, 1.0f }, g_label_color);
+}
+
+float Hud::average(History const & history) const
+{
+	if (m_history_count == 0)
+		return 0.0f;
+
+	// the unused slots are zero until the history has filled up once
+	float sum = 0.0f;
+	for (float time_ms : history)
+		sum += time_ms;
+	return sum / static_cast<float>(m_history_count);
+}
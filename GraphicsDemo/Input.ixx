@@ -2,9 +2,13 @@
 
 export module Input;
 
-import <mutex>;
-import <unordered_set>;
+import <array>;
+import <atomic>;
+import <bitset>;
+import <cstdint>;
+import <vector>;
 
+// The key state the scene sees for one step. Only used by one thread at a time, so it needs no locking
 export class Input
 {
 public:
@@ -16,19 +20,17 @@ public:
 		Up      = 265  // GLFW_KEY_UP
 	};
 
+	constexpr static int m_key_count = 512; // GLFW_KEY_LAST is 348
+
 	void SetKey(int key, bool pressed)
 	{
-		std::lock_guard lock(m_key_state_mutex);
-		if (pressed)
-			m_key_state.insert(key);
-		else
-			m_key_state.erase(key);
+		if (key >= 0 && key < m_key_count)
+			m_key_state.set(static_cast<std::size_t>(key), pressed);
 	}
 
 	bool KeyIsPressed(int key) const
 	{
-		std::lock_guard lock(m_key_state_mutex);
-		return m_key_state.contains(key);
+		return key >= 0 && key < m_key_count && m_key_state.test(static_cast<std::size_t>(key));
 	}
 
 	bool KeyIsPressed(Key key) const
@@ -36,7 +38,111 @@ public:
 		return KeyIsPressed(static_cast<int>(key));
 	}
 
+	int GetPressedKeyCount() const { return static_cast<int>(m_key_state.count()); }
+
+	// In ascending key order, so identical key states always produce identical recordings
+	template <typename Fn>
+	void ForEachPressedKey(Fn && fn) const
+	{
+		for (int key = 0; key < m_key_count; ++key)
+		{
+			if (m_key_state.test(static_cast<std::size_t>(key)))
+				fn(key);
+		}
+	}
+
+	void SetPressedKeys(std::vector<int> const & keys)
+	{
+		m_key_state.reset();
+		for (int key : keys)
+			SetKey(key, true /*pressed*/);
+	}
+
+private:
+	std::bitset<m_key_count> m_key_state;
+};
+
+// The keys held right now, set by the window thread as events arrive. Lets the render thread read the input as late as
+// possible, without waiting for the simulation thread to step with it
+export class LiveKeyState
+{
+public:
+	// Window thread only
+	void SetKey(int key, bool pressed)
+	{
+		if (key < 0 || key >= Input::m_key_count)
+			return;
+
+		std::uint64_t const bit = std::uint64_t{ 1 } << (key % 64);
+		if (pressed)
+			m_words[key / 64].fetch_or(bit, std::memory_order_relaxed);
+		else
+			m_words[key / 64].fetch_and(~bit, std::memory_order_relaxed);
+	}
+
+	Input Load() const
+	{
+		Input input;
+		for (int word = 0; word < m_word_count; ++word)
+		{
+			std::uint64_t const bits = m_words[word].load(std::memory_order_relaxed);
+			for (int bit = 0; bit < 64; ++bit)
+			{
+				if (bits & (std::uint64_t{ 1 } << bit))
+					input.SetKey(word * 64 + bit, true /*pressed*/);
+			}
+		}
+		return input;
+	}
+
 private:
-	mutable std::mutex m_key_state_mutex;
-	std::unordered_set<int> m_key_state;
+	constexpr static int m_word_count = Input::m_key_count / 64;
+
+	std::array<std::atomic<std::uint64_t>, m_word_count> m_words{};
+};
+
+export struct KeyEvent
+{
+	double m_time{ 0.0 }; // glfwGetTime() when the event arrived
+	int m_key{ 0 };
+	bool m_pressed{ false };
+};
+
+// Hands key events from the window thread to the simulation thread without locks, a single producer single consumer ring
+export class KeyEventQueue
+{
+public:
+	// Window thread only. Returns false when the simulation thread is so far behind that the queue is full
+	bool Push(KeyEvent const & event)
+	{
+		std::uint64_t const write_count = m_write_count.load(std::memory_order_relaxed);
+		if (write_count - m_read_count.load(std::memory_order_acquire) >= m_capacity)
+			return false;
+
+		m_events[write_count % m_capacity] = event;
+		m_write_count.store(write_count + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Simulation thread only. Applies the events that arrived up to time to the snapshot, later ones wait for the next step
+	void ApplyUntil(double time, Input & input)
+	{
+		std::uint64_t read_count = m_read_count.load(std::memory_order_relaxed);
+		std::uint64_t const write_count = m_write_count.load(std::memory_order_acquire);
+		for (; read_count < write_count; ++read_count)
+		{
+			KeyEvent const & event = m_events[read_count % m_capacity];
+			if (event.m_time > time)
+				break;
+			input.SetKey(event.m_key, event.m_pressed);
+		}
+		m_read_count.store(read_count, std::memory_order_release);
+	}
+
+private:
+	constexpr static std::uint64_t m_capacity = 256;
+
+	std::array<KeyEvent, m_capacity> m_events{};
+	std::atomic<std::uint64_t> m_write_count{ 0 };
+	std::atomic<std::uint64_t> m_read_count{ 0 };
 };
@@ -2,23 +2,41 @@
 
 module;
 
+#include <algorithm>
 #include <iostream>
+#include <string>
 #include <vector>
 
 #include <glad/glad.h>
 
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
 export module Mesh;
 
+import MemoryLedger;
+import Profiler;
+import RenderStats;
 import Vertex;
 
+// Local space bounds, centred on the vertices' bounding box
+export struct BoundingSphere
+{
+	glm::vec3 m_center{ 0.0f, 0.0f, 0.0f };
+	float m_radius{ 0.0f };
+};
+
 export class Mesh
 {
 public:
 	using IndexT = std::uint16_t;
 
+	// name identifies the mesh in the memory ledger
 	template <IsVertex VertexT>
 	Mesh(std::vector<VertexT> const & vertices,
-		std::vector<IndexT> const & indices);
+		std::vector<IndexT> const & indices,
+		std::string const & name);
 	~Mesh();
 
 	Mesh(Mesh && other);
@@ -28,6 +46,7 @@ public:
 	Mesh & operator=(Mesh &) = delete;
 
 	bool IsInitialized() const;
+	BoundingSphere const & GetBounds() const { return m_bounds; }
 
 	void Render(bool wireframe) const;
 
@@ -40,11 +59,39 @@ private:
 	unsigned int m_vao_id{ 0 }; // vertex array object
 
 	GLsizei m_index_count{ 0 };
+
+	BoundingSphere m_bounds;
+
+	TrackedAllocation m_allocation; // both buffers, as uploaded since the driver's padding isn't visible
 };
 
+namespace
+{
+	template <IsVertex VertexT>
+	BoundingSphere compute_bounds(std::vector<VertexT> const & vertices)
+	{
+		if (vertices.empty())
+			return BoundingSphere{};
+
+		glm::vec3 min_pos = vertices[0].m_pos;
+		glm::vec3 max_pos = vertices[0].m_pos;
+		for (VertexT const & vertex : vertices)
+		{
+			min_pos = glm::min(min_pos, vertex.m_pos);
+			max_pos = glm::max(max_pos, vertex.m_pos);
+		}
+
+		BoundingSphere bounds{ .m_center = (min_pos + max_pos) * 0.5f };
+		for (VertexT const & vertex : vertices)
+			bounds.m_radius = std::max(bounds.m_radius, glm::length(vertex.m_pos - bounds.m_center));
+		return bounds;
+	}
+}
+
 template <IsVertex VertexT>
 Mesh::Mesh(std::vector<VertexT> const & vertices,
-	std::vector<IndexT> const & indices)
+	std::vector<IndexT> const & indices,
+	std::string const & name)
 {
 	if (vertices.empty())
 	{
@@ -57,6 +104,8 @@ Mesh::Mesh(std::vector<VertexT> const & vertices,
 		return;
 	}
 
+	ProfileZone zone{ "upload mesh" };
+
 	glGenBuffers(1, &m_vbo_id);
 	glGenBuffers(1, &m_ebo_id);
 	glGenVertexArrays(1, &m_vao_id);
@@ -68,15 +117,21 @@ Mesh::Mesh(std::vector<VertexT> const & vertices,
 
 	GLsizeiptr buffer_size = static_cast<GLsizeiptr>(vertices.size() * sizeof(VertexT));
 	glBufferData(GL_ARRAY_BUFFER, buffer_size, vertices.data(), GL_STATIC_DRAW);
+	FrameStats::Current().m_upload_bytes += static_cast<std::uint64_t>(buffer_size);
+	std::uint64_t allocation_size = static_cast<std::uint64_t>(buffer_size);
 
 	buffer_size = static_cast<GLsizeiptr>(indices.size() * sizeof(IndexT));
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, buffer_size, indices.data(), GL_STATIC_DRAW);
+	FrameStats::Current().m_upload_bytes += static_cast<std::uint64_t>(buffer_size);
+	allocation_size += static_cast<std::uint64_t>(buffer_size);
 
 	Vertex::SetAttributes<VertexT>();
 
 	glBindVertexArray(0);
 
 	m_index_count = static_cast<GLsizei>(indices.size());
+	m_bounds = compute_bounds(vertices);
+	m_allocation = TrackedAllocation{ MemoryCategory::MESH, name, allocation_size };
 }
 
 Mesh::~Mesh()
@@ -92,6 +147,7 @@ void Mesh::destroy_buffers()
 	m_vao_id = 0;
 	m_vbo_id = 0;
 	m_ebo_id = 0;
+	m_allocation.Reset();
 }
 
 Mesh::Mesh(Mesh && other)
@@ -110,6 +166,8 @@ Mesh & Mesh::operator=(Mesh && other)
 	m_ebo_id = other.m_ebo_id;
 	m_vao_id = other.m_vao_id;
 	m_index_count = other.m_index_count;
+	m_bounds = other.m_bounds;
+	m_allocation = std::move(other.m_allocation);
 
 	other.m_vao_id = 0;
 	other.m_vbo_id = 0;
@@ -142,4 +200,9 @@ void Mesh::Render(bool wireframe) const
 	static_assert(std::is_same_v<IndexT, std::uint16_t>,
 		"Mesh::Render only supports 16-bit indices");
 	glDrawElements(GL_TRIANGLES, m_index_count, GL_UNSIGNED_SHORT, nullptr);
+
+	RenderStats & stats = FrameStats::Current();
+	stats.m_draw_calls += 1;
+	stats.m_instances += 1;
+	stats.m_triangles += m_index_count / 3;
 }
@@ -12,6 +12,7 @@ module;
 module PipelineBuilder;
 
 import GraphicsApi;
+import Profiler;
 
 namespace
 {
@@ -75,6 +76,8 @@ PipelineBuilder::~PipelineBuilder()
 
 void PipelineBuilder::LoadShaders(std::filesystem::path const & vs_path, std::filesystem::path const & fs_path)
 {
+	ProfileZone zone{ "compile shaders" };
+
 	m_vert_shader_id = load_shader(GL_VERTEX_SHADER, vs_path);
 	m_frag_shader_id = load_shader(GL_FRAGMENT_SHADER, fs_path);
 }
@@ -91,6 +94,9 @@ std::optional<GraphicsPipeline> PipelineBuilder::CreatePipeline() const
 		m_vert_shader_id,
 		m_frag_shader_id,
 		m_depth_test_options,
+		m_blend_options,
 		m_per_frame_constants_callback,
-		m_per_object_constants_callback };
+		m_draw_objects,
+		m_per_object_uniform_labels,
+		m_textures };
 }
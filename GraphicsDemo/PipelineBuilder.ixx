@@ -3,19 +3,21 @@
 module;
 
 #include <filesystem>
+#include <string_view>
+#include <vector>
 
 export module PipelineBuilder;
 
 import GraphicsApi;
 import GraphicsPipeline;
-import RenderObject;
+import RenderPacket;
+import Texture;
 import Vertex;
 
 export class PipelineBuilder
 {
 public:
 	using PerFrameConstantsCallback = GraphicsPipeline::PerFrameConstantsCallback;
-	using PerObjectConstantsCallback = GraphicsPipeline::PerObjectConstantsCallback;
 
 	PipelineBuilder() = default;
 	~PipelineBuilder();
@@ -23,9 +25,16 @@ public:
 	void LoadShaders(std::filesystem::path const & vs_path, std::filesystem::path const & fs_path);
 
 	void SetDepthTestOptions(DepthTestOptions const & options) { m_depth_test_options = options; }
+	void SetBlendOptions(BlendOptions const & options) { m_blend_options = options; }
 
 	void SetPerFrameConstantsCallback(PerFrameConstantsCallback callback) { m_per_frame_constants_callback = callback; }
-	void SetPerObjectConstantsCallback(PerObjectConstantsCallback callback) { m_per_object_constants_callback = callback; }
+
+	// Uniforms the renderer sets from each draw, the code that does it is generated for these types
+	template <PerObjectUniform... Uniforms>
+	void SetPerObjectUniformTypes();
+
+	// Bound for each draw by its DrawPacket::m_tex_id
+	void SetTextures(std::vector<Texture> const & textures) { m_textures = &textures; }
 
 	std::optional<GraphicsPipeline> CreatePipeline() const;
 
@@ -34,7 +43,17 @@ private:
 	unsigned int m_frag_shader_id{ 0 };
 
 	DepthTestOptions m_depth_test_options;
+	BlendOptions m_blend_options;
 
 	PerFrameConstantsCallback m_per_frame_constants_callback;
-	PerObjectConstantsCallback m_per_object_constants_callback;
+	GraphicsPipeline::DrawObjectsFn m_draw_objects{ GraphicsPipeline::MakeDrawObjectsFn() };
+	std::vector<std::string_view> m_per_object_uniform_labels;
+	std::vector<Texture> const * m_textures{ nullptr };
 };
+
+template <PerObjectUniform... Uniforms>
+void PipelineBuilder::SetPerObjectUniformTypes()
+{
+	m_per_object_uniform_labels = { Uniforms::m_label... };
+	m_draw_objects = GraphicsPipeline::MakeDrawObjectsFn<Uniforms...>();
+}
@@ -2,6 +2,7 @@
 
 module;
 
+#include <cstdint>
 #include <string>
 
 #include <glm/vec3.hpp>
@@ -9,6 +10,8 @@ module;
 
 export module RenderObject;
 
+import VersionedBlock;
+
 export class RenderObject
 {
 public:
@@ -23,18 +26,24 @@ public:
 	void SetMeshId(int mesh_id) { m_mesh_id = mesh_id; }
 	void SetPipelineId(int pipeline_id) { m_pipeline_id = pipeline_id; }
 	void SetTextureId(int texture_id) { m_texture_id = texture_id; }
-	void SetColor(glm::vec3 const & color) { m_color = color; }
+	void SetColor(glm::vec3 const & color);
 	void SetDrawWireframe(bool wireframe = true) { m_draw_wireframe = wireframe; }
+	void SetCullable(bool cullable) { m_cullable = cullable; }
 
 	int GetMeshId() const { return m_mesh_id; }
 	int GetPipelineId() const { return m_pipeline_id; }
 	int GetTextureId() const { return m_texture_id; }
 	glm::vec3 const & GetColor() const { return m_color; }
 	bool GetDrawWireframe() const { return m_draw_wireframe; }
+	bool IsCullable() const { return m_cullable; }
 
-	glm::mat4 & ModifyModelTransform() { return m_model_transform; }
+	void SetModelTransform(glm::mat4 const & model_transform);
+	glm::mat4 & ModifyModelTransform(); // taken as a change
 	glm::mat4 const & GetModelTransform() const { return m_model_transform; }
 
+	// Of the model transform and color, the per-object constants, see VersionedBlock
+	std::uint64_t GetConstantsVersion() const { return m_constants_version; }
+
 private:
 	std::string m_name; // for debugging
 
@@ -45,6 +54,30 @@ private:
 	glm::vec3 m_color;
 
 	bool m_draw_wireframe{ false };
+	bool m_cullable{ true }; // false for objects the shader keeps around the camera, like the skybox
 
 	glm::mat4 m_model_transform{ 1.0 };
+	std::uint64_t m_constants_version{ NextBlockVersion() };
 };
+
+void RenderObject::SetColor(glm::vec3 const & color)
+{
+	if (color == m_color)
+		return;
+	m_color = color;
+	m_constants_version = NextBlockVersion();
+}
+
+void RenderObject::SetModelTransform(glm::mat4 const & model_transform)
+{
+	if (model_transform == m_model_transform)
+		return;
+	m_model_transform = model_transform;
+	m_constants_version = NextBlockVersion();
+}
+
+glm::mat4 & RenderObject::ModifyModelTransform()
+{
+	m_constants_version = NextBlockVersion();
+	return m_model_transform;
+}
@@ -0,0 +1,53 @@
+// RenderPacket.ixx
+
+module;
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/ext/matrix_float4x4.hpp>
+
+export module RenderPacket;
+
+// Everything the submission stage needs to draw one object, copied out of its RenderObject by the extraction stage
+export struct DrawPacket
+{
+	std::uint64_t m_draw_key{ 0 }; // pipeline, then mesh, then extraction order, the draws are submitted sorted by it
+	glm::mat4 m_model_transform{ 1.0 };
+	glm::vec3 m_color{ 1.0, 1.0, 1.0 };
+	std::uint64_t m_constants_version{ 0 }; // of the model transform and color, see RenderObject::GetConstantsVersion()
+	int m_mesh_id{ -1 };
+	int m_tex_id{ -1 };
+	bool m_draw_wireframe{ false };
+};
+
+// The draws of a frame once culled and sorted, so submitting them reads neither the render objects nor the scene graph
+export struct FramePacket
+{
+	glm::vec3 m_clear_color{ 0.0, 0.0, 0.0 };
+	std::vector<DrawPacket> m_draws;
+	std::vector<std::size_t> m_pipeline_draw_offsets; // the draws of pipeline i are [offsets[i], offsets[i + 1])
+
+	// counted while extracting, added to the stats of the frame that submits the packet
+	std::uint64_t m_objects_visible{ 0 };
+	std::uint64_t m_objects_culled{ 0 };
+
+	std::span<DrawPacket const> GetPipelineDraws(std::size_t pipeline_index) const
+	{
+		if (pipeline_index + 1 >= m_pipeline_draw_offsets.size())
+			return {};
+		return std::span<DrawPacket const>(m_draws).subspan(
+			m_pipeline_draw_offsets[pipeline_index],
+			m_pipeline_draw_offsets[pipeline_index + 1] - m_pipeline_draw_offsets[pipeline_index]);
+	}
+
+	static std::uint64_t MakeDrawKey(std::size_t pipeline_index, int mesh_id, std::size_t draw_index)
+	{
+		return (static_cast<std::uint64_t>(pipeline_index & 0xFFFF) << 48)
+			| (static_cast<std::uint64_t>(mesh_id & 0xFFFF) << 32)
+			| static_cast<std::uint64_t>(draw_index & 0xFFFFFFFF);
+	}
+};
@@ -0,0 +1,77 @@
+// RenderTarget.cpp
+
+module;
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+
+module RenderTarget;
+
+RenderTarget::RenderTarget(int width, int height)
+	: m_width(width)
+	, m_height(height)
+{
+	glGenRenderbuffers(1, &m_color_renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_color_renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_width, m_height);
+
+	glGenRenderbuffers(1, &m_depth_renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_depth_renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, m_width, m_height);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &m_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color_renderbuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depth_renderbuffer);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "RenderTarget: framebuffer is incomplete, status: " << status << std::endl;
+		glDeleteFramebuffers(1, &m_framebuffer);
+		m_framebuffer = 0;
+	}
+
+	// 4 bytes per pixel for both RGBA8 and DEPTH24_STENCIL8
+	m_allocation = TrackedAllocation{ MemoryCategory::RENDER_TARGET, "offscreen framebuffer",
+		std::uint64_t{ 8 } * m_width * m_height };
+}
+
+RenderTarget::~RenderTarget()
+{
+	glDeleteFramebuffers(1, &m_framebuffer);
+	glDeleteRenderbuffers(1, &m_depth_renderbuffer);
+	glDeleteRenderbuffers(1, &m_color_renderbuffer);
+}
+
+void RenderTarget::Bind() const
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glViewport(0, 0, m_width, m_height); // a surfaceless context starts with an empty viewport
+}
+
+void RenderTarget::ReadPixels(std::vector<std::uint8_t> & out_rgba_pixels) const
+{
+	size_t const row_size = static_cast<size_t>(m_width) * 4;
+	out_rgba_pixels.resize(row_size * m_height);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, out_rgba_pixels.data());
+
+	// OpenGL returns the bottom row first
+	for (int y = 0; y < m_height / 2; ++y)
+	{
+		auto top = out_rgba_pixels.begin() + y * row_size;
+		auto bottom = out_rgba_pixels.begin() + (m_height - 1 - y) * row_size;
+		std::swap_ranges(top, top + row_size, bottom);
+	}
+}
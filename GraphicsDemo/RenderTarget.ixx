@@ -0,0 +1,41 @@
+// RenderTarget.ixx
+
+module;
+
+#include <cstdint>
+#include <vector>
+
+export module RenderTarget;
+
+import MemoryLedger;
+
+// Offscreen framebuffer with a colour and a depth attachment, used in place of the window's default framebuffer
+export class RenderTarget
+{
+public:
+	RenderTarget(int width, int height);
+	~RenderTarget();
+
+	RenderTarget(RenderTarget &) = delete;
+	RenderTarget & operator=(RenderTarget &) = delete;
+
+	bool IsValid() const { return m_framebuffer != 0; }
+
+	void Bind() const;
+
+	// Tightly packed RGBA8, top row first
+	void ReadPixels(std::vector<std::uint8_t> & out_rgba_pixels) const;
+
+	int GetWidth() const { return m_width; }
+	int GetHeight() const { return m_height; }
+
+private:
+	int m_width{ 0 };
+	int m_height{ 0 };
+
+	unsigned int m_framebuffer{ 0 };
+	unsigned int m_color_renderbuffer{ 0 };
+	unsigned int m_depth_renderbuffer{ 0 };
+
+	TrackedAllocation m_allocation;
+};
@@ -2,54 +2,164 @@
 
 module;
 
-#include <iostream>
+#include <algorithm>
 
 #include <glad/glad.h>
 
+#include <glm/geometric.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 module Renderer;
 
 import ObjLoader;
+import Log;
+import Profiler;
+import RenderStats;
+
+void Renderer::Extract()
+{
+	ProfileZone zone{ "Renderer::Extract" };
+
+	std::size_t const packet_index = (m_extracted_packet + 1) % m_packet_count;
+	FramePacket & packet = m_packets[packet_index];
+	packet.m_clear_color = m_clear_color;
+	packet.m_draws.clear();
+	packet.m_pipeline_draw_offsets.clear();
+	packet.m_objects_visible = 0;
+	packet.m_objects_culled = 0;
+
+	{
+		// frustum culling and gathering the draws, timed apart from the sort
+		ProfileZone cull_zone{ "cull" };
+
+		for (std::size_t i = 0; i < m_pipeline_containers.size(); ++i)
+		{
+			packet.m_pipeline_draw_offsets.push_back(packet.m_draws.size());
+
+			for (std::weak_ptr<RenderObject> const & render_object : m_pipeline_containers[i].m_render_objects)
+			{
+				std::shared_ptr<RenderObject> obj = render_object.lock();
+				if (!obj)
+					continue;
+
+				int mesh_id = obj->GetMeshId();
+				if (mesh_id == -1)
+					continue;
+
+				if (!is_visible(*obj, m_meshes[mesh_id]))
+				{
+					packet.m_objects_culled += 1;
+					continue;
+				}
+				packet.m_objects_visible += 1;
+
+				packet.m_draws.push_back(DrawPacket{
+					.m_draw_key = FramePacket::MakeDrawKey(i, mesh_id, packet.m_draws.size()),
+					.m_model_transform = obj->GetModelTransform(),
+					.m_color = obj->GetColor(),
+					.m_constants_version = obj->GetConstantsVersion(),
+					.m_mesh_id = mesh_id,
+					.m_tex_id = obj->GetTextureId(),
+					.m_draw_wireframe = obj->GetDrawWireframe()
+				});
+			}
+		}
+	}
+	packet.m_pipeline_draw_offsets.push_back(packet.m_draws.size());
+
+	// the pipeline is the key's top bits, so each pipeline's draws stay within its range while the same meshes come together
+	std::ranges::sort(packet.m_draws, {}, &DrawPacket::m_draw_key);
+
+	m_extracted_packet = packet_index;
+}
 
 void Renderer::Render() const
 {
+	ProfileZone zone{ "Renderer::Render" };
+
+	FramePacket const & packet = m_packets[m_extracted_packet];
+	FrameStats::Current().m_objects_visible += packet.m_objects_visible;
+	FrameStats::Current().m_objects_culled += packet.m_objects_culled;
+
 	glEnable(GL_DEPTH_TEST);
 	glDepthMask(GL_TRUE);
 	glDepthFunc(GL_LESS);
 
-	glClearColor(m_clear_color.r, m_clear_color.g, m_clear_color.b, 1.0);
+	glClearColor(packet.m_clear_color.r, packet.m_clear_color.g, packet.m_clear_color.b, 1.0);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	for (PipelineContainer const & container : m_pipeline_containers)
+	for (std::size_t i = 0; i < m_pipeline_containers.size(); ++i)
 	{
+		ProfileZone pipeline_zone{ "Renderer pipeline", static_cast<int>(i) };
+		m_graphics_api.BeginPipelineTimer(static_cast<std::uint32_t>(i));
+
+		PipelineContainer const & container = m_pipeline_containers[i];
 		GraphicsPipeline const & pipeline = container.m_pipeline;
 		pipeline.Activate();
-		pipeline.UpdatePerFrameConstants();
-
-		for (std::weak_ptr<RenderObject> render_object : container.m_render_objects)
 		{
-			std::shared_ptr<RenderObject> obj = render_object.lock();
-			if (!obj)
-				continue;
+			ProfileZone upload_zone{ "upload per-frame constants" };
+			pipeline.UpdatePerFrameConstants();
+		}
 
-			int mesh_id = obj->GetMeshId();
-			if (mesh_id == -1)
-				continue;
+		pipeline.DrawObjects(packet.GetPipelineDraws(i), m_meshes);
 
-			pipeline.UpdatePerObjectConstants(*obj);
+		m_graphics_api.EndPipelineTimer();
+	}
 
-			Mesh const & mesh = m_meshes[mesh_id];
-			mesh.Render(obj->GetDrawWireframe());
-		}
+	if (m_overlay_callback)
+	{
+		ProfileZone overlay_zone{ "Renderer overlay" };
+		m_graphics_api.BeginPipelineTimer(static_cast<std::uint32_t>(m_pipeline_containers.size()));
+		m_overlay_callback();
+		m_graphics_api.EndPipelineTimer();
+	}
+}
+
+void Renderer::SetViewProjTransform(glm::mat4 const & view_proj)
+{
+	// Gribb-Hartmann: each plane is the last row of the matrix plus or minus one of the others
+	auto row = [&view_proj](int i) { return glm::vec4{ view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i] }; };
+
+	std::array<glm::vec4, 6> planes{
+		row(3) + row(0), // left
+		row(3) - row(0), // right
+		row(3) + row(1), // bottom
+		row(3) - row(1), // top
+		row(3) + row(2), // near, conservative when the depth range is [0, 1]
+		row(3) - row(2)  // far
+	};
+
+	for (glm::vec4 & plane : planes)
+		plane /= glm::length(glm::vec3{ plane });
+
+	m_frustum_planes = planes;
+}
+
+bool Renderer::is_visible(RenderObject const & obj, Mesh const & mesh) const
+{
+	if (!m_frustum_planes.has_value() || !obj.IsCullable())
+		return true;
+
+	glm::mat4 const & model = obj.GetModelTransform();
+	BoundingSphere const & bounds = mesh.GetBounds();
+
+	glm::vec3 const center{ model * glm::vec4{ bounds.m_center, 1.0f } };
+	float const scale = std::max({ glm::length(glm::vec3{ model[0] }), glm::length(glm::vec3{ model[1] }), glm::length(glm::vec3{ model[2] }) });
+	float const radius = bounds.m_radius * scale;
+
+	for (glm::vec4 const & plane : m_frustum_planes.value())
+	{
+		if (glm::dot(glm::vec3{ plane }, center) + plane.w < -radius)
+			return false;
 	}
+	return true;
 }
 
 int Renderer::AddPipeline(GraphicsPipeline && pipeline)
 {
 	if (!pipeline.IsValid())
 	{
-		std::cout << "Renderer::AddGraphicsPipeline() invalid pipeline";
+		LogError("Renderer::AddGraphicsPipeline() invalid pipeline");
 		return -1;
 	}
 
@@ -70,12 +180,12 @@ std::shared_ptr<RenderObject> Renderer::CreateRenderObject(std::string const & n
 {
 	if (mesh_id < 0 || mesh_id >= static_cast<int>(m_meshes.size()))
 	{
-		std::cout << "Renderer::CreateRenderObject() invalid mesh id for object: " << name << std::endl;
+		LogError("Renderer::CreateRenderObject() invalid mesh id for object: {}", name);
 		return nullptr;
 	}
 	if (pipeline_id < 0 || pipeline_id >= static_cast<int>(m_pipeline_containers.size()))
 	{
-		std::cout << "Renderer::CreateRenderObject() invalid pipeline id for object: " << name << std::endl;
+		LogError("Renderer::CreateRenderObject() invalid pipeline id for object: {}", name);
 		return nullptr;
 	}
 
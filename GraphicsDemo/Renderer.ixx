@@ -2,19 +2,26 @@
 
 module;
 
+#include <array>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/ext/matrix_float4x4.hpp>
 
 export module Renderer;
 
 import <filesystem>;
 
+import GraphicsApi;
 import GraphicsPipeline;
 import Mesh;
 import RenderObject;
+import RenderPacket;
 
 struct PipelineContainer
 {
@@ -25,8 +32,17 @@ struct PipelineContainer
 export class Renderer
 {
 public:
-	Renderer() = default;
+	using OverlayCallback = std::function<void()>;
 
+	explicit Renderer(GraphicsApi & graphics_api)
+		: m_graphics_api(graphics_api)
+	{}
+
+	// Extraction stage: culls the render objects and copies what drawing them takes into the next packet of the ring.
+	// The packet submitted last stays untouched, so the next frame can be prepared before the current one is done with
+	void Extract();
+
+	// Submission stage: draws the last extracted packet, reading nothing else of the scene but the per-frame constants
 	void Render() const;
 
 	int AddPipeline(GraphicsPipeline && pipeline);
@@ -36,10 +52,33 @@ public:
 
 	void SetClearColor(glm::vec3 const & color) { m_clear_color = color; }
 
+	int GetPipelineCount() const { return static_cast<int>(m_pipeline_containers.size()); }
+
+	// Called after every pipeline has drawn, to draw on top of the scene, e.g. the hud.
+	// Timed as one more pipeline, its index is GetPipelineCount()
+	void SetOverlayCallback(OverlayCallback callback) { m_overlay_callback = callback; }
+
+	// Objects whose bounding sphere is outside the frustum are skipped, nothing is culled until this is set
+	void SetViewProjTransform(glm::mat4 const & view_proj);
+
 private:
+	bool is_visible(RenderObject const & obj, Mesh const & mesh) const;
+
+private:
+	GraphicsApi & m_graphics_api; // non-const, the gpu timers it runs are part of its state
+
 	std::vector<PipelineContainer> m_pipeline_containers;
 
 	std::vector<Mesh> m_meshes; // TODO: need asset manager
 
 	glm::vec3 m_clear_color;
+
+	OverlayCallback m_overlay_callback;
+
+	std::optional<std::array<glm::vec4, 6>> m_frustum_planes; // normalized, pointing inwards
+
+	// the packet being submitted and the one being extracted for the next frame
+	static constexpr std::size_t m_packet_count = 2;
+	std::array<FramePacket, m_packet_count> m_packets;
+	std::size_t m_extracted_packet{ 0 };
 };
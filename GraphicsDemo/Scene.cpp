@@ -2,13 +2,17 @@
 
 module;
 
+#include <algorithm>
 #include <array>
 #include <filesystem>
 #include <iostream>
+#include <limits>
 #include <numbers>
-#include <stdexcept>
+#include <random>
+#include <string_view>
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 module Scene;
 
@@ -16,6 +20,8 @@ import GraphicsPipeline;
 import Mesh;
 import ObjLoader;
 import PipelineBuilder;
+import Profiler;
+import RenderPacket;
 import Vertex;
 
 namespace
@@ -35,18 +41,18 @@ namespace
 	public:
 		using VertexT = TextureVertex;
 
-		static AssetId<VertexT> Create(Renderer & renderer);
+		static AssetId<VertexT> Create(Renderer & renderer, float half_size = 30.0f);
 
 	private:
-		static Mesh create_ground_mesh();
+		static Mesh create_ground_mesh(float half_size);
 	};
 
-	auto GroundMesh::Create(Renderer & renderer)
+	auto GroundMesh::Create(Renderer & renderer, float half_size /*= 30.0f*/)
 		-> AssetId<VertexT>
 	{
 		AssetId<VertexT> id;
 
-		Mesh ground_mesh = create_ground_mesh();
+		Mesh ground_mesh = create_ground_mesh(half_size);
 		if (!ground_mesh.IsInitialized())
 		{
 			std::cout << "Failed to create GroundMesh" << std::endl;
@@ -57,9 +63,9 @@ namespace
 		return id;
 	}
 
-	Mesh GroundMesh::create_ground_mesh()
+	Mesh GroundMesh::create_ground_mesh(float half_size)
 	{
-		float scale = 30.0f;
+		float scale = half_size;
 
 		static_assert(std::same_as<VertexT, TextureVertex>);
 		std::vector<TextureVertex> verts{
@@ -79,7 +85,7 @@ namespace
 			1, 0, 2,
 			1, 2, 3 };
 
-		return Mesh{ verts, indices };
+		return Mesh{ verts, indices, "ground" };
 	}
 
 	class SkyboxMesh
@@ -136,7 +142,7 @@ namespace
 			1, 5, 2,
 			2, 5, 6 };
 
-		return Mesh{ verts, indices };
+		return Mesh{ verts, indices, "skybox" };
 	}
 
 	class FileMesh
@@ -185,9 +191,21 @@ namespace
 			return std::nullopt;
 		}
 
-		return Mesh{ verts, indices };
+		return Mesh{ verts, indices, file_path.filename().string() };
 	}
 
+	struct ModelTransformUniform
+	{
+		static constexpr std::string_view m_label = "model_transform";
+		static glm::mat4 const & FromDraw(DrawPacket const & draw) { return draw.m_model_transform; }
+	};
+
+	struct ObjectColorUniform
+	{
+		static constexpr std::string_view m_label = "object_color";
+		static glm::vec3 const & FromDraw(DrawPacket const & draw) { return draw.m_color; }
+	};
+
 	class TexturePipeline
 	{
 	public:
@@ -235,34 +253,31 @@ namespace
 		builder.SetPerFrameConstantsCallback(
 			[&scene](GraphicsPipeline const & pipeline)
 			{
-				pipeline.SetUniform("view_transform", scene.GetCamera().GetViewTransform());
-				pipeline.SetUniform("proj_transform", scene.GetCamera().GetProjTransform());
-
-				pipeline.SetUniform("ambient_light_color", scene.GetAmbientLight().m_color);
-				pipeline.SetUniform("pointlight_1.pos", scene.GetPointLight1().m_pos);
-				pipeline.SetUniform("pointlight_1.color", scene.GetPointLight1().m_color);
-				pipeline.SetUniform("pointlight_1.radius", scene.GetPointLight1().m_radius);
-				pipeline.SetUniform("pointlight_2.pos", scene.GetPointLight2().m_pos);
-				pipeline.SetUniform("pointlight_2.color", scene.GetPointLight2().m_color);
-				pipeline.SetUniform("pointlight_2.radius", scene.GetPointLight2().m_radius);
-				pipeline.SetUniform("pointlight_3.pos", scene.GetPointLight3().m_pos);
-				pipeline.SetUniform("pointlight_3.color", scene.GetPointLight3().m_color);
-				pipeline.SetUniform("pointlight_3.radius", scene.GetPointLight3().m_radius);
-				pipeline.SetUniform("spotlight_1.pos", scene.GetSpotLight().m_pos);
-				pipeline.SetUniform("spotlight_1.dir", scene.GetSpotLight().m_dir);
-				pipeline.SetUniform("spotlight_1.color", scene.GetSpotLight().m_color);
-				pipeline.SetUniform("spotlight_1.inner_radius", scene.GetSpotLight().m_inner_radius);
-				pipeline.SetUniform("spotlight_1.outer_radius", scene.GetSpotLight().m_outer_radius);
-			});
-		builder.SetPerObjectConstantsCallback(
-			[&scene](GraphicsPipeline const & pipeline, RenderObject const & obj)
-			{
-				pipeline.SetUniform("model_transform", obj.GetModelTransform());
-
-				int tex_id = obj.GetTextureId();
-				if (tex_id != -1)
-					scene.GetTexture(tex_id).Bind();
+				VersionedBlock<CameraConstants> const & camera = scene.GetCameraConstants();
+				pipeline.SetUniform("view_transform", camera.Get().m_view, camera.GetVersion());
+				pipeline.SetUniform("proj_transform", camera.Get().m_proj, camera.GetVersion());
+
+				VersionedBlock<AmbientLight> const & ambient_light = scene.GetAmbientLight();
+				pipeline.SetUniform("ambient_light_color", ambient_light.Get().m_color, ambient_light.GetVersion());
+				VersionedBlock<std::array<PointLight, 3>> const & pointlights = scene.GetPointLights();
+				pipeline.SetUniform("pointlight_1.pos", pointlights.Get()[0].m_pos, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_1.color", pointlights.Get()[0].m_color, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_1.radius", pointlights.Get()[0].m_radius, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_2.pos", pointlights.Get()[1].m_pos, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_2.color", pointlights.Get()[1].m_color, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_2.radius", pointlights.Get()[1].m_radius, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_3.pos", pointlights.Get()[2].m_pos, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_3.color", pointlights.Get()[2].m_color, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_3.radius", pointlights.Get()[2].m_radius, pointlights.GetVersion());
+				VersionedBlock<SpotLight> const & spotlight = scene.GetSpotLight();
+				pipeline.SetUniform("spotlight_1.pos", spotlight.Get().m_pos, spotlight.GetVersion());
+				pipeline.SetUniform("spotlight_1.dir", spotlight.Get().m_dir, spotlight.GetVersion());
+				pipeline.SetUniform("spotlight_1.color", spotlight.Get().m_color, spotlight.GetVersion());
+				pipeline.SetUniform("spotlight_1.inner_radius", spotlight.Get().m_inner_radius, spotlight.GetVersion());
+				pipeline.SetUniform("spotlight_1.outer_radius", spotlight.Get().m_outer_radius, spotlight.GetVersion());
 			});
+		builder.SetPerObjectUniformTypes<ModelTransformUniform>();
+		builder.SetTextures(scene.GetTextures());
 
 		return builder.CreatePipeline();
 	}
@@ -314,32 +329,32 @@ namespace
 		builder.SetPerFrameConstantsCallback(
 			[&scene](GraphicsPipeline const & pipeline)
 			{
-				pipeline.SetUniform("view_transform", scene.GetCamera().GetViewTransform());
-				pipeline.SetUniform("proj_transform", scene.GetCamera().GetProjTransform());
-
-				pipeline.SetUniform("ambient_light_color", scene.GetAmbientLight().m_color);
-				pipeline.SetUniform("pointlight_1.pos", scene.GetPointLight1().m_pos);
-				pipeline.SetUniform("pointlight_1.color", scene.GetPointLight1().m_color);
-				pipeline.SetUniform("pointlight_1.radius", scene.GetPointLight1().m_radius);
-				pipeline.SetUniform("pointlight_2.pos", scene.GetPointLight2().m_pos);
-				pipeline.SetUniform("pointlight_2.color", scene.GetPointLight2().m_color);
-				pipeline.SetUniform("pointlight_2.radius", scene.GetPointLight2().m_radius);
-				pipeline.SetUniform("pointlight_3.pos", scene.GetPointLight3().m_pos);
-				pipeline.SetUniform("pointlight_3.color", scene.GetPointLight3().m_color);
-				pipeline.SetUniform("pointlight_3.radius", scene.GetPointLight3().m_radius);
-				pipeline.SetUniform("spotlight_1.pos", scene.GetSpotLight().m_pos);
-				pipeline.SetUniform("spotlight_1.dir", scene.GetSpotLight().m_dir);
-				pipeline.SetUniform("spotlight_1.color", scene.GetSpotLight().m_color);
-				pipeline.SetUniform("spotlight_1.inner_radius", scene.GetSpotLight().m_inner_radius);
-				pipeline.SetUniform("spotlight_1.outer_radius", scene.GetSpotLight().m_outer_radius);
-
-				pipeline.SetUniform("camera_pos_world", scene.GetCamera().GetPos());
-			});
-		builder.SetPerObjectConstantsCallback(
-			[](GraphicsPipeline const & pipeline, RenderObject const & obj)
-			{
-				pipeline.SetUniform("model_transform", obj.GetModelTransform());
+				VersionedBlock<CameraConstants> const & camera = scene.GetCameraConstants();
+				pipeline.SetUniform("view_transform", camera.Get().m_view, camera.GetVersion());
+				pipeline.SetUniform("proj_transform", camera.Get().m_proj, camera.GetVersion());
+
+				VersionedBlock<AmbientLight> const & ambient_light = scene.GetAmbientLight();
+				pipeline.SetUniform("ambient_light_color", ambient_light.Get().m_color, ambient_light.GetVersion());
+				VersionedBlock<std::array<PointLight, 3>> const & pointlights = scene.GetPointLights();
+				pipeline.SetUniform("pointlight_1.pos", pointlights.Get()[0].m_pos, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_1.color", pointlights.Get()[0].m_color, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_1.radius", pointlights.Get()[0].m_radius, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_2.pos", pointlights.Get()[1].m_pos, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_2.color", pointlights.Get()[1].m_color, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_2.radius", pointlights.Get()[1].m_radius, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_3.pos", pointlights.Get()[2].m_pos, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_3.color", pointlights.Get()[2].m_color, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_3.radius", pointlights.Get()[2].m_radius, pointlights.GetVersion());
+				VersionedBlock<SpotLight> const & spotlight = scene.GetSpotLight();
+				pipeline.SetUniform("spotlight_1.pos", spotlight.Get().m_pos, spotlight.GetVersion());
+				pipeline.SetUniform("spotlight_1.dir", spotlight.Get().m_dir, spotlight.GetVersion());
+				pipeline.SetUniform("spotlight_1.color", spotlight.Get().m_color, spotlight.GetVersion());
+				pipeline.SetUniform("spotlight_1.inner_radius", spotlight.Get().m_inner_radius, spotlight.GetVersion());
+				pipeline.SetUniform("spotlight_1.outer_radius", spotlight.Get().m_outer_radius, spotlight.GetVersion());
+
+				pipeline.SetUniform("camera_pos_world", camera.Get().m_pos, camera.GetVersion());
 			});
+		builder.SetPerObjectUniformTypes<ModelTransformUniform>();
 
 		return builder.CreatePipeline();
 	}
@@ -396,8 +411,9 @@ namespace
 		builder.SetPerFrameConstantsCallback(
 			[&scene](GraphicsPipeline const & pipeline)
 			{
-				pipeline.SetUniform("view_transform", scene.GetCamera().GetViewTransform());
-				pipeline.SetUniform("proj_transform", scene.GetCamera().GetProjTransform());
+				VersionedBlock<CameraConstants> const & camera = scene.GetCameraConstants();
+				pipeline.SetUniform("view_transform", camera.Get().m_view, camera.GetVersion());
+				pipeline.SetUniform("proj_transform", camera.Get().m_proj, camera.GetVersion());
 			});
 
 		return builder.CreatePipeline();
@@ -450,30 +466,30 @@ namespace
 		builder.SetPerFrameConstantsCallback(
 			[&scene](GraphicsPipeline const & pipeline)
 			{
-				pipeline.SetUniform("view_transform", scene.GetCamera().GetViewTransform());
-				pipeline.SetUniform("proj_transform", scene.GetCamera().GetProjTransform());
-
-				pipeline.SetUniform("ambient_light_color", scene.GetAmbientLight().m_color);
-				pipeline.SetUniform("pointlight_1.pos", scene.GetPointLight1().m_pos);
-				pipeline.SetUniform("pointlight_1.color", scene.GetPointLight1().m_color);
-				pipeline.SetUniform("pointlight_1.radius", scene.GetPointLight1().m_radius);
-				pipeline.SetUniform("pointlight_2.pos", scene.GetPointLight2().m_pos);
-				pipeline.SetUniform("pointlight_2.color", scene.GetPointLight2().m_color);
-				pipeline.SetUniform("pointlight_2.radius", scene.GetPointLight2().m_radius);
-				pipeline.SetUniform("pointlight_3.pos", scene.GetPointLight3().m_pos);
-				pipeline.SetUniform("pointlight_3.color", scene.GetPointLight3().m_color);
-				pipeline.SetUniform("pointlight_3.radius", scene.GetPointLight3().m_radius);
-				pipeline.SetUniform("spotlight_1.pos", scene.GetSpotLight().m_pos);
-				pipeline.SetUniform("spotlight_1.dir", scene.GetSpotLight().m_dir);
-				pipeline.SetUniform("spotlight_1.color", scene.GetSpotLight().m_color);
-				pipeline.SetUniform("spotlight_1.inner_radius", scene.GetSpotLight().m_inner_radius);
-				pipeline.SetUniform("spotlight_1.outer_radius", scene.GetSpotLight().m_outer_radius);
-			});
-		builder.SetPerObjectConstantsCallback(
-			[](GraphicsPipeline const & pipeline, RenderObject const & obj)
-			{
-				pipeline.SetUniform("model_transform", obj.GetModelTransform());
+				VersionedBlock<CameraConstants> const & camera = scene.GetCameraConstants();
+				pipeline.SetUniform("view_transform", camera.Get().m_view, camera.GetVersion());
+				pipeline.SetUniform("proj_transform", camera.Get().m_proj, camera.GetVersion());
+
+				VersionedBlock<AmbientLight> const & ambient_light = scene.GetAmbientLight();
+				pipeline.SetUniform("ambient_light_color", ambient_light.Get().m_color, ambient_light.GetVersion());
+				VersionedBlock<std::array<PointLight, 3>> const & pointlights = scene.GetPointLights();
+				pipeline.SetUniform("pointlight_1.pos", pointlights.Get()[0].m_pos, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_1.color", pointlights.Get()[0].m_color, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_1.radius", pointlights.Get()[0].m_radius, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_2.pos", pointlights.Get()[1].m_pos, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_2.color", pointlights.Get()[1].m_color, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_2.radius", pointlights.Get()[1].m_radius, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_3.pos", pointlights.Get()[2].m_pos, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_3.color", pointlights.Get()[2].m_color, pointlights.GetVersion());
+				pipeline.SetUniform("pointlight_3.radius", pointlights.Get()[2].m_radius, pointlights.GetVersion());
+				VersionedBlock<SpotLight> const & spotlight = scene.GetSpotLight();
+				pipeline.SetUniform("spotlight_1.pos", spotlight.Get().m_pos, spotlight.GetVersion());
+				pipeline.SetUniform("spotlight_1.dir", spotlight.Get().m_dir, spotlight.GetVersion());
+				pipeline.SetUniform("spotlight_1.color", spotlight.Get().m_color, spotlight.GetVersion());
+				pipeline.SetUniform("spotlight_1.inner_radius", spotlight.Get().m_inner_radius, spotlight.GetVersion());
+				pipeline.SetUniform("spotlight_1.outer_radius", spotlight.Get().m_outer_radius, spotlight.GetVersion());
 			});
+		builder.SetPerObjectUniformTypes<ModelTransformUniform>();
 
 		return builder.CreatePipeline();
 	}
@@ -525,18 +541,13 @@ namespace
 		builder.SetPerFrameConstantsCallback(
 			[&scene](GraphicsPipeline const & pipeline)
 			{
-				pipeline.SetUniform("view_transform", scene.GetCamera().GetViewTransform());
-				pipeline.SetUniform("proj_transform", scene.GetCamera().GetProjTransform());
+				VersionedBlock<CameraConstants> const & camera = scene.GetCameraConstants();
+				pipeline.SetUniform("view_transform", camera.Get().m_view, camera.GetVersion());
+				pipeline.SetUniform("proj_transform", camera.Get().m_proj, camera.GetVersion());
 
-				pipeline.SetUniform("camera_pos_world", scene.GetCamera().GetPos());
-			});
-		builder.SetPerObjectConstantsCallback(
-			[](GraphicsPipeline const & pipeline, RenderObject const & obj)
-			{
-				pipeline.SetUniform("model_transform", obj.GetModelTransform());
-
-				pipeline.SetUniform("object_color", obj.GetColor());
+				pipeline.SetUniform("camera_pos_world", camera.Get().m_pos, camera.GetVersion());
 			});
+		builder.SetPerObjectUniformTypes<ModelTransformUniform, ObjectColorUniform>();
 
 		return builder.CreatePipeline();
 	}
@@ -603,10 +614,102 @@ namespace
 	{
 		transform = glm::rotate(glm::mat4(1.0), delta_time * 0.5f, glm::vec3(0.0, 0.0, 1.0)) * transform;
 	}
+
+	float random_float(std::mt19937 & rng, float min, float max)
+	{
+		return std::uniform_real_distribution<float>{ min, max }(rng);
+	}
+
+	struct StressPlacement
+	{
+		float m_extent{ 0.0f }; // objects are placed within [-extent, extent] on the X and Y axes
+		float m_min_height{ 0.0f };
+		float m_max_height{ 0.0f };
+		float m_min_scale{ 1.0f };
+		float m_max_scale{ 1.0f };
+		bool m_y_up_mesh{ false };
+	};
+
+	template <typename MeshAssetId, typename PipelineAssetId>
+		requires AssetsAreCompatible<MeshAssetId, PipelineAssetId>
+	void add_stress_objects(
+		Renderer & renderer,
+		std::string const & name,
+		int count,
+		MeshAssetId mesh_id,
+		std::vector<PipelineAssetId> const & pipeline_ids,
+		int tex_id,
+		StressPlacement const & placement,
+		std::mt19937 & rng,
+		std::vector<StressObject> & out_objects)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			// spread the objects over the pipeline copies so every copy is bound each frame
+			PipelineAssetId pipeline_id = pipeline_ids[i % pipeline_ids.size()];
+
+			StressObject stress_obj{
+				.m_obj = create_render_object(renderer, name, mesh_id, pipeline_id, tex_id),
+				.m_pos{
+					random_float(rng, -placement.m_extent, placement.m_extent),
+					random_float(rng, -placement.m_extent, placement.m_extent),
+					random_float(rng, placement.m_min_height, placement.m_max_height) },
+				.m_spin_speed = random_float(rng, -1.0f, 1.0f),
+				.m_bob_phase = random_float(rng, 0.0f, 2.0f * std::numbers::pi_v<float>)
+			};
+			if (!stress_obj.m_obj)
+				return;
+
+			float const scale = random_float(rng, placement.m_min_scale, placement.m_max_scale);
+			stress_obj.m_base_transform = glm::scale(glm::mat4(1.0), glm::vec3(scale));
+
+			// same correction as the demo objects for meshes designed with the Y axis up
+			if (placement.m_y_up_mesh)
+				stress_obj.m_base_transform = glm::rotate(glm::mat4(1.0), std::numbers::pi_v<float> / 2.0f, glm::vec3(1.0, 0.0, 0.0)) * stress_obj.m_base_transform;
+
+			out_objects.push_back(std::move(stress_obj));
+		}
+	}
+
+	// Translation and scale are blended linearly and the rotation is slerped, blending the matrices themselves would
+	// shrink a spinning object halfway between two snapshots
+	glm::mat4 interpolate_transform(glm::mat4 const & from, glm::mat4 const & to, float alpha)
+	{
+		if (alpha >= 1.0f)
+			return to;
+
+		glm::vec3 const from_scale{ glm::length(glm::vec3(from[0])), glm::length(glm::vec3(from[1])), glm::length(glm::vec3(from[2])) };
+		glm::vec3 const to_scale{ glm::length(glm::vec3(to[0])), glm::length(glm::vec3(to[1])), glm::length(glm::vec3(to[2])) };
+		glm::quat const from_rot = glm::quat_cast(glm::mat3(glm::vec3(from[0]) / from_scale.x, glm::vec3(from[1]) / from_scale.y, glm::vec3(from[2]) / from_scale.z));
+		glm::quat const to_rot = glm::quat_cast(glm::mat3(glm::vec3(to[0]) / to_scale.x, glm::vec3(to[1]) / to_scale.y, glm::vec3(to[2]) / to_scale.z));
+
+		glm::vec3 const scale = glm::mix(from_scale, to_scale, alpha);
+		glm::mat4 transform = glm::mat4_cast(glm::slerp(from_rot, to_rot, alpha));
+		transform[0] *= scale.x;
+		transform[1] *= scale.y;
+		transform[2] *= scale.z;
+		transform[3] = glm::mix(from[3], to[3], alpha);
+		return transform;
+	}
+
+	// The stress scene may give a slot to another light between two snapshots, that one pops in where it is
+	constexpr double g_max_camera_prediction = 0.1; // seconds past the latest snapshot, in case the simulation stalls
+
+	PointLight interpolate_light(PointLight const & from, PointLight const & to, float alpha)
+	{
+		if (from.m_color != to.m_color || from.m_radius != to.m_radius)
+			return to;
+
+		PointLight light = to;
+		light.m_pos = glm::mix(from.m_pos, to.m_pos, alpha);
+		return light;
+	}
 }
 
-void Scene::Init()
+void Scene::Init(std::optional<StressSceneOptions> const & stress_options /*= std::nullopt*/)
 {
+	m_changes.m_assets = true;
+
 	const std::filesystem::path resources_path = std::filesystem::path("..") / "resources";
 	const std::filesystem::path shaders_path = "shaders";
 
@@ -623,6 +726,13 @@ void Scene::Init()
 		resources_path / "textures" / "skybox" / "back.jpg"
 	});
 
+	if (stress_options.has_value())
+	{
+		init_stress_scene(stress_options.value(), resources_path, shaders_path, ground_tex_id, skybox_tex_id);
+		init_simulation();
+		return;
+	}
+
 	AssetId<TexturePipeline::VertexT> texture_pipeline_id = TexturePipeline::Create(m_renderer, *this, shaders_path);
 	AssetId<LightSourcePipeline::VertexT> light_source_pipeline_id = LightSourcePipeline::Create(m_renderer, *this, shaders_path);
 	AssetId<ReflectionPipeline::VertexT> reflection_pipeline_id = ReflectionPipeline::Create(m_renderer, *this, shaders_path);
@@ -647,6 +757,7 @@ void Scene::Init()
 	m_blue_gem = create_render_object(m_renderer, "blue gem", blue_gem_mesh_id, light_source_pipeline_id);
 	m_ground = create_render_object(m_renderer, "ground", ground_mesh_id, texture_pipeline_id, ground_tex_id);
 	m_skybox = create_render_object(m_renderer, "skybox", skybox_mesh_id, skybox_pipeline_id, skybox_tex_id);
+	m_skybox->SetCullable(false); // drawn around the camera, its bounds mean nothing
 
 	m_red_gem->SetColor({ 1.0, 0.0, 0.0 });
 	m_green_gem->SetColor({ 0.0, 1.0, 0.0 });
@@ -658,72 +769,330 @@ void Scene::Init()
 	init_gem_transform(1, m_green_gem->ModifyModelTransform());
 	init_gem_transform(2, m_blue_gem->ModifyModelTransform());
 
-	m_ambient_light = AmbientLight{ glm::vec3{ 0.5, 0.5, 0.5 } };
+	m_ambient_light.Set(AmbientLight{ glm::vec3{ 0.5, 0.5, 0.5 } });
 
-	m_spotlight = SpotLight{
+	m_spotlight.Set(SpotLight{
 		.m_pos{ 0.0f, 0.0f, 25.0f },
 		.m_dir{ 0.0f, 0.0f, -1.0f },
 		.m_color{ 1.0f, 1.0f, 1.0f },
 		.m_inner_radius{ 0.988f },
 		.m_outer_radius{ 0.986f }
-	};
+	});
 
 	glm::vec3 camera_pos{ 0.0f, -10.0f, 5.0f };
 	glm::vec3 camera_dir = glm::normalize(glm::vec3{ 0.0f, 0.0f, 2.5f } - camera_pos);
 	m_camera.Init(camera_pos, camera_dir);
+	update_camera_constants();
+
+	init_simulation();
 }
 
-void Scene::OnViewportResized(int width, int height)
+void Scene::init_stress_scene(
+	StressSceneOptions const & options,
+	std::filesystem::path const & resources_path,
+	std::filesystem::path const & shaders_path,
+	int ground_tex_id,
+	int skybox_tex_id)
 {
-	m_camera.OnViewportResized(width, height);
+	m_is_stress_scene = true;
+
+	std::vector<AssetId<TexturePipeline::VertexT>> texture_pipeline_ids;
+	std::vector<AssetId<LightSourcePipeline::VertexT>> light_source_pipeline_ids;
+	std::vector<AssetId<ReflectionPipeline::VertexT>> reflection_pipeline_ids;
+	for (int i = 0; i < options.m_pipeline_copies; ++i)
+	{
+		texture_pipeline_ids.push_back(TexturePipeline::Create(m_renderer, *this, shaders_path));
+		light_source_pipeline_ids.push_back(LightSourcePipeline::Create(m_renderer, *this, shaders_path));
+		reflection_pipeline_ids.push_back(ReflectionPipeline::Create(m_renderer, *this, shaders_path));
+	}
+	AssetId<SkyboxPipeline::VertexT> skybox_pipeline_id = SkyboxPipeline::Create(m_renderer, *this, shaders_path);
+
+	// keep the density roughly constant as the object count grows
+	int const object_count = options.m_sword_count + options.m_gem_count + options.m_quad_count;
+	float const extent = std::max(15.0f, std::sqrt(static_cast<float>(object_count)));
+
+	AssetId<FileMesh::VertexT> sword_mesh_id = FileMesh::Create(m_renderer,
+		resources_path / "objects" / "skullsword.obj");
+	std::array<AssetId<FileMesh::VertexT>, 3> gem_mesh_ids{
+		FileMesh::Create(m_renderer, resources_path / "objects" / "redgem.obj"),
+		FileMesh::Create(m_renderer, resources_path / "objects" / "greengem.obj"),
+		FileMesh::Create(m_renderer, resources_path / "objects" / "bluegem.obj")
+	};
+	AssetId<GroundMesh::VertexT> quad_mesh_id = GroundMesh::Create(m_renderer, 0.5f /*half_size*/);
+	AssetId<GroundMesh::VertexT> ground_mesh_id = GroundMesh::Create(m_renderer, std::max(30.0f, extent));
+	AssetId<SkyboxMesh::VertexT> skybox_mesh_id = SkyboxMesh::Create(m_renderer);
+
+	std::mt19937 rng{ options.m_seed };
+	m_stress_objects.reserve(object_count);
+
+	add_stress_objects(m_renderer, "stress sword", options.m_sword_count, sword_mesh_id, reflection_pipeline_ids, skybox_tex_id,
+		StressPlacement{ .m_extent = extent, .m_min_height = 2.0f, .m_max_height = 5.0f, .m_min_scale = 0.3f, .m_max_scale = 1.0f, .m_y_up_mesh = true },
+		rng, m_stress_objects);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		int const gem_count = options.m_gem_count / 3 + (i < options.m_gem_count % 3 ? 1 : 0);
+		size_t const first_gem = m_stress_objects.size();
+		add_stress_objects(m_renderer, "stress gem", gem_count, gem_mesh_ids[i], light_source_pipeline_ids, -1 /*tex_id*/,
+			StressPlacement{ .m_extent = extent, .m_min_height = 0.5f, .m_max_height = 4.0f, .m_min_scale = 0.5f, .m_max_scale = 1.5f, .m_y_up_mesh = true },
+			rng, m_stress_objects);
+
+		for (size_t j = first_gem; j < m_stress_objects.size(); ++j)
+			m_stress_objects[j].m_obj->SetColor({ random_float(rng, 0.0f, 1.0f), random_float(rng, 0.0f, 1.0f), random_float(rng, 0.0f, 1.0f) });
+	}
+
+	add_stress_objects(m_renderer, "stress quad", options.m_quad_count, quad_mesh_id, texture_pipeline_ids, ground_tex_id,
+		StressPlacement{ .m_extent = extent, .m_min_height = 0.1f, .m_max_height = 3.0f, .m_min_scale = 0.5f, .m_max_scale = 2.0f },
+		rng, m_stress_objects);
+
+	m_ground = create_render_object(m_renderer, "ground", ground_mesh_id, texture_pipeline_ids[0], ground_tex_id);
+	m_skybox = create_render_object(m_renderer, "skybox", skybox_mesh_id, skybox_pipeline_id, skybox_tex_id);
+	m_skybox->SetCullable(false); // drawn around the camera, its bounds mean nothing
+
+	m_stress_lights.reserve(options.m_light_count);
+	for (int i = 0; i < options.m_light_count; ++i)
+	{
+		m_stress_lights.push_back(StressLight{
+			.m_orbit_center{ random_float(rng, -extent, extent), random_float(rng, -extent, extent), random_float(rng, 1.0f, 5.0f) },
+			.m_orbit_radius = random_float(rng, 1.0f, 5.0f),
+			.m_orbit_speed = random_float(rng, -1.0f, 1.0f),
+			.m_orbit_phase = random_float(rng, 0.0f, 2.0f * std::numbers::pi_v<float>),
+			.m_light{
+				.m_color{ random_float(rng, 0.0f, 1.0f), random_float(rng, 0.0f, 1.0f), random_float(rng, 0.0f, 1.0f) },
+				.m_radius{ random_float(rng, 5.0f, 20.0f) } }
+			});
+	}
+
+	m_ambient_light.Set(AmbientLight{ glm::vec3{ 0.5, 0.5, 0.5 } });
+
+	m_spotlight.Set(SpotLight{
+		.m_pos{ 0.0f, 0.0f, 25.0f },
+		.m_dir{ 0.0f, 0.0f, -1.0f },
+		.m_color{ 1.0f, 1.0f, 1.0f },
+		.m_inner_radius{ 0.988f },
+		.m_outer_radius{ 0.986f }
+	});
+
+	glm::vec3 camera_pos{ 0.0f, -extent, 5.0f + extent * 0.5f };
+	glm::vec3 camera_dir = glm::normalize(glm::vec3{ 0.0f, 0.0f, 0.0f } - camera_pos);
+	m_camera.Init(camera_pos, camera_dir);
+	update_camera_constants();
+
+	std::cout << "Stress scene: " << m_stress_objects.size() << " objects, " << m_stress_lights.size() << " lights, "
+		<< options.m_pipeline_copies << " copies of each pipeline" << std::endl;
 }
 
-void Scene::Update(double delta_time, Input const & input)
+void Scene::init_simulation()
 {
-	const float dt = static_cast<float>(delta_time);
-	m_timer += dt;
-
-	m_camera.Update(delta_time, input);
+	if (m_is_stress_scene)
+	{
+		for (StressObject const & stress_obj : m_stress_objects)
+			m_animated_objects.push_back(stress_obj.m_obj);
+	}
+	else
+	{
+		m_animated_objects = { m_sword0, m_sword1, m_red_gem, m_green_gem, m_blue_gem };
+	}
 
-	glm::vec3 bg_color;
-	bg_color.r = std::sin(m_timer) / 2.0f + 0.5f;
-	bg_color.g = std::cos(m_timer) / 2.0f + 0.5f;
-	bg_color.b = std::tan(m_timer) / 2.0f + 0.5f;
-	m_renderer.SetClearColor(bg_color);
+	// the simulation starts from the initial transforms and keeps its own copy from then on
+	m_sim_transforms.clear();
+	for (std::shared_ptr<RenderObject> const & obj : m_animated_objects)
+		m_sim_transforms.push_back(obj->GetModelTransform());
 
-	update_sword_transform(0, m_sword0->ModifyModelTransform(), m_timer, dt);
-	update_sword_transform(1, m_sword1->ModifyModelTransform(), m_timer, dt);
-	update_gem_transform(m_red_gem->ModifyModelTransform(), dt);
-	update_gem_transform(m_green_gem->ModifyModelTransform(), dt);
-	update_gem_transform(m_blue_gem->ModifyModelTransform(), dt);
+	m_sim_camera = m_camera;
+}
 
-	glm::mat4 const & red_gem_transform = m_red_gem->GetModelTransform();
-	m_pointlight_1 = PointLight{
+void Scene::simulate_demo_scene(float delta_time, std::array<PointLight, 3> & out_pointlights)
+{
+	// in the order of m_animated_objects
+	glm::mat4 & red_gem_transform = m_sim_transforms[2];
+	glm::mat4 & green_gem_transform = m_sim_transforms[3];
+	glm::mat4 & blue_gem_transform = m_sim_transforms[4];
+
+	update_sword_transform(0, m_sim_transforms[0], m_timer, delta_time);
+	update_sword_transform(1, m_sim_transforms[1], m_timer, delta_time);
+	update_gem_transform(red_gem_transform, delta_time);
+	update_gem_transform(green_gem_transform, delta_time);
+	update_gem_transform(blue_gem_transform, delta_time);
+
+	out_pointlights[0] = PointLight{
 		.m_pos{ red_gem_transform[3][0], red_gem_transform[3][1], red_gem_transform[3][2] },
 		.m_color{ 1.0, 0.0, 0.0 },
 		.m_radius{ 20.0f } };
 
-	glm::mat4 const & green_gem_transform = m_green_gem->GetModelTransform();
-	m_pointlight_2 = PointLight{
+	out_pointlights[1] = PointLight{
 		.m_pos{ green_gem_transform[3][0], green_gem_transform[3][1], green_gem_transform[3][2] },
 		.m_color{ 0.0, 1.0, 0.0 },
 		.m_radius{ 20.0f } };
 
-	glm::mat4 const & blue_gem_transform = m_blue_gem->GetModelTransform();
-	m_pointlight_3 = PointLight{
+	out_pointlights[2] = PointLight{
 		.m_pos{ blue_gem_transform[3][0], blue_gem_transform[3][1], blue_gem_transform[3][2] },
 		.m_color{ 0.0, 0.0, 1.0 },
 		.m_radius{ 20.0f } };
 }
 
-void Scene::Render() const
+void Scene::simulate_stress_scene(std::array<PointLight, 3> & out_pointlights)
 {
-	m_renderer.Render();
+	for (size_t i = 0; i < m_stress_objects.size(); ++i)
+	{
+		StressObject const & stress_obj = m_stress_objects[i];
+		glm::vec3 pos = stress_obj.m_pos;
+		pos.z += std::sin(m_timer + stress_obj.m_bob_phase) * 0.25f;
+
+		m_sim_transforms[i] = glm::translate(glm::mat4(1.0), pos)
+			* glm::rotate(glm::mat4(1.0), m_timer * stress_obj.m_spin_speed, glm::vec3(0.0, 0.0, 1.0))
+			* stress_obj.m_base_transform;
+	}
+
+	// The shaders only take three point lights, so the ones nearest the camera are picked each step
+	std::array<float, 3> nearest_distances;
+	nearest_distances.fill(std::numeric_limits<float>::max());
+	// unused slots stay black, with a radius the shaders can divide by
+	out_pointlights.fill(PointLight{ .m_color{ 0.0, 0.0, 0.0 }, .m_radius{ 1.0f } });
+
+	glm::vec3 const camera_pos = m_sim_camera.GetPos();
+	for (StressLight & stress_light : m_stress_lights)
+	{
+		float const angle = m_timer * stress_light.m_orbit_speed + stress_light.m_orbit_phase;
+		stress_light.m_light.m_pos = stress_light.m_orbit_center
+			+ glm::vec3{ std::cos(angle), std::sin(angle), 0.0f } * stress_light.m_orbit_radius;
+
+		glm::vec3 const offset = stress_light.m_light.m_pos - camera_pos;
+		float distance = glm::dot(offset, offset);
+		PointLight light = stress_light.m_light;
+		for (size_t i = 0; i < out_pointlights.size(); ++i)
+		{
+			if (distance < nearest_distances[i])
+			{
+				std::swap(distance, nearest_distances[i]);
+				std::swap(light, out_pointlights[i]);
+			}
+		}
+	}
 }
 
-Texture const & Scene::GetTexture(int id) const
+void Scene::update_camera_constants()
 {
-	if (id < 0 || id >= static_cast<int>(m_textures.size()))
-		throw std::out_of_range("Invalid texture ID");
-	return m_textures[id];
+	m_camera_constants.Set(CameraConstants{
+		.m_view = m_camera.GetViewTransform(),
+		.m_proj = m_camera.GetProjTransform(),
+		.m_pos = m_camera.GetPos()
+	});
+}
+
+void Scene::OnViewportResized(int width, int height)
+{
+	m_camera.OnViewportResized(width, height);
+	update_camera_constants();
+	m_changes.m_viewport = true;
+}
+
+SceneChanges Scene::Simulate(double step_time, double delta_time, Input const & input)
+{
+	ProfileZone zone{ "Scene::Simulate" };
+
+	// toggled on the step the key goes down, the camera still moves while paused
+	bool const pause_key_down = input.KeyIsPressed('P');
+	if (pause_key_down && !m_pause_key_down)
+		m_animation_paused = !m_animation_paused;
+	m_pause_key_down = pause_key_down;
+
+	const float dt = m_animation_paused ? 0.0f : static_cast<float>(delta_time);
+	m_timer += dt;
+
+	glm::vec3 const camera_pos = m_sim_camera.GetPos();
+	glm::vec3 const camera_dir = m_sim_camera.GetDir();
+	m_sim_camera.Update(delta_time, input);
+
+	SceneSnapshot & snapshot = m_snapshots.BeginWrite();
+	snapshot.m_time = step_time;
+	snapshot.m_camera_pos = m_sim_camera.GetPos();
+	snapshot.m_camera_dir = m_sim_camera.GetDir();
+
+	snapshot.m_clear_color.r = std::sin(m_timer) / 2.0f + 0.5f;
+	snapshot.m_clear_color.g = std::cos(m_timer) / 2.0f + 0.5f;
+	snapshot.m_clear_color.b = std::tan(m_timer) / 2.0f + 0.5f;
+
+	if (m_is_stress_scene)
+		simulate_stress_scene(snapshot.m_pointlights);
+	else
+		simulate_demo_scene(dt, snapshot.m_pointlights);
+
+	snapshot.m_transforms = m_sim_transforms; // reuses the slot's storage once it has grown
+
+	// everything animated moves with the timer, so only the camera is worth comparing
+	snapshot.m_changes = SceneChanges{
+		.m_camera = m_sim_camera.GetPos() != camera_pos || m_sim_camera.GetDir() != camera_dir,
+		.m_transforms = !m_animation_paused && !m_sim_transforms.empty(),
+		.m_lights = !m_animation_paused
+	};
+	SceneChanges const changes = snapshot.m_changes;
+	m_snapshots.Publish();
+	return changes;
+}
+
+void Scene::Interpolate(double render_time)
+{
+	ProfileZone zone{ "Scene::Interpolate" };
+
+	auto [previous, latest] = m_snapshots.AcquireLatest();
+	if (latest == nullptr)
+		return; // nothing simulated yet, the objects are still where Init() put them
+	if (previous == nullptr)
+		previous = latest;
+
+	float alpha = 1.0f;
+	if (latest->m_time > previous->m_time)
+		alpha = static_cast<float>(std::clamp((render_time - previous->m_time) / (latest->m_time - previous->m_time), 0.0, 1.0));
+
+	m_changes |= latest->m_changes;
+	m_changes |= m_latest_changes; // the last frame may have stopped in between, this one ends where it settled
+	m_latest_changes = latest->m_changes;
+
+	for (size_t i = 0; i < m_animated_objects.size(); ++i)
+		m_animated_objects[i]->SetModelTransform(interpolate_transform(previous->m_transforms[i], latest->m_transforms[i], alpha));
+
+	m_camera.Init(
+		glm::mix(previous->m_camera_pos, latest->m_camera_pos, alpha),
+		glm::normalize(glm::mix(previous->m_camera_dir, latest->m_camera_dir, alpha)));
+	m_renderer.SetViewProjTransform(m_camera.GetProjTransform() * m_camera.GetViewTransform());
+	update_camera_constants();
+	m_renderer.SetClearColor(glm::mix(previous->m_clear_color, latest->m_clear_color, alpha));
+
+	// the same values again once the animation stopped, which keeps the version and skips the uploads
+	m_pointlights.Set({
+		interpolate_light(previous->m_pointlights[0], latest->m_pointlights[0], alpha),
+		interpolate_light(previous->m_pointlights[1], latest->m_pointlights[1], alpha),
+		interpolate_light(previous->m_pointlights[2], latest->m_pointlights[2], alpha)
+	});
+}
+
+void Scene::PredictCamera(double time, Input const & input)
+{
+	ProfileZone zone{ "Scene::PredictCamera" };
+
+	SceneSnapshot const * latest = m_snapshots.AcquireLatest().m_latest;
+	if (latest == nullptr)
+		return;
+
+	// the same update the simulation runs, only over the time since its latest step and with the keys held now
+	m_camera.Init(latest->m_camera_pos, latest->m_camera_dir);
+	m_camera.Update(std::clamp(time - latest->m_time, 0.0, g_max_camera_prediction), input);
+	if (m_camera.GetPos() != latest->m_camera_pos || m_camera.GetDir() != latest->m_camera_dir)
+		m_changes.m_camera = true;
+	m_renderer.SetViewProjTransform(m_camera.GetProjTransform() * m_camera.GetViewTransform());
+	update_camera_constants();
+}
+
+void Scene::Update(double delta_time, Input const & input)
+{
+	m_update_time += delta_time;
+	Simulate(m_update_time, delta_time, input);
+	Interpolate(m_update_time);
+	Extract();
+}
+
+void Scene::Render() const
+{
+	m_renderer.Render();
 }
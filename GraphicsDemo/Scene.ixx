@@ -2,22 +2,33 @@
 
 module;
 
+#include <array>
+#include <filesystem>
 #include <memory>
+#include <optional>
+#include <utility>
 #include <vector>
 
 #include <glm/vec3.hpp>
+#include <glm/ext/matrix_float4x4.hpp>
 
 export module Scene;
 
+import AppOptions;
 import Camera;
+import GraphicsApi;
 import Input;
 import Renderer;
 import RenderObject;
+import SnapshotExchange;
 import Texture;
+import VersionedBlock;
 
 struct AmbientLight
 {
 	alignas(16) glm::vec3 m_color{ 1.0, 1.0, 1.0 };
+
+	bool operator==(AmbientLight const &) const = default;
 };
 
 struct PointLight
@@ -25,6 +36,8 @@ struct PointLight
 	alignas(16) glm::vec3 m_pos{ 0.0, 0.0, 0.0 };
 	alignas(16) glm::vec3 m_color{ 1.0, 1.0, 1.0 };
 	alignas(4) float m_radius{ 0.0f };
+
+	bool operator==(PointLight const &) const = default;
 };
 
 struct SpotLight
@@ -34,29 +47,130 @@ struct SpotLight
 	alignas(16) glm::vec3 m_color{ 1.0, 1.0, 1.0 };
 	alignas(4) float m_inner_radius{ 0.0 };
 	alignas(4) float m_outer_radius{ 0.0 };
+
+	bool operator==(SpotLight const &) const = default;
+};
+
+// What the pipelines read of the camera, kept apart from it so they can tell when it moved
+struct CameraConstants
+{
+	glm::mat4 m_view{ 1.0 };
+	glm::mat4 m_proj{ 1.0 };
+	glm::vec3 m_pos{ 0.0, 0.0, 0.0 };
+
+	bool operator==(CameraConstants const &) const = default;
+};
+
+struct StressObject
+{
+	std::shared_ptr<RenderObject> m_obj;
+	glm::mat4 m_base_transform{ 1.0 }; // orientation and scale, applied before the animation
+	glm::vec3 m_pos{ 0.0f, 0.0f, 0.0f };
+	float m_spin_speed{ 0.0f };
+	float m_bob_phase{ 0.0f };
+};
+
+struct StressLight
+{
+	glm::vec3 m_orbit_center{ 0.0f, 0.0f, 0.0f };
+	float m_orbit_radius{ 0.0f };
+	float m_orbit_speed{ 0.0f };
+	float m_orbit_phase{ 0.0f };
+	PointLight m_light;
+};
+
+// What changed in the scene, a frame drawn when nothing did looks the same as the one before
+export struct SceneChanges
+{
+	bool m_camera{ false };
+	bool m_transforms{ false };
+	bool m_lights{ false }; // the point lights and the clear color
+	bool m_viewport{ false };
+	bool m_assets{ false };
+
+	bool Any() const { return m_camera || m_transforms || m_lights || m_viewport || m_assets; }
+
+	SceneChanges & operator|=(SceneChanges const & other)
+	{
+		m_camera |= other.m_camera;
+		m_transforms |= other.m_transforms;
+		m_lights |= other.m_lights;
+		m_viewport |= other.m_viewport;
+		m_assets |= other.m_assets;
+		return *this;
+	}
+};
+
+// What the simulation thread publishes after each step, the render thread interpolates between the last two
+struct SceneSnapshot
+{
+	double m_time{ 0.0 }; // when the step was due
+	glm::vec3 m_camera_pos{ 0.0f, 0.0f, 0.0f };
+	glm::vec3 m_camera_dir{ 0.0f, 0.0f, -1.0f };
+	glm::vec3 m_clear_color{ 0.0f, 0.0f, 0.0f };
+	std::array<PointLight, 3> m_pointlights;
+	std::vector<glm::mat4> m_transforms; // in the order of Scene::m_animated_objects
+	SceneChanges m_changes; // since the previous step
 };
 
 export class Scene
 {
 public:
-	Scene() = default;
+	explicit Scene(GraphicsApi & graphics_api)
+		: m_renderer{ graphics_api }
+	{}
 
-	void Init();
+	void Init(std::optional<StressSceneOptions> const & stress_options = std::nullopt);
 	void OnViewportResized(int width, int height);
 
+	// Simulation thread. Advances the scene by one fixed step due at step_time and publishes a snapshot of it,
+	// the render objects themselves are never touched. Returns what the step changed. P pauses the animation
+	SceneChanges Simulate(double step_time, double delta_time, Input const & input);
+
+	// Render thread. Moves the render objects, camera and lights to where they were at render_time,
+	// in between the last two snapshots
+	void Interpolate(double render_time);
+
+	// Render thread. Moves the camera from the latest snapshot to where input takes it by time, replacing the one
+	// Interpolate() placed a step behind, so the view follows a key press without waiting for the simulation to see it
+	void PredictCamera(double time, Input const & input);
+
+	// Render thread. Prepares the next frame's draws from where Interpolate() put the objects, see Renderer::Extract()
+	void Extract() { m_renderer.Extract(); }
+
+	// Render thread. What changed since the last call, for the frame being prepared. A frame keeps changing while the
+	// latest snapshot does, and changes once more after, to settle where the interpolation stopped
+	SceneChanges ConsumeChanges() { return std::exchange(m_changes, SceneChanges{}); }
+
+	// Simulates a step and extracts its result right away, for headless runs which step once per frame
 	void Update(double delta_time, Input const & input);
+
 	void Render() const;
 
+	void SetOverlayCallback(Renderer::OverlayCallback callback) { m_renderer.SetOverlayCallback(callback); }
+
 	Renderer const & GetRenderer() const { return m_renderer; }
 	Camera const & GetCamera() const { return m_camera; }
 
-	AmbientLight const & GetAmbientLight() const { return m_ambient_light; }
-	PointLight const & GetPointLight1() const { return m_pointlight_1; }
-	PointLight const & GetPointLight2() const { return m_pointlight_2; }
-	PointLight const & GetPointLight3() const { return m_pointlight_3; }
-	SpotLight const & GetSpotLight() const { return m_spotlight; }
+	// The per-frame constants, a pipeline skips the upload of a block that didn't change since it last did it
+	VersionedBlock<CameraConstants> const & GetCameraConstants() const { return m_camera_constants; }
+	VersionedBlock<AmbientLight> const & GetAmbientLight() const { return m_ambient_light; }
+	VersionedBlock<std::array<PointLight, 3>> const & GetPointLights() const { return m_pointlights; }
+	VersionedBlock<SpotLight> const & GetSpotLight() const { return m_spotlight; }
 
-	Texture const & GetTexture(int id) const;
+	std::vector<Texture> const & GetTextures() const { return m_textures; }
+
+private:
+	void init_stress_scene(
+		StressSceneOptions const & options,
+		std::filesystem::path const & resources_path,
+		std::filesystem::path const & shaders_path,
+		int ground_tex_id,
+		int skybox_tex_id);
+	void init_simulation();
+	void update_camera_constants(); // after anything that moves the camera or changes its projection
+	void simulate_demo_scene(float delta_time, std::array<PointLight, 3> & out_pointlights);
+	void simulate_stress_scene(std::array<PointLight, 3> & out_pointlights);
 
 private:
 	Renderer m_renderer;
@@ -72,11 +186,29 @@ private:
 	std::shared_ptr<RenderObject> m_ground;
 	std::shared_ptr<RenderObject> m_skybox;
 
-	AmbientLight m_ambient_light;
-	PointLight m_pointlight_1;
-	PointLight m_pointlight_2;
-	PointLight m_pointlight_3;
-	SpotLight m_spotlight;
+	VersionedBlock<CameraConstants> m_camera_constants;
+	VersionedBlock<AmbientLight> m_ambient_light;
+	VersionedBlock<std::array<PointLight, 3>> m_pointlights;
+	VersionedBlock<SpotLight> m_spotlight;
 
+	bool m_is_stress_scene{ false };
+	std::vector<StressObject> m_stress_objects;
+	std::vector<StressLight> m_stress_lights;
+
+	// the render objects moved by the simulation, the render thread copies the snapshots' transforms into them
+	std::vector<std::shared_ptr<RenderObject>> m_animated_objects;
+	SnapshotExchange<SceneSnapshot> m_snapshots;
+
+	// render thread only
+	SceneChanges m_changes;
+	SceneChanges m_latest_changes; // of the snapshot the last Interpolate() ended on
+
+	// only touched by the thread running Simulate()
+	Camera m_sim_camera;
+	std::vector<glm::mat4> m_sim_transforms;
 	float m_timer{ 0.0 };
+	bool m_animation_paused{ false };
+	bool m_pause_key_down{ false };
+
+	double m_update_time{ 0.0 }; // Update() only
 };
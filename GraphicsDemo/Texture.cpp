@@ -6,6 +6,7 @@ module;
 #include <array>
 #include <filesystem>
 #include <iostream>
+#include <string>
 
 #include <glad/glad.h>
 
@@ -14,6 +15,9 @@ module;
 
 module Texture;
 
+import Profiler;
+import RenderStats;
+
 class ImageData
 {
 public:
@@ -54,12 +58,31 @@ private:
 	unsigned char * m_data{ nullptr };
 };
 
+namespace
+{
+	std::uint64_t mip_chain_size(int width, int height)
+	{
+		std::uint64_t size = 0;
+		while (true)
+		{
+			size += std::uint64_t{ 4 } * width * height;
+			if (width == 1 && height == 1)
+				return size;
+
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+	}
+}
+
 Texture::Texture(std::filesystem::path const & filepath)
 {
 	ImageData image(filepath);
 	if (!image.IsValid())
 		return;
 
+	ProfileZone zone{ "upload texture" };
+
 	m_type = GL_TEXTURE_2D;
 	glGenTextures(1, &m_tex_id);
 	glBindTexture(m_type, m_tex_id);
@@ -70,7 +93,11 @@ Texture::Texture(std::filesystem::path const & filepath)
 	glTexParameteri(m_type, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
 	glTexImage2D(m_type, 0 /*level*/, GL_RGBA, image.GetWidth(), image.GetHeight(), 0 /*border*/, GL_RGBA, GL_UNSIGNED_BYTE, image.GetData());
+	FrameStats::Current().m_upload_bytes += std::uint64_t{ 4 } * image.GetWidth() * image.GetHeight();
 	glGenerateMipmap(m_type);
+
+	m_allocation = TrackedAllocation{ MemoryCategory::TEXTURE, filepath.filename().string(),
+		mip_chain_size(image.GetWidth(), image.GetHeight()) };
 }
 
 Texture::Texture(std::array<std::filesystem::path, 6> const & filepaths)
@@ -82,6 +109,8 @@ Texture::Texture(std::array<std::filesystem::path, 6> const & filepaths)
 	if (std::ranges::any_of(images, [](ImageData const & image) { return !image.IsValid(); }))
 		return;
 
+	ProfileZone zone{ "upload texture" };
+
 	m_type = GL_TEXTURE_CUBE_MAP;
 	glGenTextures(1, &m_tex_id);
 	glBindTexture(m_type, m_tex_id);
@@ -92,11 +121,42 @@ Texture::Texture(std::array<std::filesystem::path, 6> const & filepaths)
 	glTexParameteri(m_type, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(m_type, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
+	std::uint64_t allocation_size = 0;
 	for (unsigned int i = 0; i < images.size(); i++)
 	{
 		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
 			0, GL_RGBA, images[i].GetWidth(), images[i].GetHeight(), 0, GL_RGBA, GL_UNSIGNED_BYTE, images[i].GetData());
+		FrameStats::Current().m_upload_bytes += std::uint64_t{ 4 } * images[i].GetWidth() * images[i].GetHeight();
+		allocation_size += std::uint64_t{ 4 } * images[i].GetWidth() * images[i].GetHeight();
+	}
+
+	// the faces share a directory
+	m_allocation = TrackedAllocation{ MemoryCategory::TEXTURE, filepaths[0].parent_path().filename().string(), allocation_size };
+}
+
+Texture::Texture(int width, int height, std::vector<std::uint8_t> const & rgba_pixels)
+{
+	if (width <= 0 || height <= 0 || rgba_pixels.size() != std::size_t{ 4 } * width * height)
+	{
+		std::cout << "Texture() Pixel data doesn't match the image size" << std::endl;
+		return;
 	}
+
+	ProfileZone zone{ "upload texture" };
+
+	m_type = GL_TEXTURE_2D;
+	glGenTextures(1, &m_tex_id);
+	glBindTexture(m_type, m_tex_id);
+
+	glTexParameteri(m_type, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(m_type, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(m_type, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(m_type, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glTexImage2D(m_type, 0 /*level*/, GL_RGBA, width, height, 0 /*border*/, GL_RGBA, GL_UNSIGNED_BYTE, rgba_pixels.data());
+	FrameStats::Current().m_upload_bytes += rgba_pixels.size();
+
+	m_allocation = TrackedAllocation{ MemoryCategory::TEXTURE, "generated image", rgba_pixels.size() };
 }
 
 Texture::~Texture()
@@ -109,6 +169,7 @@ void Texture::destroy_texture()
 	glDeleteTextures(1, &m_tex_id);
 	m_tex_id = 0;
 	m_type = 0;
+	m_allocation.Reset();
 }
 
 Texture::Texture(Texture && other)
@@ -125,6 +186,7 @@ Texture & Texture::operator=(Texture && other)
 
 	m_tex_id = other.m_tex_id;
 	m_type = other.m_type;
+	m_allocation = std::move(other.m_allocation);
 
 	other.m_tex_id = 0;
 	other.m_type = 0;
@@ -140,4 +202,5 @@ bool Texture::IsValid() const
 void Texture::Bind() const
 {
 	glBindTexture(m_type, m_tex_id);
+	FrameStats::Current().m_texture_binds += 1;
 }
@@ -1,15 +1,21 @@
 // Texture.ixx
 
 #include <array>
+#include <cstdint>
 #include <filesystem>
+#include <vector>
 
 export module Texture;
 
+import MemoryLedger;
+
 export class Texture
 {
 public:
 	Texture(std::filesystem::path const & filepath);
 	Texture(std::array<std::filesystem::path, 6> const & filepaths); // cubemap
+	// Nearest filtered and clamped to the edge, for images generated at runtime such as the hud font
+	Texture(int width, int height, std::vector<std::uint8_t> const & rgba_pixels);
 	~Texture();
 
 	Texture(Texture && other);
@@ -28,4 +34,6 @@ private:
 private:
 	unsigned int m_type{ 0 };
 	unsigned int m_tex_id{ 0 };
+
+	TrackedAllocation m_allocation; // estimated from the image sizes, the driver's layout isn't visible
 };
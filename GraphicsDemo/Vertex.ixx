@@ -33,12 +33,19 @@ export struct ColorVertex {
 	glm::vec3 m_color;
 };
 
+export struct OverlayVertex {
+	glm::vec3 m_pos; // pixels from the top left of the viewport, z is unused
+	glm::vec2 m_tex_coord;
+	glm::vec3 m_color;
+};
+
 export template <typename T>
 concept IsVertex =
 	std::same_as<T, PositionVertex>
 	|| std::same_as<T, NormalVertex>
 	|| std::same_as<T, TextureVertex>
-	|| std::same_as<T, ColorVertex>;
+	|| std::same_as<T, ColorVertex>
+	|| std::same_as<T, OverlayVertex>;
 
 export template <typename T>
 concept VertexSupportsNormal = IsVertex<T> && requires(T v) { v.m_normal; };
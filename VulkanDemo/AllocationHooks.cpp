@@ -0,0 +1,45 @@
+// AllocationHooks.cpp
+
+// Replaces the global operator new and delete so every heap allocation goes through the AllocationTracker.
+// The nothrow overloads forward to these ones, over-aligned allocations are not counted.
+
+#include <cstdlib>
+#include <new>
+
+import AllocationTracker;
+
+void * operator new(std::size_t size)
+{
+	AllocationTracker::RecordAllocation(size);
+
+	// malloc(0) may return null, operator new must return a unique pointer
+	if (void * ptr = std::malloc(size == 0 ? 1 : size))
+		return ptr;
+
+	throw std::bad_alloc{};
+}
+
+void * operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void * ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void * ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void * ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
@@ -0,0 +1,75 @@
+// FixedStepThread.ixx
+
+module;
+
+#include <chrono>
+#include <functional>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+export module FixedStepThread;
+
+import Profiler;
+
+// Calls a step function at a fixed rate on its own thread until destroyed, with the time the step was due and the fixed
+// delta time. Steps that fall behind run back to back to catch up, after a longer stall the missed ones are skipped
+// instead, the simulation slows down for a moment rather than spending seconds catching up.
+export class FixedStepThread
+{
+public:
+	using TimeFn = double(); // seconds, e.g. glfwGetTime
+	using StepFn = std::function<void(double step_time, double delta_time)>;
+
+	FixedStepThread(double steps_per_second, TimeFn * time_fn, StepFn step_fn);
+
+	FixedStepThread(FixedStepThread const &) = delete;
+	FixedStepThread & operator=(FixedStepThread const &) = delete;
+
+	double GetStepDuration() const { return m_step_duration; }
+
+private:
+	void run(std::stop_token stop_token);
+
+private:
+	static constexpr int m_max_catch_up_steps = 5;
+
+	double m_step_duration{ 0.0 };
+	TimeFn * m_time_fn{ nullptr };
+	StepFn m_step_fn;
+
+	std::jthread m_thread; // last, so it stops before the rest is destroyed
+};
+
+FixedStepThread::FixedStepThread(double steps_per_second, TimeFn * time_fn, StepFn step_fn)
+	: m_step_duration(1.0 / steps_per_second)
+	, m_time_fn(time_fn)
+	, m_step_fn(std::move(step_fn))
+{
+	m_thread = std::jthread([this](std::stop_token stop_token) { run(stop_token); });
+}
+
+void FixedStepThread::run(std::stop_token stop_token)
+{
+	Profiler::SetThreadName("simulation");
+
+	double next_step_time = m_time_fn();
+	while (!stop_token.stop_requested())
+	{
+		double const now = m_time_fn();
+		if (now < next_step_time)
+		{
+			std::this_thread::sleep_for(std::chrono::duration<double>(next_step_time - now));
+			continue;
+		}
+
+		if (now - next_step_time > m_max_catch_up_steps * m_step_duration)
+			next_step_time = now;
+
+		{
+			ProfileZone zone{ "simulation step" };
+			m_step_fn(next_step_time, m_step_duration);
+		}
+		next_step_time += m_step_duration;
+	}
+}
@@ -0,0 +1,104 @@
+// FrameArena.ixx
+
+module;
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+export module FrameArena;
+
+// Linear allocator for data that only lives until the end of the frame. Allocating bumps an offset and Reset() rewinds
+// it, so a frame costs no heap allocations once the arena has grown to the largest frame seen so far.
+// Nothing is destructed, only trivially destructible types can be allocated.
+export class FrameArena
+{
+public:
+	explicit FrameArena(std::size_t capacity = 64 * 1024);
+
+	FrameArena(FrameArena const &) = delete;
+	FrameArena & operator=(FrameArena const &) = delete;
+
+	// Value initialized, valid until the next Reset()
+	template<typename T>
+	std::span<T> Allocate(std::size_t count);
+
+	// Call once per frame when nothing allocated from the arena is used anymore
+	void Reset();
+
+	std::size_t GetCapacity() const { return m_capacity; }
+	std::size_t GetHighWaterMark() const { return m_high_water_mark; }
+
+private:
+	void * allocate_bytes(std::size_t size, std::size_t alignment);
+
+private:
+	std::unique_ptr<std::byte[]> m_buffer;
+	std::size_t m_capacity{ 0 };
+	std::size_t m_offset{ 0 };
+
+	// a frame that doesn't fit falls back on the heap, the buffer grows on the next Reset()
+	std::vector<std::unique_ptr<std::byte[]>> m_overflow_blocks;
+	std::size_t m_frame_bytes{ 0 };
+	std::size_t m_high_water_mark{ 0 };
+};
+
+template<typename T>
+std::span<T> FrameArena::Allocate(std::size_t count)
+{
+	static_assert(std::is_trivially_destructible_v<T>, "FrameArena never calls destructors");
+
+	if (count == 0)
+		return {};
+
+	T * data = static_cast<T *>(allocate_bytes(sizeof(T) * count, alignof(T)));
+	for (std::size_t i = 0; i < count; ++i)
+		new (data + i) T{};
+	return std::span<T>(data, count);
+}
+
+FrameArena::FrameArena(std::size_t capacity)
+	: m_buffer(std::make_unique_for_overwrite<std::byte[]>(capacity))
+	, m_capacity(capacity)
+{
+}
+
+void FrameArena::Reset()
+{
+	m_high_water_mark = std::max(m_high_water_mark, m_frame_bytes);
+
+	if (!m_overflow_blocks.empty())
+	{
+		// room for the largest frame with some slack, so a slowly growing frame doesn't reallocate every time
+		m_capacity = std::max(m_capacity * 2, m_high_water_mark + m_high_water_mark / 2);
+		m_buffer = std::make_unique_for_overwrite<std::byte[]>(m_capacity);
+		m_overflow_blocks.clear();
+	}
+
+	m_offset = 0;
+	m_frame_bytes = 0;
+}
+
+void * FrameArena::allocate_bytes(std::size_t size, std::size_t alignment)
+{
+	std::uintptr_t const base = reinterpret_cast<std::uintptr_t>(m_buffer.get());
+	std::size_t const aligned_offset = ((base + m_offset + alignment - 1) & ~(alignment - 1)) - base;
+
+	// counts the worst case padding so the grown buffer is sure to fit the same frame
+	m_frame_bytes += size + alignment - 1;
+
+	if (aligned_offset + size <= m_capacity)
+	{
+		m_offset = aligned_offset + size;
+		return m_buffer.get() + aligned_offset;
+	}
+
+	// new[] aligns to __STDCPP_DEFAULT_NEW_ALIGNMENT__, which covers every type allocated here
+	m_overflow_blocks.push_back(std::make_unique_for_overwrite<std::byte[]>(size));
+	return m_overflow_blocks.back().get();
+}
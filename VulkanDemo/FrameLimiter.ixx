@@ -0,0 +1,70 @@
+// FrameLimiter.ixx
+
+module;
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+export module FrameLimiter;
+
+// Caps the frame rate by holding each frame back until its slot in a fixed cadence. Sleeping alone wakes up late by
+// whatever the os timer granularity is, so it sleeps until a margin before the slot and spins the rest. The margin
+// follows the worst oversleep seen lately, so the spinning stays short where the sleeps are precise.
+export class FrameLimiter
+{
+public:
+	explicit FrameLimiter(double max_fps); // 0 never waits
+
+	bool IsEnabled() const { return m_frame_duration > Clock::duration::zero(); }
+
+	// Call at the start of every frame, returns the milliseconds it waited
+	double Wait();
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	Clock::duration m_frame_duration{ Clock::duration::zero() };
+	Clock::time_point m_next_frame{};
+	Clock::duration m_spin_margin{ std::chrono::milliseconds(1) };
+};
+
+FrameLimiter::FrameLimiter(double max_fps)
+{
+	if (max_fps > 0.0)
+		m_frame_duration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / max_fps));
+}
+
+double FrameLimiter::Wait()
+{
+	if (!IsEnabled())
+		return 0.0;
+
+	Clock::time_point const start = Clock::now();
+
+	// a frame that ran long restarts the cadence, the next ones don't rush to make up for it
+	if (start > m_next_frame + m_frame_duration)
+		m_next_frame = start;
+
+	for (Clock::time_point now = start; now < m_next_frame; now = Clock::now())
+	{
+		Clock::duration const remaining = m_next_frame - now;
+		if (remaining <= m_spin_margin)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		Clock::duration const sleep = remaining - m_spin_margin;
+		std::this_thread::sleep_for(sleep);
+		Clock::duration const overslept = Clock::now() - now - sleep;
+
+		// grows at once to cover a late wake up, shrinks slowly so a single one doesn't matter for long
+		Clock::duration const decayed = m_spin_margin - m_spin_margin / 16;
+		Clock::duration const min_margin = std::chrono::microseconds(200);
+		m_spin_margin = std::clamp(std::max(decayed, overslept + min_margin), min_margin, std::max(m_frame_duration, min_margin));
+	}
+
+	m_next_frame += m_frame_duration;
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
@@ -3,11 +3,14 @@
 module;
 
 #include <algorithm>
+#include <deque>
 #include <iostream>
 #include <limits>
+#include <mutex>
 #include <optional>
 #include <ranges>
 #include <set>
+#include <span>
 
 #include <vulkan/vulkan.h>
 
@@ -16,6 +19,10 @@ module;
 
 module GraphicsApi;
 
+import Log;
+import Profiler;
+import RenderStats;
+
 namespace
 {
 	bool validation_layers_are_supported(std::vector<char const *> const & desired_layers)
@@ -50,7 +57,7 @@ namespace
 			.applicationVersion = VK_MAKE_VERSION(1, 0, 0),
 			.pEngineName = "No Engine",
 			.engineVersion = VK_MAKE_VERSION(1, 0, 0),
-			.apiVersion = VK_API_VERSION_1_0
+			.apiVersion = VK_API_VERSION_1_1 // vkGetPhysicalDeviceMemoryProperties2 for the memory budget
 		};
 
 		VkInstanceCreateInfo create_info{
@@ -100,10 +107,17 @@ namespace
 			if (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
 				indices.graphics_family = i;
 
-			VkBool32 present_support = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
-			if (present_support)
-				indices.present_family = i;
+			if (surface == VK_NULL_HANDLE) // headless, nothing is presented so the graphics queue stands in
+			{
+				indices.present_family = indices.graphics_family;
+			}
+			else
+			{
+				VkBool32 present_support = false;
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+				if (present_support)
+					indices.present_family = i;
+			}
 
 			if (indices.IsComplete())
 				break;
@@ -157,7 +171,20 @@ namespace
 			});
 	}
 
-	bool device_is_suitable(
+	int device_type_score(VkPhysicalDeviceType device_type)
+	{
+		switch (device_type)
+		{
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 1000;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 500;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 250;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU: return 100; // software rasterizers like lavapipe
+		default: return 10;
+		}
+	}
+
+	// Returns std::nullopt if the device can't be used at all, otherwise higher scores are preferred
+	std::optional<int> rate_device(
 		VkPhysicalDevice device,
 		std::vector<const char *> const & device_extensions,
 		VkSurfaceKHR surface,
@@ -166,28 +193,31 @@ namespace
 		VkPhysicalDeviceProperties device_properties;
 		vkGetPhysicalDeviceProperties(device, &device_properties);
 
-		// Just find a dedicated gpu for now
-		if (device_properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
-			return false;
-
 		QueueFamilyIndices qfis = find_queue_families(device, surface);
 		if (!qfis.IsComplete())
-			return false;
+			return std::nullopt;
 
 		if (!device_supports_extensions(device, device_extensions))
-			return false;
+			return std::nullopt;
 
-		SwapChainSupportDetails swap_chain_support = query_swap_chain_support(device, surface);
-		if (swap_chain_support.formats.empty() || swap_chain_support.present_modes.empty())
-			return false;
+		SwapChainSupportDetails swap_chain_support;
+		if (surface != VK_NULL_HANDLE)
+		{
+			swap_chain_support = query_swap_chain_support(device, surface);
+			if (swap_chain_support.formats.empty() || swap_chain_support.present_modes.empty())
+				return std::nullopt;
+		}
 
 		VkPhysicalDeviceFeatures supported_features;
 		vkGetPhysicalDeviceFeatures(device, &supported_features);
-		if (!supported_features.samplerAnisotropy)
-			return false;
+
+		int score = device_type_score(device_properties.deviceType);
+		if (supported_features.samplerAnisotropy)
+			score += 1; // nice to have, the texture sampler falls back to no anisotropic filtering
 
 		out_device_info = PhysicalDeviceInfo{ device, qfis, swap_chain_support };
-		return true;
+		out_device_info.features = supported_features;
+		return score;
 	}
 
 	PhysicalDeviceInfo pick_physical_device(
@@ -204,23 +234,102 @@ namespace
 		vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
 
 		PhysicalDeviceInfo phys_device_info;
-		auto iter = std::ranges::find_if(devices,
-			[&device_extensions, surface, &phys_device_info](VkPhysicalDevice device)
+		int best_score = -1;
+		for (VkPhysicalDevice device : devices)
+		{
+			PhysicalDeviceInfo device_info;
+			std::optional<int> score = rate_device(device, device_extensions, surface, device_info);
+			if (score.has_value() && score.value() > best_score)
 			{
-				return device_is_suitable(device, device_extensions, surface, phys_device_info);
-			});
-		if (iter == devices.end())
+				best_score = score.value();
+				phys_device_info = device_info;
+			}
+		}
+		if (phys_device_info.device == VK_NULL_HANDLE)
 			throw std::runtime_error("Failed to find a suitable GPU!");
 
 		vkGetPhysicalDeviceMemoryProperties(phys_device_info.device, &phys_device_info.mem_properties);
 		vkGetPhysicalDeviceProperties(phys_device_info.device, &phys_device_info.properties);
 
+		std::cout << "Using physical device: " << phys_device_info.properties.deviceName << std::endl;
+
 		return phys_device_info;
 	}
 
+	// Puts an extension's feature or property struct at the front of a pNext chain
+	template <typename T>
+	void chain_struct(void *& chain, T & extension_struct)
+	{
+		extension_struct.pNext = chain;
+		chain = &extension_struct;
+	}
+
+	DynamicRenderStateSupport query_dynamic_render_state_support(PhysicalDeviceInfo const & phys_device_info)
+	{
+		DynamicRenderStateSupport support{ .m_wireframe = phys_device_info.features.fillModeNonSolid == VK_TRUE };
+		if (phys_device_info.properties.apiVersion < VK_API_VERSION_1_1) // vkGetPhysicalDeviceFeatures2
+			return support;
+
+		bool const has_eds = device_supports_extensions(phys_device_info.device, { VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME });
+		bool const has_eds3 = device_supports_extensions(phys_device_info.device, { VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME });
+
+		VkPhysicalDeviceExtendedDynamicState3FeaturesEXT eds3_features{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT
+		};
+		VkPhysicalDeviceExtendedDynamicStateFeaturesEXT eds_features{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT
+		};
+		VkPhysicalDeviceFeatures2 features2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2
+		};
+		// only the structs of extensions the device has may be chained
+		if (has_eds3)
+			chain_struct(features2.pNext, eds3_features);
+		if (has_eds)
+			chain_struct(features2.pNext, eds_features);
+		vkGetPhysicalDeviceFeatures2(phys_device_info.device, &features2);
+
+		support.m_depth_and_cull = has_eds && eds_features.extendedDynamicState;
+		support.m_polygon_mode = has_eds3 && eds3_features.extendedDynamicState3PolygonMode && support.m_wireframe; // fill is all there is otherwise
+		return support;
+	}
+
+	// Linking pipelines from libraries only pays off when the driver links fast, see GraphicsPipeline
+	bool query_pipeline_library_support(PhysicalDeviceInfo const & phys_device_info)
+	{
+		if (phys_device_info.properties.apiVersion < VK_API_VERSION_1_1 // vkGetPhysicalDeviceFeatures2
+			|| !device_supports_extensions(phys_device_info.device,
+				{ VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME }))
+		{
+			return false;
+		}
+
+		VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT gpl_features{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT
+		};
+		VkPhysicalDeviceFeatures2 features2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+			.pNext = &gpl_features
+		};
+		vkGetPhysicalDeviceFeatures2(phys_device_info.device, &features2);
+
+		VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT gpl_properties{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT
+		};
+		VkPhysicalDeviceProperties2 properties2{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+			.pNext = &gpl_properties
+		};
+		vkGetPhysicalDeviceProperties2(phys_device_info.device, &properties2);
+
+		return gpl_features.graphicsPipelineLibrary && gpl_properties.graphicsPipelineLibraryFastLinking;
+	}
+
 	VkDevice create_logical_device(
 		PhysicalDeviceInfo phys_device_info,
 		std::vector<const char *> const & device_extensions,
+		DynamicRenderStateSupport const & dynamic_render_state_support,
+		bool pipeline_library_supported,
 		VkQueue & out_graphics_queue,
 		VkQueue & out_present_queue)
 	{
@@ -243,11 +352,35 @@ namespace
 			});
 
 		VkPhysicalDeviceFeatures deviceFeatures{
-			.samplerAnisotropy = VK_TRUE
+			.fillModeNonSolid = dynamic_render_state_support.m_wireframe ? VK_TRUE : VK_FALSE,
+			.samplerAnisotropy = phys_device_info.features.samplerAnisotropy,
+			.pipelineStatisticsQuery = phys_device_info.features.pipelineStatisticsQuery
+		};
+
+		VkPhysicalDeviceExtendedDynamicState3FeaturesEXT eds3_features{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT,
+			.extendedDynamicState3PolygonMode = VK_TRUE
+		};
+		VkPhysicalDeviceExtendedDynamicStateFeaturesEXT eds_features{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT,
+			.extendedDynamicState = VK_TRUE
 		};
+		VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT gpl_features{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
+			.graphicsPipelineLibrary = VK_TRUE
+		};
+
+		void * features_chain = nullptr;
+		if (dynamic_render_state_support.m_polygon_mode)
+			chain_struct(features_chain, eds3_features);
+		if (dynamic_render_state_support.m_depth_and_cull)
+			chain_struct(features_chain, eds_features);
+		if (pipeline_library_supported)
+			chain_struct(features_chain, gpl_features);
 
 		VkDeviceCreateInfo createInfo{
 			.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+			.pNext = features_chain,
 			.queueCreateInfoCount = static_cast<std::uint32_t>(queue_create_infos.size()),
 			.pQueueCreateInfos = queue_create_infos.data(),
 			.enabledExtensionCount = static_cast<std::uint32_t>(device_extensions.size()),
@@ -281,10 +414,31 @@ namespace
 		return available_formats[0];
 	}
 
-	VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR> & available_present_modes)
+	VkPresentModeKHR to_vk_present_mode(PresentMode mode)
 	{
-		constexpr VkPresentModeKHR desired_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+		switch (mode)
+		{
+		case PresentMode::MAILBOX: return VK_PRESENT_MODE_MAILBOX_KHR;
+		case PresentMode::IMMEDIATE: return VK_PRESENT_MODE_IMMEDIATE_KHR;
+		default: return VK_PRESENT_MODE_FIFO_KHR;
+		}
+	}
 
+	char const * get_present_mode_name(VkPresentModeKHR mode)
+	{
+		switch (mode)
+		{
+		case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+		case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+		case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+		default: return "unknown";
+		}
+	}
+
+	// Every surface supports fifo
+	VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR> & available_present_modes, VkPresentModeKHR desired_mode)
+	{
 		auto iter = std::ranges::find(available_present_modes, desired_mode);
 		if (iter != available_present_modes.end())
 			return desired_mode;
@@ -315,15 +469,18 @@ namespace
 		int height,
 		VkSurfaceKHR surface,
 		VkDevice logical_device,
+		VkSwapchainKHR old_swap_chain,
+		VkPresentModeKHR desired_present_mode,
 		std::vector<VkImage> & out_swap_chain_images,
 		VkFormat & out_swap_chain_image_format,
-		VkExtent2D & out_swap_chain_extent)
+		VkExtent2D & out_swap_chain_extent,
+		VkPresentModeKHR & out_present_mode)
 	{
 		QueueFamilyIndices & qfis = phys_device_info.qfis;
 		SwapChainSupportDetails & sws = phys_device_info.sws_details;
 
 		VkSurfaceFormatKHR surface_format = choose_swap_surface_format(sws.formats);
-		VkPresentModeKHR present_mode = choose_swap_present_mode(sws.present_modes);
+		VkPresentModeKHR present_mode = choose_swap_present_mode(sws.present_modes, desired_present_mode);
 		VkExtent2D extent = choose_swap_extent(sws.capabilities, width, height);
 		if (extent.width == 0 || extent.height == 0)
 			return VK_NULL_HANDLE;
@@ -348,7 +505,7 @@ namespace
 			.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
 			.presentMode = present_mode,
 			.clipped = VK_TRUE,
-			.oldSwapchain = VK_NULL_HANDLE
+			.oldSwapchain = old_swap_chain // lets the driver hand over resources and keep presenting the old images meanwhile
 		};
 
 		std::uint32_t qfis_array[] = {
@@ -373,11 +530,16 @@ namespace
 
 		out_swap_chain_image_format = surface_format.format;
 		out_swap_chain_extent = extent;
+		out_present_mode = present_mode;
 
 		return swap_chain;
 	}
 
-	VkRenderPass create_render_pass(VkDevice logical_device, VkFormat swap_chain_image_format, VkFormat depth_format)
+	VkRenderPass create_render_pass(
+		VkDevice logical_device,
+		VkFormat swap_chain_image_format,
+		VkFormat depth_format,
+		VkImageLayout color_final_layout)
 	{
 		VkAttachmentDescription color_attachment{
 			.format = swap_chain_image_format,
@@ -387,7 +549,7 @@ namespace
 			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-			.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+			.finalLayout = color_final_layout
 		};
 
 		VkAttachmentReference color_attachment_ref{
@@ -585,6 +747,47 @@ namespace
 		return fences;
 	}
 
+	VkQueryPool create_timestamp_query_pool(VkDevice logical_device, std::uint32_t query_count)
+	{
+		VkQueryPoolCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_TIMESTAMP,
+			.queryCount = query_count
+		};
+
+		VkQueryPool query_pool = VK_NULL_HANDLE;
+		VkResult result = vkCreateQueryPool(logical_device, &create_info, nullptr, &query_pool);
+		if (result != VK_SUCCESS)
+			std::cout << "Failed to create timestamp query pool, gpu frame times are unavailable" << std::endl;
+
+		return query_pool;
+	}
+
+	// The order of the flags is the order of the counters in the results, see read_frame_timer()
+	constexpr VkQueryPipelineStatisticFlags g_pipeline_statistics =
+		VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+		VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+	constexpr std::uint32_t g_pipeline_statistics_count = 4;
+
+	VkQueryPool create_statistics_query_pool(VkDevice logical_device, std::uint32_t query_count)
+	{
+		VkQueryPoolCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+			.queryCount = query_count,
+			.pipelineStatistics = g_pipeline_statistics
+		};
+
+		VkQueryPool query_pool = VK_NULL_HANDLE;
+		VkResult result = vkCreateQueryPool(logical_device, &create_info, nullptr, &query_pool);
+		if (result != VK_SUCCESS)
+			std::cout << "Failed to create pipeline statistics query pool, pipeline statistics are unavailable" << std::endl;
+
+		return query_pool;
+	}
+
 	std::uint32_t find_memory_type(PhysicalDeviceInfo const & phys_device_info, std::uint32_t type_filter, VkMemoryPropertyFlags properties)
 	{
 		VkPhysicalDeviceMemoryProperties const & mem_properties = phys_device_info.mem_properties;
@@ -604,7 +807,10 @@ GraphicsApi::GraphicsApi(
 	int height,
 	std::string const & app_title,
 	std::uint32_t extension_count,
-	char const ** extensions)
+	char const ** extensions,
+	FramePacingOptions const & pacing)
+	: m_desired_present_mode(to_vk_present_mode(pacing.m_present_mode))
+	, m_frames_in_flight(static_cast<std::uint32_t>(std::clamp(pacing.m_frames_in_flight, 1, FramePacingOptions::m_max_frames_in_flight)))
 {
 	if (m_enable_validation_layers && !validation_layers_are_supported(m_validation_layers))
 		throw std::runtime_error("Validation layers requested, but not available!");
@@ -617,14 +823,61 @@ GraphicsApi::GraphicsApi(
 	if (m_surface == VK_NULL_HANDLE)
 		return;
 
+	init_device(width, height);
+}
+
+GraphicsApi::GraphicsApi(
+	int width,
+	int height,
+	std::string const & app_title,
+	FramePacingOptions const & pacing)
+	: m_headless(true)
+	, m_frames_in_flight(static_cast<std::uint32_t>(std::clamp(pacing.m_frames_in_flight, 1, FramePacingOptions::m_max_frames_in_flight)))
+{
+	if (m_enable_validation_layers && !validation_layers_are_supported(m_validation_layers))
+		throw std::runtime_error("Validation layers requested, but not available!");
+
+	m_instance = create_instance(app_title, 0 /*extension_count*/, nullptr, m_enable_validation_layers, m_validation_layers);
+	if (m_instance == VK_NULL_HANDLE)
+		return;
+
+	m_device_extensions.clear(); // nothing is presented, so the swap chain extension isn't needed
+
+	init_device(width, height);
+}
+
+void GraphicsApi::init_device(int width, int height)
+{
 	m_phys_device_info = pick_physical_device(m_instance, m_surface, m_device_extensions);
 	if (m_phys_device_info.device == VK_NULL_HANDLE)
 		return;
 
-	m_logical_device = create_logical_device(m_phys_device_info, m_device_extensions, m_graphics_queue, m_present_queue);
+	m_memory_budget_supported = m_phys_device_info.properties.apiVersion >= VK_API_VERSION_1_1
+		&& device_supports_extensions(m_phys_device_info.device, { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME });
+	if (m_memory_budget_supported)
+		m_device_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+	m_dynamic_render_state_support = query_dynamic_render_state_support(m_phys_device_info);
+	if (m_dynamic_render_state_support.m_depth_and_cull)
+		m_device_extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+	if (m_dynamic_render_state_support.m_polygon_mode)
+		m_device_extensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+
+	m_pipeline_library_supported = query_pipeline_library_support(m_phys_device_info);
+	if (m_pipeline_library_supported)
+	{
+		m_device_extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+		m_device_extensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+	}
+
+	m_logical_device = create_logical_device(m_phys_device_info, m_device_extensions, m_dynamic_render_state_support,
+		m_pipeline_library_supported, m_graphics_queue, m_present_queue);
 	if (m_logical_device == VK_NULL_HANDLE)
 		return;
 
+	load_dynamic_render_state_commands();
+	LogInfo("Pipelines {}", m_pipeline_library_supported ? "linked from libraries" : "compiled whole");
+
 	m_command_pool = create_command_pool(m_phys_device_info, m_logical_device);
 	if (m_command_pool == VK_NULL_HANDLE)
 		return;
@@ -633,17 +886,34 @@ GraphicsApi::GraphicsApi(
 	if (std::ranges::find(m_command_buffers, VK_NULL_HANDLE) != m_command_buffers.end())
 		return;
 
-	m_swap_chain = create_swap_chain(m_phys_device_info, width, height, m_surface, m_logical_device,
-		m_swap_chain_images, m_swap_chain_image_format, m_swap_chain_extent);
-	if (m_swap_chain == VK_NULL_HANDLE)
-		return;
+	if (m_headless)
+	{
+		VkResult result = create_offscreen_images(width, height);
+		if (result != VK_SUCCESS)
+			return;
+	}
+	else
+	{
+		m_swap_chain = create_swap_chain(m_phys_device_info, width, height, m_surface, m_logical_device, VK_NULL_HANDLE,
+			m_desired_present_mode, m_swap_chain_images, m_swap_chain_image_format, m_swap_chain_extent, m_present_mode);
+		if (m_swap_chain == VK_NULL_HANDLE)
+			return;
+
+		if (m_present_mode != m_desired_present_mode)
+			LogWarning("Present mode {} isn't supported, using {}", get_present_mode_name(m_desired_present_mode), get_present_mode_name(m_present_mode));
+		LogInfo("Present mode {}, {} frames in flight", get_present_mode_name(m_present_mode), m_frames_in_flight);
+	}
 
 	m_depth_format = find_depth_format(m_phys_device_info.device);
 	VkResult result = create_depth_resources(m_depth_image, m_depth_image_memory, m_depth_image_view);
 	if (result != VK_SUCCESS)
 		return;
+	m_depth_extent = m_swap_chain_extent;
+	m_depth_allocation = TrackedAllocation{ MemoryCategory::RENDER_TARGET, "depth buffer", GetMemorySize(m_depth_image) };
 
-	m_render_pass = create_render_pass(m_logical_device, m_swap_chain_image_format, m_depth_format);
+	// Offscreen images are left ready to be copied out instead of presented
+	VkImageLayout const color_final_layout = m_headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	m_render_pass = create_render_pass(m_logical_device, m_swap_chain_image_format, m_depth_format, color_final_layout);
 	if (m_render_pass == VK_NULL_HANDLE)
 		return;
 
@@ -654,10 +924,47 @@ GraphicsApi::GraphicsApi(
 	m_image_available_semaphores = create_semaphores<m_max_frames_in_flight>(m_logical_device);
 	m_render_finished_semaphores = create_semaphores<m_max_frames_in_flight>(m_logical_device);
 	m_in_flight_fences = create_fences<m_max_frames_in_flight>(m_logical_device, true /*create_signaled*/);
+
+	if (m_phys_device_info.properties.limits.timestampComputeAndGraphics)
+		m_timestamp_query_pool = create_timestamp_query_pool(m_logical_device, m_timestamps_per_frame * m_max_frames_in_flight);
+	if (m_phys_device_info.features.pipelineStatisticsQuery)
+		m_statistics_query_pool = create_statistics_query_pool(m_logical_device, m_max_pipeline_timers * m_max_frames_in_flight);
+}
+
+void GraphicsApi::load_dynamic_render_state_commands()
+{
+	DynamicRenderStateSupport & support = m_dynamic_render_state_support;
+	if (support.m_depth_and_cull)
+	{
+		m_cmd_set_depth_test_enable = reinterpret_cast<PFN_vkCmdSetDepthTestEnableEXT>(vkGetDeviceProcAddr(m_logical_device, "vkCmdSetDepthTestEnableEXT"));
+		m_cmd_set_depth_write_enable = reinterpret_cast<PFN_vkCmdSetDepthWriteEnableEXT>(vkGetDeviceProcAddr(m_logical_device, "vkCmdSetDepthWriteEnableEXT"));
+		m_cmd_set_depth_compare_op = reinterpret_cast<PFN_vkCmdSetDepthCompareOpEXT>(vkGetDeviceProcAddr(m_logical_device, "vkCmdSetDepthCompareOpEXT"));
+		m_cmd_set_cull_mode = reinterpret_cast<PFN_vkCmdSetCullModeEXT>(vkGetDeviceProcAddr(m_logical_device, "vkCmdSetCullModeEXT"));
+		support.m_depth_and_cull = m_cmd_set_depth_test_enable && m_cmd_set_depth_write_enable
+			&& m_cmd_set_depth_compare_op && m_cmd_set_cull_mode;
+	}
+	if (support.m_polygon_mode)
+	{
+		m_cmd_set_polygon_mode = reinterpret_cast<PFN_vkCmdSetPolygonModeEXT>(vkGetDeviceProcAddr(m_logical_device, "vkCmdSetPolygonModeEXT"));
+		support.m_polygon_mode = m_cmd_set_polygon_mode != nullptr;
+	}
+
+	LogInfo("Depth and cull state {}, polygon mode {}",
+		support.m_depth_and_cull ? "dynamic" : "per pipeline",
+		support.m_polygon_mode ? "dynamic" : support.m_wireframe ? "per pipeline permutation" : "fill only");
 }
 
 GraphicsApi::~GraphicsApi()
 {
+	vkDeviceWaitIdle(m_logical_device);
+	process_deletion_queue(true /*flush_all*/);
+
+	for (auto const & [key, library] : m_shared_pipeline_libraries)
+		vkDestroyPipeline(m_logical_device, library, nullptr);
+
+	vkDestroyQueryPool(m_logical_device, m_statistics_query_pool, nullptr);
+	vkDestroyQueryPool(m_logical_device, m_timestamp_query_pool, nullptr);
+
 	for (auto fence : m_in_flight_fences)
 		vkDestroyFence(m_logical_device, fence, nullptr);
 	for (auto semaphore : m_render_finished_semaphores)
@@ -671,7 +978,8 @@ GraphicsApi::~GraphicsApi()
 
 	vkDestroyRenderPass(m_logical_device, m_render_pass, nullptr);
 	vkDestroyDevice(m_logical_device, nullptr);
-	vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+	if (!m_headless)
+		vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
 	vkDestroyInstance(m_instance, nullptr);
 }
 
@@ -680,16 +988,69 @@ void GraphicsApi::destroy_swap_chain()
 	destroy_swap_chain_framebuffers();
 
 	vkDestroyImageView(m_logical_device, m_depth_image_view, nullptr);
+	m_depth_image_view = VK_NULL_HANDLE;
 	vkDestroyImage(m_logical_device, m_depth_image, nullptr);
+	m_depth_image = VK_NULL_HANDLE;
 	vkFreeMemory(m_logical_device, m_depth_image_memory, nullptr);
+	m_depth_image_memory = VK_NULL_HANDLE;
+	m_depth_extent = VkExtent2D{ 0, 0 };
+	m_depth_allocation.Reset();
 
-	vkDestroySwapchainKHR(m_logical_device, m_swap_chain, nullptr);
+	if (m_headless)
+	{
+		for (auto image : m_swap_chain_images)
+			vkDestroyImage(m_logical_device, image, nullptr);
+		for (auto image_memory : m_offscreen_image_memories)
+			vkFreeMemory(m_logical_device, image_memory, nullptr);
+		m_offscreen_image_memories.clear();
+		m_offscreen_images_allocation.Reset();
+	}
+	else
+	{
+		// the swap chain and surface extensions aren't enabled headless, not even a null handle may be passed to them
+		vkDestroySwapchainKHR(m_logical_device, m_swap_chain, nullptr);
+	}
 	m_swap_chain = VK_NULL_HANDLE;
 	m_swap_chain_images.clear();
 	m_swap_chain_image_format = VK_FORMAT_UNDEFINED;
 	m_swap_chain_extent = VkExtent2D{ 0, 0 };
 }
 
+VkResult GraphicsApi::create_offscreen_images(int width, int height)
+{
+	m_swap_chain_image_format = find_supported_format(
+		m_phys_device_info.device,
+		{ VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB },
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_TRANSFER_SRC_BIT);
+	m_swap_chain_extent = VkExtent2D{ static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height) };
+
+	// One image per frame in flight, so the cpu can record a frame while the previous one is still rendering
+	m_swap_chain_images.resize(m_frames_in_flight, VK_NULL_HANDLE);
+	m_offscreen_image_memories.resize(m_frames_in_flight, VK_NULL_HANDLE);
+	VkDeviceSize images_size = 0;
+	for (std::uint32_t i = 0; i < m_frames_in_flight; ++i)
+	{
+		VkResult result = Create2dImage(
+			m_swap_chain_extent.width,
+			m_swap_chain_extent.height,
+			1 /*layers*/,
+			m_swap_chain_image_format,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			0 /*flags*/,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			m_swap_chain_images[i],
+			m_offscreen_image_memories[i]);
+		if (result != VK_SUCCESS)
+			return result;
+
+		images_size += GetMemorySize(m_swap_chain_images[i]);
+	}
+	m_offscreen_images_allocation = TrackedAllocation{ MemoryCategory::RENDER_TARGET, "offscreen images", images_size };
+	return VK_SUCCESS;
+}
+
 VkResult GraphicsApi::create_swap_chain_framebuffers()
 {
 	m_swap_chain_image_views.resize(m_swap_chain_images.size(), VK_NULL_HANDLE);
@@ -735,53 +1096,124 @@ void GraphicsApi::RecreateSwapChain(int width, int height)
 	if (width == 0 || height == 0)
 		return;
 
-	vkDeviceWaitIdle(m_logical_device);
+	// Offscreen images have a fixed size and never go out of date
+	if (m_headless)
+		return;
 
-	destroy_swap_chain();
+	// No device wait here: the old swap chain is handed to the new one and, together with its image views and
+	// framebuffers, retired through the deletion queue once the frames in flight that reference it have finished.
+	VkSwapchainKHR old_swap_chain = m_swap_chain;
+	std::vector<VkImageView> old_image_views = std::move(m_swap_chain_image_views);
+	std::vector<VkFramebuffer> old_framebuffers = std::move(m_swap_chain_framebuffers);
+	m_swap_chain_image_views.clear();
+	m_swap_chain_framebuffers.clear();
+	m_swap_chain_images.clear();
+	m_swap_chain_extent = VkExtent2D{ 0, 0 };
 
 	m_phys_device_info.sws_details = query_swap_chain_support(m_phys_device_info.device, m_surface);
 
-	m_swap_chain = create_swap_chain(m_phys_device_info, width, height, m_surface, m_logical_device,
-		m_swap_chain_images, m_swap_chain_image_format, m_swap_chain_extent);
+	m_swap_chain = create_swap_chain(m_phys_device_info, width, height, m_surface, m_logical_device, old_swap_chain,
+		m_desired_present_mode, m_swap_chain_images, m_swap_chain_image_format, m_swap_chain_extent, m_present_mode);
+
+	DestroyDeferred(
+		[old_swap_chain, old_image_views = std::move(old_image_views), old_framebuffers = std::move(old_framebuffers)](VkDevice device)
+		{
+			for (auto framebuffer : old_framebuffers)
+				vkDestroyFramebuffer(device, framebuffer, nullptr);
+			for (auto image_view : old_image_views)
+				vkDestroyImageView(device, image_view, nullptr);
+			vkDestroySwapchainKHR(device, old_swap_chain, nullptr);
+		});
+
 	if (m_swap_chain == VK_NULL_HANDLE)
 		return;
 
-	VkResult result = create_depth_resources(m_depth_image, m_depth_image_memory, m_depth_image_view);
-	if (result != VK_SUCCESS)
-		return;
+	// Framebuffer attachments may be larger than the framebuffer, so a depth image that is still big enough is kept
+	bool const depth_image_fits = m_depth_image != VK_NULL_HANDLE
+		&& m_swap_chain_extent.width <= m_depth_extent.width
+		&& m_swap_chain_extent.height <= m_depth_extent.height;
+	if (!depth_image_fits)
+	{
+		DestroyDeferred(
+			[image_view = m_depth_image_view, image = m_depth_image, image_memory = m_depth_image_memory](VkDevice device)
+			{
+				vkDestroyImageView(device, image_view, nullptr);
+				vkDestroyImage(device, image, nullptr);
+				vkFreeMemory(device, image_memory, nullptr);
+			});
+		m_depth_image_view = VK_NULL_HANDLE;
+		m_depth_image = VK_NULL_HANDLE;
+		m_depth_image_memory = VK_NULL_HANDLE;
+		m_depth_extent = VkExtent2D{ 0, 0 };
+		m_depth_allocation.Reset();
+
+		VkResult result = create_depth_resources(m_depth_image, m_depth_image_memory, m_depth_image_view);
+		if (result != VK_SUCCESS)
+			return;
+		m_depth_extent = m_swap_chain_extent;
+		m_depth_allocation = TrackedAllocation{ MemoryCategory::RENDER_TARGET, "depth buffer", GetMemorySize(m_depth_image) };
+	}
 
 	create_swap_chain_framebuffers();
 }
 
 bool GraphicsApi::SwapChainIsValid() const
 {
+	if (m_headless)
+		return !m_swap_chain_framebuffers.empty();
+
 	return m_swap_chain != VK_NULL_HANDLE;
 }
 
-void GraphicsApi::DrawFrame(std::function<void()> render_fn, bool & out_swap_chain_out_of_date)
+void GraphicsApi::DrawFrame(
+	std::function<void()> const & render_fn,
+	std::function<void()> const & late_latch_fn,
+	bool & out_swap_chain_out_of_date)
 {
-	vkWaitForFences(m_logical_device, 1, &m_in_flight_fences[m_current_frame], VK_TRUE, UINT64_MAX);
-
-	VkResult result = vkAcquireNextImageKHR(
-		m_logical_device,
-		m_swap_chain,
-		UINT64_MAX,
-		m_image_available_semaphores[m_current_frame],
-		VK_NULL_HANDLE,
-		&m_current_image_index);
+	ProfileZone zone{ "GraphicsApi::DrawFrame" };
 
-	if (result == VK_ERROR_OUT_OF_DATE_KHR)
+	// the fence and swap chain image waits are where the gpu and the display hold the cpu back
 	{
-		out_swap_chain_out_of_date = true;
-		return;
+		ProfileZone fence_zone{ "wait for frame fence" };
+		std::int64_t const wait_begin_ns = Profiler::Now();
+		vkWaitForFences(m_logical_device, 1, &m_in_flight_fences[m_current_frame], VK_TRUE, UINT64_MAX);
+		FrameStats::Current().m_present_wait_us += static_cast<std::uint64_t>(Profiler::Now() - wait_begin_ns) / 1000;
 	}
-	else if (result == VK_SUBOPTIMAL_KHR)
+
+	process_deletion_queue(false /*flush_all*/);
+	read_frame_timer();
+
+	VkResult result = VK_SUCCESS;
+	if (m_headless)
 	{
-		out_swap_chain_out_of_date = true;
+		m_current_image_index = m_current_frame; // each frame in flight owns its offscreen image
 	}
-	else if (result != VK_SUCCESS)
+	else
 	{
-		throw std::runtime_error("Failed to acquire swap chain image!");
+		ProfileZone acquire_zone{ "acquire swap chain image" };
+		std::int64_t const wait_begin_ns = Profiler::Now();
+		result = vkAcquireNextImageKHR(
+			m_logical_device,
+			m_swap_chain,
+			UINT64_MAX,
+			m_image_available_semaphores[m_current_frame],
+			VK_NULL_HANDLE,
+			&m_current_image_index);
+		FrameStats::Current().m_present_wait_us += static_cast<std::uint64_t>(Profiler::Now() - wait_begin_ns) / 1000;
+
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			out_swap_chain_out_of_date = true;
+			return;
+		}
+		else if (result == VK_SUBOPTIMAL_KHR)
+		{
+			out_swap_chain_out_of_date = true;
+		}
+		else if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to acquire swap chain image!");
+		}
 	}
 
 	// Only reset the fence if we are submitting work
@@ -797,21 +1229,43 @@ void GraphicsApi::DrawFrame(std::function<void()> render_fn, bool & out_swap_cha
 	VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
 	VkSemaphore signal_semaphores[] = { m_render_finished_semaphores[m_current_frame] };
 
+	// Without a swap chain there is nothing to acquire or present, so the fence alone tracks the frame
+	std::uint32_t const semaphore_count = m_headless ? 0 : 1;
+
 	VkSubmitInfo submit_info{
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.waitSemaphoreCount = 1,
+		.waitSemaphoreCount = semaphore_count,
 		.pWaitSemaphores = wait_semaphores,
 		.pWaitDstStageMask = wait_stages,
 		.commandBufferCount = 1,
 		.pCommandBuffers = &m_command_buffers[m_current_frame],
-		.signalSemaphoreCount = 1,
+		.signalSemaphoreCount = semaphore_count,
 		.pSignalSemaphores = signal_semaphores
 	};
 
-	result = vkQueueSubmit(m_graphics_queue, 1, &submit_info, m_in_flight_fences[m_current_frame]);
+	// the uniform buffers are host coherent, so whatever is written until the submit is what the gpu reads
+	if (late_latch_fn)
+	{
+		ProfileZone late_latch_zone{ "late latch" };
+		late_latch_fn();
+	}
+
+	{
+		ProfileZone submit_zone{ "queue submit" };
+		m_frame_submit_time_ns[m_current_frame] = Profiler::Now();
+		result = vkQueueSubmit(m_graphics_queue, 1, &submit_info, m_in_flight_fences[m_current_frame]);
+	}
 	if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to submit draw command buffer!");
 
+	++m_frame_number;
+
+	if (m_headless)
+	{
+		m_current_frame = (m_current_frame + 1) % m_frames_in_flight;
+		return;
+	}
+
 	VkSwapchainKHR swap_chains[] = { m_swap_chain };
 
 	VkPresentInfoKHR present_info{
@@ -823,14 +1277,275 @@ void GraphicsApi::DrawFrame(std::function<void()> render_fn, bool & out_swap_cha
 		.pImageIndices = &m_current_image_index
 	};
 
-	result = vkQueuePresentKHR(m_present_queue, &present_info);
+	{
+		ProfileZone present_zone{ "queue present" };
+		std::int64_t const wait_begin_ns = Profiler::Now();
+		result = vkQueuePresentKHR(m_present_queue, &present_info);
+		FrameStats::Current().m_present_wait_us += static_cast<std::uint64_t>(Profiler::Now() - wait_begin_ns) / 1000;
+	}
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
 		out_swap_chain_out_of_date = true;
 	else if (result != VK_SUCCESS)
 		throw std::runtime_error("Failed to present swap chain image!");
 
-	m_current_frame = (m_current_frame + 1) % m_max_frames_in_flight;
+	m_current_frame = (m_current_frame + 1) % m_frames_in_flight;
+}
+
+void GraphicsApi::DestroyDeferred(DeletionFn deletion_fn) const
+{
+	std::lock_guard lock(m_deletion_queue_mutex);
+	m_deletion_queue.emplace_back(DeferredDeletion{
+		.m_frame_number = m_frame_number.load(),
+		.m_deletion_fn = std::move(deletion_fn)
+		});
+}
+
+VkDeviceSize GraphicsApi::GetMemorySize(VkBuffer buffer) const
+{
+	VkMemoryRequirements mem_requirements;
+	vkGetBufferMemoryRequirements(m_logical_device, buffer, &mem_requirements);
+	return mem_requirements.size;
+}
+
+VkDeviceSize GraphicsApi::GetMemorySize(VkImage image) const
+{
+	VkMemoryRequirements mem_requirements;
+	vkGetImageMemoryRequirements(m_logical_device, image, &mem_requirements);
+	return mem_requirements.size;
+}
+
+std::vector<MemoryHeapBudget> GraphicsApi::GetMemoryHeapBudgets() const
+{
+	VkPhysicalDeviceMemoryProperties const & mem_properties = m_phys_device_info.mem_properties;
+
+	std::vector<MemoryHeapBudget> heaps(mem_properties.memoryHeapCount);
+	for (std::uint32_t i = 0; i < mem_properties.memoryHeapCount; ++i)
+	{
+		heaps[i].m_size = mem_properties.memoryHeaps[i].size;
+		heaps[i].m_device_local = (mem_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+	}
+
+	if (!m_memory_budget_supported)
+		return heaps;
+
+	// Queried every call, the driver updates the budget as other processes allocate
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT
+	};
+	VkPhysicalDeviceMemoryProperties2 mem_properties2{
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+		.pNext = &budget_properties
+	};
+	vkGetPhysicalDeviceMemoryProperties2(m_phys_device_info.device, &mem_properties2);
+
+	for (std::uint32_t i = 0; i < mem_properties.memoryHeapCount; ++i)
+	{
+		heaps[i].m_budget = budget_properties.heapBudget[i];
+		heaps[i].m_usage = budget_properties.heapUsage[i];
+	}
+	return heaps;
+}
+
+void GraphicsApi::process_deletion_queue(bool flush_all)
+{
+	// Frames complete in submission order, so once the fence for the current frame slot has signalled,
+	// every frame submitted at least m_frames_in_flight frames ago is done with its resources.
+	std::uint64_t const frame_number = m_frame_number.load();
+
+	std::vector<DeletionFn> ready;
+	{
+		std::lock_guard lock(m_deletion_queue_mutex);
+		while (!m_deletion_queue.empty())
+		{
+			DeferredDeletion & deletion = m_deletion_queue.front();
+			if (!flush_all && deletion.m_frame_number + m_frames_in_flight > frame_number)
+				break;
+
+			ready.push_back(std::move(deletion.m_deletion_fn));
+			m_deletion_queue.pop_front();
+		}
+	}
+
+	for (DeletionFn const & deletion_fn : ready)
+		deletion_fn(m_logical_device);
+}
+
+VkPipeline GraphicsApi::GetSharedPipelineLibrary(std::string const & key, std::function<VkPipeline()> const & create_fn) const
+{
+	std::lock_guard lock(m_shared_pipeline_libraries_mutex);
+
+	auto iter = m_shared_pipeline_libraries.find(key);
+	if (iter != m_shared_pipeline_libraries.end())
+		return iter->second;
+
+	VkPipeline library = create_fn();
+	if (library != VK_NULL_HANDLE)
+		m_shared_pipeline_libraries.emplace(key, library);
+	return library;
+}
+
+void GraphicsApi::CmdSetRenderState(VkCommandBuffer command_buffer, RenderState const & state) const
+{
+	auto changed = [this, &state]<typename T>(T RenderState::* member)
+		{ return !m_cur_render_state.has_value() || m_cur_render_state.value().*member != state.*member; };
+
+	if (m_dynamic_render_state_support.m_depth_and_cull)
+	{
+		if (changed(&RenderState::m_depth_test_enable))
+			m_cmd_set_depth_test_enable(command_buffer, state.m_depth_test_enable ? VK_TRUE : VK_FALSE);
+		if (changed(&RenderState::m_depth_write_enable))
+			m_cmd_set_depth_write_enable(command_buffer, state.m_depth_write_enable ? VK_TRUE : VK_FALSE);
+		if (changed(&RenderState::m_depth_compare_op))
+			m_cmd_set_depth_compare_op(command_buffer, state.m_depth_compare_op);
+		if (changed(&RenderState::m_cull_mode))
+			m_cmd_set_cull_mode(command_buffer, state.m_cull_mode);
+	}
+	if (m_dynamic_render_state_support.m_polygon_mode && changed(&RenderState::m_polygon_mode))
+		m_cmd_set_polygon_mode(command_buffer, state.m_polygon_mode);
+
+	m_cur_render_state = state;
+}
+
+void GraphicsApi::CmdBeginFrameTimer(VkCommandBuffer command_buffer) const
+{
+	m_pipeline_timer_indices[m_current_frame].clear();
+	if (m_timestamp_query_pool == VK_NULL_HANDLE)
+		return;
+
+	// Queries can only be reset outside a render pass, so the pipeline timers are reset here too
+	std::uint32_t const first_query = m_timestamps_per_frame * m_current_frame;
+	vkCmdResetQueryPool(command_buffer, m_timestamp_query_pool, first_query, m_timestamps_per_frame);
+	if (m_statistics_query_pool != VK_NULL_HANDLE)
+		vkCmdResetQueryPool(command_buffer, m_statistics_query_pool, m_max_pipeline_timers * m_current_frame, m_max_pipeline_timers);
+
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestamp_query_pool, first_query);
+}
+
+void GraphicsApi::CmdEndFrameTimer(VkCommandBuffer command_buffer) const
+{
+	if (m_timestamp_query_pool == VK_NULL_HANDLE)
+		return;
+
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestamp_query_pool, m_timestamps_per_frame * m_current_frame + 1);
+	m_frame_timer_written[m_current_frame] = true;
+}
+
+void GraphicsApi::CmdBeginPipelineTimer(VkCommandBuffer command_buffer, std::uint32_t pipeline_index) const
+{
+	std::vector<std::uint32_t> & indices = m_pipeline_timer_indices[m_current_frame];
+	m_pipeline_timer_open = m_timestamp_query_pool != VK_NULL_HANDLE && indices.size() < m_max_pipeline_timers;
+	if (!m_pipeline_timer_open)
+		return;
+
+	std::uint32_t const timer = static_cast<std::uint32_t>(indices.size());
+	indices.push_back(pipeline_index);
+
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestamp_query_pool,
+		m_timestamps_per_frame * m_current_frame + 2 + 2 * timer);
+	if (m_statistics_query_pool != VK_NULL_HANDLE)
+		vkCmdBeginQuery(command_buffer, m_statistics_query_pool, m_max_pipeline_timers * m_current_frame + timer, 0 /*flags*/);
+}
+
+void GraphicsApi::CmdEndPipelineTimer(VkCommandBuffer command_buffer) const
+{
+	if (!m_pipeline_timer_open)
+		return;
+	m_pipeline_timer_open = false;
+
+	std::uint32_t const timer = static_cast<std::uint32_t>(m_pipeline_timer_indices[m_current_frame].size() - 1);
+
+	if (m_statistics_query_pool != VK_NULL_HANDLE)
+		vkCmdEndQuery(command_buffer, m_statistics_query_pool, m_max_pipeline_timers * m_current_frame + timer);
+	vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestamp_query_pool,
+		m_timestamps_per_frame * m_current_frame + 2 + 2 * timer + 1);
+}
+
+void GraphicsApi::read_frame_timer()
+{
+	if (!m_frame_timer_written[m_current_frame])
+		return;
+	m_frame_timer_written[m_current_frame] = false;
+
+	std::vector<std::uint32_t> const & pipeline_indices = m_pipeline_timer_indices[m_current_frame];
+	std::uint32_t const pipeline_timer_count = static_cast<std::uint32_t>(pipeline_indices.size());
+
+	// The fence for this frame slot has signalled, so the results are available without waiting
+	std::span<std::uint64_t> const timestamps = m_frame_arena.Allocate<std::uint64_t>(2 + 2 * pipeline_timer_count);
+	VkResult result = vkGetQueryPoolResults(
+		m_logical_device,
+		m_timestamp_query_pool,
+		m_timestamps_per_frame * m_current_frame,
+		static_cast<std::uint32_t>(timestamps.size()),
+		timestamps.size() * sizeof(std::uint64_t),
+		timestamps.data(),
+		sizeof(std::uint64_t),
+		VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS)
+		return;
+
+	std::span<std::uint64_t> const statistics = m_frame_arena.Allocate<std::uint64_t>(g_pipeline_statistics_count * pipeline_timer_count);
+	bool has_statistics = false;
+	if (m_statistics_query_pool != VK_NULL_HANDLE && pipeline_timer_count > 0)
+	{
+		result = vkGetQueryPoolResults(
+			m_logical_device,
+			m_statistics_query_pool,
+			m_max_pipeline_timers * m_current_frame,
+			pipeline_timer_count,
+			statistics.size() * sizeof(std::uint64_t),
+			statistics.data(),
+			g_pipeline_statistics_count * sizeof(std::uint64_t),
+			VK_QUERY_RESULT_64_BIT);
+		has_statistics = result == VK_SUCCESS;
+	}
+
+	double const timestamp_period_ns = m_phys_device_info.properties.limits.timestampPeriod;
+	auto to_ms = [timestamp_period_ns](std::uint64_t begin, std::uint64_t end)
+		{
+			return static_cast<double>(end - begin) * timestamp_period_ns / 1'000'000.0;
+		};
+
+	m_last_gpu_frame_time_ms = to_ms(timestamps[0], timestamps[1]);
+
+	m_last_gpu_pipeline_timings.clear();
+	for (std::uint32_t timer = 0; timer < pipeline_timer_count; ++timer)
+	{
+		GpuPipelineTiming timing{
+			.m_pipeline_index = pipeline_indices[timer],
+			.m_time_ms = to_ms(timestamps[2 + 2 * timer], timestamps[2 + 2 * timer + 1])
+		};
+
+		if (has_statistics)
+		{
+			std::uint64_t const * counters = &statistics[g_pipeline_statistics_count * timer];
+			timing.m_statistics = PipelineStatistics{
+				.m_input_assembly_primitives = counters[0],
+				.m_vertex_shader_invocations = counters[1],
+				.m_clipping_primitives = counters[2],
+				.m_fragment_shader_invocations = counters[3]
+			};
+		}
+
+		m_last_gpu_pipeline_timings.push_back(timing);
+	}
+
+	if (Profiler::IsEnabled())
+	{
+		// Gpu and cpu clocks aren't calibrated against each other, the gpu frame is placed at its submit time
+		std::int64_t const submit_ns = m_frame_submit_time_ns[m_current_frame];
+		auto to_trace_ns = [&timestamps, timestamp_period_ns, submit_ns](std::uint64_t timestamp)
+			{
+				return submit_ns + static_cast<std::int64_t>(static_cast<double>(timestamp - timestamps[0]) * timestamp_period_ns);
+			};
+
+		Profiler::RecordGpuZone("gpu frame", -1, to_trace_ns(timestamps[0]), to_trace_ns(timestamps[1]));
+		for (std::uint32_t timer = 0; timer < pipeline_timer_count; ++timer)
+		{
+			Profiler::RecordGpuZone("gpu pipeline", static_cast<int>(pipeline_indices[timer]),
+				to_trace_ns(timestamps[2 + 2 * timer]), to_trace_ns(timestamps[2 + 2 * timer + 1]));
+		}
+	}
 }
 
 void GraphicsApi::WaitForLastFrame() const
@@ -838,6 +1553,102 @@ void GraphicsApi::WaitForLastFrame() const
 	vkDeviceWaitIdle(m_logical_device);
 }
 
+VkResult GraphicsApi::ReadOffscreenImage(std::vector<std::uint8_t> & out_rgba_pixels) const
+{
+	if (!m_headless || m_swap_chain_images.empty())
+		return VK_ERROR_INITIALIZATION_FAILED;
+
+	VkImage image = m_swap_chain_images[m_current_image_index];
+	VkExtent2D extent = m_swap_chain_extent;
+	VkDeviceSize const size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+
+	VkBuffer readback_buffer = VK_NULL_HANDLE;
+	VkDeviceMemory readback_buffer_memory = VK_NULL_HANDLE;
+	VkResult result = CreateBuffer(
+		size,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		readback_buffer,
+		readback_buffer_memory);
+	if (result != VK_SUCCESS)
+		return result;
+	TrackedAllocation readback_allocation{ MemoryCategory::STAGING, "offscreen readback", GetMemorySize(readback_buffer) };
+
+	DoOneTimeCommand([image, extent, readback_buffer](VkCommandBuffer command_buffer)
+		{
+			// The render pass already left the image in TRANSFER_SRC_OPTIMAL, this only orders the copy after the frame's writes
+			VkImageMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = image,
+				.subresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = 0,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1,
+				}
+			};
+
+			vkCmdPipelineBarrier(
+				command_buffer,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0 /*dependencyFlags*/,
+				0 /*memoryBarrierCount*/, nullptr,
+				0 /*bufferMemoryBarrierCount*/, nullptr,
+				1 /*imageMemoryBarrierCount*/, &barrier
+			);
+
+			VkBufferImageCopy region{
+				.bufferOffset = 0,
+				.bufferRowLength = 0,
+				.bufferImageHeight = 0,
+				.imageSubresource{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = 0,
+					.baseArrayLayer = 0,
+					.layerCount = 1,
+				},
+				.imageOffset{ 0, 0, 0 },
+				.imageExtent{ extent.width, extent.height, 1 }
+			};
+
+			vkCmdCopyImageToBuffer(
+				command_buffer,
+				image,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				readback_buffer,
+				1,
+				&region
+			);
+		});
+
+	void * data = nullptr;
+	result = vkMapMemory(m_logical_device, readback_buffer_memory, 0, size, 0, &data);
+	if (result == VK_SUCCESS)
+	{
+		out_rgba_pixels.resize(static_cast<size_t>(size));
+		memcpy(out_rgba_pixels.data(), data, static_cast<size_t>(size));
+		vkUnmapMemory(m_logical_device, readback_buffer_memory);
+
+		if (m_swap_chain_image_format == VK_FORMAT_B8G8R8A8_SRGB)
+		{
+			for (size_t i = 0; i < out_rgba_pixels.size(); i += 4)
+				std::swap(out_rgba_pixels[i], out_rgba_pixels[i + 2]);
+		}
+	}
+
+	vkDestroyBuffer(m_logical_device, readback_buffer, nullptr);
+	vkFreeMemory(m_logical_device, readback_buffer_memory, nullptr);
+
+	return result;
+}
+
 VkResult GraphicsApi::CreateBuffer(
 	VkDeviceSize size,
 	VkBufferUsageFlags usage,
@@ -855,7 +1666,7 @@ VkResult GraphicsApi::CreateBuffer(
 	VkResult result = vkCreateBuffer(m_logical_device, &buffer_info, nullptr, &out_buffer);
 	if (result != VK_SUCCESS)
 	{
-		std::cout << "Failed to create buffer" << std::endl;
+		LogError("Failed to create buffer");
 		return result;
 	}
 
@@ -885,7 +1696,7 @@ VkResult GraphicsApi::CreateBufferMemory(
 	VkResult result = vkAllocateMemory(m_logical_device, &alloc_info, nullptr, &out_buffer_memory);
 	if (result != VK_SUCCESS)
 	{
-		std::cout << "Failed to allocate buffer memory" << std::endl;
+		LogError("Failed to allocate buffer memory");
 		return result;
 	}
 
@@ -927,7 +1738,7 @@ VkResult GraphicsApi::Create2dImage(
 	VkResult result = vkCreateImage(m_logical_device, &image_info, nullptr, &out_image);
 	if (result != VK_SUCCESS)
 	{
-		std::cout << "Failed to create iamge" << std::endl;
+		LogError("Failed to create image");
 		return result;
 	}
 
@@ -957,7 +1768,7 @@ VkResult GraphicsApi::CreateImageMemory(
 	VkResult result = vkAllocateMemory(m_logical_device, &alloc_info, nullptr, &out_image_memory);
 	if (result != VK_SUCCESS)
 	{
-		std::cout << "Failed to allocate image memory" << std::endl;
+		LogError("Failed to allocate image memory");
 		return result;
 	}
 
@@ -994,7 +1805,7 @@ VkResult GraphicsApi::CreateImageView(
 
 	VkResult result = vkCreateImageView(m_logical_device, &create_info, nullptr, &out_image_view);
 	if (result != VK_SUCCESS)
-		std::cout << "Failed to create iamge view" << std::endl;
+		LogError("Failed to create image view");
 
 	return result;
 }
@@ -1029,7 +1840,10 @@ void GraphicsApi::DoOneTimeCommand(std::function<void(VkCommandBuffer)> const &
 	};
 
 	vkQueueSubmit(m_graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-	vkQueueWaitIdle(m_graphics_queue);
+	{
+		ProfileZone wait_zone{ "one time command vkQueueWaitIdle" }; // also waits for every frame in flight
+		vkQueueWaitIdle(m_graphics_queue);
+	}
 
 	vkFreeCommandBuffers(m_logical_device, m_command_pool, 1, &command_buffer);
 }
@@ -1039,6 +1853,9 @@ void GraphicsApi::CopyBuffer(
 	VkBuffer dst_buffer,
 	VkDeviceSize size) const
 {
+	ProfileZone zone{ "upload buffer" };
+	FrameStats::Current().m_upload_bytes += size;
+
 	DoOneTimeCommand([src_buffer, dst_buffer, size](VkCommandBuffer command_buffer)
 		{
 			VkBufferCopy copy_region{
@@ -1053,6 +1870,9 @@ void GraphicsApi::CopyBuffer(
 
 void GraphicsApi::CopyBufferToImage(VkBuffer buffer, VkImage image, std::uint32_t width, std::uint32_t height, std::uint32_t layers) const
 {
+	ProfileZone zone{ "upload image" };
+	FrameStats::Current().m_upload_bytes += std::uint64_t{ 4 } * width * height * layers; // every texture is RGBA8
+
 	DoOneTimeCommand([buffer, image, width, height, layers](VkCommandBuffer command_buffer)
 		{
 			VkBufferImageCopy region{
@@ -1172,23 +1992,13 @@ VkResult GraphicsApi::create_depth_resources(
 	if (result != VK_SUCCESS)
 		return result;
 
-	result = CreateImageView(
+	// No explicit layout transition: the render pass takes the depth attachment from VK_IMAGE_LAYOUT_UNDEFINED,
+	// and a one time command would wait for the graphics queue to go idle in the middle of a resize.
+	return CreateImageView(
 		out_image,
 		VK_IMAGE_VIEW_TYPE_2D,
 		m_depth_format,
 		VK_IMAGE_ASPECT_DEPTH_BIT,
 		1 /*layers*/,
 		out_image_view);
-	if (result != VK_SUCCESS)
-		return result;
-
-	// not technically required
-	TransitionImageLayout(
-		out_image,
-		1 /*layers*/,
-		m_depth_format,
-		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
-
-	return result;
 }
@@ -3,7 +3,11 @@
 module;
 
 #include <array>
+#include <atomic>
+#include <deque>
 #include <functional>
+#include <mutex>
+#include <unordered_map>
 
 #include <vulkan/vulkan.h>
 
@@ -18,6 +22,10 @@ import <optional>;
 import <string>;
 import <vector>;
 
+import AppOptions;
+import FrameArena;
+import MemoryLedger;
+
 struct QueueFamilyIndices
 {
 	std::optional<std::uint32_t> graphics_family;
@@ -42,12 +50,53 @@ struct PhysicalDeviceInfo
 
 	VkPhysicalDeviceMemoryProperties mem_properties;
 	VkPhysicalDeviceProperties properties;
+	VkPhysicalDeviceFeatures features{};
+};
+
+// Counters of a pipeline statistics query
+export struct PipelineStatistics
+{
+	std::uint64_t m_input_assembly_primitives{ 0 };
+	std::uint64_t m_vertex_shader_invocations{ 0 };
+	std::uint64_t m_clipping_primitives{ 0 };
+	std::uint64_t m_fragment_shader_invocations{ 0 };
+};
+
+export struct GpuPipelineTiming
+{
+	std::uint32_t m_pipeline_index{ 0 };
+	double m_time_ms{ 0.0 };
+	std::optional<PipelineStatistics> m_statistics; // empty when the device has no pipelineStatisticsQuery
+};
+
+// Depth and rasterizer state of the draws, see GraphicsApi::CmdSetRenderState()
+export struct RenderState
+{
+	bool m_depth_test_enable{ true };
+	bool m_depth_write_enable{ true };
+	VkCompareOp m_depth_compare_op{ VK_COMPARE_OP_LESS };
+	VkCullModeFlags m_cull_mode{ VK_CULL_MODE_BACK_BIT };
+	VkPolygonMode m_polygon_mode{ VK_POLYGON_MODE_FILL };
+
+	bool operator==(RenderState const &) const = default;
+};
+
+// Which parts of RenderState the pipelines leave dynamic, the rest is baked into each pipeline
+export struct DynamicRenderStateSupport
+{
+	bool m_depth_and_cull{ false }; // VK_EXT_extended_dynamic_state
+	bool m_polygon_mode{ false }; // VK_EXT_extended_dynamic_state3
+	bool m_wireframe{ false }; // fillModeNonSolid, without it wireframe objects are drawn filled
 };
 
 export class GraphicsApi
 {
 public:
-	constexpr static std::uint32_t m_max_frames_in_flight = 2;
+	// per frame resources are created for this many frames, GetFramesInFlight() of them are used
+	constexpr static std::uint32_t m_max_frames_in_flight = FramePacingOptions::m_max_frames_in_flight;
+	constexpr static std::uint32_t m_max_pipeline_timers = 64; // per frame, pipelines past this are not timed
+
+	using DeletionFn = std::function<void(VkDevice)>;
 
 public:
 	GraphicsApi(
@@ -56,14 +105,35 @@ public:
 		int height,
 		std::string const & app_title,
 		std::uint32_t extension_count,
-		char const ** extensions);
+		char const ** extensions,
+		FramePacingOptions const & pacing);
+
+	// Headless: renders into offscreen colour and depth images without a surface or swap chain
+	GraphicsApi(
+		int width,
+		int height,
+		std::string const & app_title,
+		FramePacingOptions const & pacing);
 
 	~GraphicsApi();
 
+	bool IsHeadless() const { return m_headless; }
+
+	// Frames the cpu may record ahead of the gpu, at most m_max_frames_in_flight
+	std::uint32_t GetFramesInFlight() const { return m_frames_in_flight; }
+
+	// The present mode the swap chain was created with, fifo when the requested one isn't supported
+	VkPresentModeKHR GetPresentMode() const { return m_present_mode; }
+
 	void RecreateSwapChain(int width, int height);
 	bool SwapChainIsValid() const;
 
-	void DrawFrame(std::function<void()> render_fn, bool & out_window_size_out_of_date);
+	// late_latch_fn runs after render_fn has recorded the frame, just before it's submitted, to patch constants in the
+	// mapped buffers of the current frame with data as fresh as possible. May be empty
+	void DrawFrame(
+		std::function<void()> const & render_fn,
+		std::function<void()> const & late_latch_fn,
+		bool & out_window_size_out_of_date);
 	void WaitForLastFrame() const;
 
 	VkResult CreateBuffer(
@@ -108,6 +178,50 @@ public:
 	void CopyBufferToImage(VkBuffer buffer, VkImage image, std::uint32_t width, std::uint32_t height, std::uint32_t layers) const;
 	void TransitionImageLayout(VkImage image, std::uint32_t layers, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout) const;
 
+	// Copies the most recently rendered offscreen image into tightly packed RGBA8 pixels, headless only
+	VkResult ReadOffscreenImage(std::vector<std::uint8_t> & out_rgba_pixels) const;
+
+	// Brackets the commands of the current frame with gpu timestamps, read back once the frame's fence has signalled
+	void CmdBeginFrameTimer(VkCommandBuffer command_buffer) const;
+	void CmdEndFrameTimer(VkCommandBuffer command_buffer) const;
+
+	// Brackets one pipeline's draws with timestamps and a pipeline statistics query, inside the frame timer and render pass
+	void CmdBeginPipelineTimer(VkCommandBuffer command_buffer, std::uint32_t pipeline_index) const;
+	void CmdEndPipelineTimer(VkCommandBuffer command_buffer) const;
+
+	// Records the dynamic parts of the state that differ from what the command buffer already has, so pipelines and
+	// draws can set their whole state without paying for the parts that stayed put. Recording a command buffer starts
+	// with ResetRenderState() since nothing is known about its state then
+	void ResetRenderState() const { m_cur_render_state.reset(); }
+	void CmdSetRenderState(VkCommandBuffer command_buffer, RenderState const & state) const;
+	DynamicRenderStateSupport const & GetDynamicRenderStateSupport() const { return m_dynamic_render_state_support; }
+
+	// VK_EXT_graphics_pipeline_library with fast linking, pipelines are linked from parts instead of compiled whole
+	bool SupportsPipelineLibraries() const { return m_pipeline_library_supported; }
+
+	// Library parts every pipeline built from the same state can share, e.g. the vertex input of a vertex type.
+	// create_fn makes the part the first time its key is asked for, it's destroyed with the device
+	VkPipeline GetSharedPipelineLibrary(std::string const & key, std::function<VkPipeline()> const & create_fn) const;
+
+	// Gpu time of the most recently completed frame, lags the cpu by up to GetFramesInFlight() frames
+	std::optional<double> GetLastGpuFrameTime() const { return m_last_gpu_frame_time_ms; }
+
+	// Per pipeline results of the same frame as GetLastGpuFrameTime(), in the order they were recorded
+	std::vector<GpuPipelineTiming> const & GetLastGpuPipelineTimings() const { return m_last_gpu_pipeline_timings; }
+
+	// Bytes of device memory backing a buffer or image, as recorded in the memory ledger
+	VkDeviceSize GetMemorySize(VkBuffer buffer) const;
+	VkDeviceSize GetMemorySize(VkImage image) const;
+
+	// Size of every memory heap, with the budget and usage when VK_EXT_memory_budget is supported
+	std::vector<MemoryHeapBudget> GetMemoryHeapBudgets() const;
+
+	// Scratch memory for the cpu side of the current frame, the frame loop rewinds it at the start of every frame
+	FrameArena & GetFrameArena() const { return m_frame_arena; }
+
+	// Destroys the resources once every frame in flight that may still reference them has finished on the gpu
+	void DestroyDeferred(DeletionFn deletion_fn) const;
+
 	VkDevice GetDevice() const { return m_logical_device; }
 	VkFormat GetSwapChainImageFormat() const { return m_swap_chain_image_format; }
 	VkExtent2D GetSwapChainExtent() const { return m_swap_chain_extent; }
@@ -120,7 +234,11 @@ public:
 	PhysicalDeviceInfo const & GetPhysicalDeviceInfo() const { return m_phys_device_info; }
 
 private:
+	void init_device(int width, int height);
+	void load_dynamic_render_state_commands();
+
 	void destroy_swap_chain();
+	VkResult create_offscreen_images(int width, int height);
 
 	VkResult create_swap_chain_framebuffers();
 	void destroy_swap_chain_framebuffers();
@@ -130,9 +248,20 @@ private:
 		VkDeviceMemory & out_image_memory,
 		VkImageView & out_image_view) const;
 
+	void process_deletion_queue(bool flush_all);
+	void read_frame_timer();
+
 private:
+	struct DeferredDeletion
+	{
+		std::uint64_t m_frame_number{ 0 };
+		DeletionFn m_deletion_fn;
+	};
+
+	bool m_headless{ false };
+
 	VkInstance m_instance{ VK_NULL_HANDLE };
-	VkSurfaceKHR m_surface{ VK_NULL_HANDLE };
+	VkSurfaceKHR m_surface{ VK_NULL_HANDLE }; // null when headless
 
 	PhysicalDeviceInfo m_phys_device_info; // Automatically cleaned up when m_instance is destroyed
 	VkDevice m_logical_device{ VK_NULL_HANDLE };
@@ -142,10 +271,14 @@ private:
 	VkSwapchainKHR m_swap_chain{ VK_NULL_HANDLE };
 	VkFormat m_swap_chain_image_format{ VK_FORMAT_UNDEFINED };
 	VkExtent2D m_swap_chain_extent{ 0, 0 };
-	std::vector<VkImage> m_swap_chain_images; // Automatically cleaned up when m_swap_chain is destroyed
+	std::vector<VkImage> m_swap_chain_images; // Automatically cleaned up when m_swap_chain is destroyed, offscreen images when headless
+	std::vector<VkDeviceMemory> m_offscreen_image_memories; // headless only, one per entry in m_swap_chain_images
+	TrackedAllocation m_offscreen_images_allocation;
 	std::vector<VkImageView> m_swap_chain_image_views;
 	std::vector<VkFramebuffer> m_swap_chain_framebuffers;
 	std::uint32_t m_current_image_index = 0;
+	VkPresentModeKHR m_desired_present_mode{ VK_PRESENT_MODE_FIFO_KHR };
+	VkPresentModeKHR m_present_mode{ VK_PRESENT_MODE_FIFO_KHR };
 
 	VkRenderPass m_render_pass{ VK_NULL_HANDLE };
 
@@ -153,6 +286,8 @@ private:
 	VkImage m_depth_image{ VK_NULL_HANDLE };
 	VkDeviceMemory m_depth_image_memory{ VK_NULL_HANDLE };
 	VkImageView m_depth_image_view{ VK_NULL_HANDLE };
+	VkExtent2D m_depth_extent{ 0, 0 }; // may be larger than the swap chain extent after shrinking
+	TrackedAllocation m_depth_allocation;
 
 	VkCommandPool m_command_pool{ VK_NULL_HANDLE };
 	std::array<VkCommandBuffer, m_max_frames_in_flight> m_command_buffers; // Automatically cleaned up when m_comand_pool is destroyed
@@ -161,11 +296,43 @@ private:
 	std::array<VkSemaphore, m_max_frames_in_flight> m_render_finished_semaphores;
 	std::array<VkFence, m_max_frames_in_flight> m_in_flight_fences;
 
+	constexpr static std::uint32_t m_timestamps_per_frame = 2 + 2 * m_max_pipeline_timers; // frame pair, then a pair per pipeline
+
+	VkQueryPool m_timestamp_query_pool{ VK_NULL_HANDLE }; // m_timestamps_per_frame per frame in flight, null if unsupported
+	VkQueryPool m_statistics_query_pool{ VK_NULL_HANDLE }; // m_max_pipeline_timers per frame in flight, null if unsupported
+	mutable std::array<bool, m_max_frames_in_flight> m_frame_timer_written{};
+	mutable std::array<std::vector<std::uint32_t>, m_max_frames_in_flight> m_pipeline_timer_indices; // pipeline of each timer written
+	mutable bool m_pipeline_timer_open{ false };
+	std::array<std::int64_t, m_max_frames_in_flight> m_frame_submit_time_ns{}; // anchors the gpu zones in the profiler trace
+	std::optional<double> m_last_gpu_frame_time_ms;
+	std::vector<GpuPipelineTiming> m_last_gpu_pipeline_timings;
+
+	mutable FrameArena m_frame_arena;
+
+	std::uint32_t m_frames_in_flight{ 2 };
 	std::uint32_t m_current_frame = 0;
+	std::atomic<std::uint64_t> m_frame_number{ 0 }; // number of frames submitted so far
+
+	mutable std::mutex m_deletion_queue_mutex;
+	mutable std::deque<DeferredDeletion> m_deletion_queue;
 
-	std::vector<const char *> const m_device_extensions = {
+	std::vector<const char *> m_device_extensions = {
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME
 	};
+	bool m_memory_budget_supported{ false }; // VK_EXT_memory_budget is optional, enabled when the device has it
+
+	// VK_EXT_extended_dynamic_state(3) are optional too, their commands are loaded when enabled
+	DynamicRenderStateSupport m_dynamic_render_state_support;
+	PFN_vkCmdSetDepthTestEnableEXT m_cmd_set_depth_test_enable{ nullptr };
+	PFN_vkCmdSetDepthWriteEnableEXT m_cmd_set_depth_write_enable{ nullptr };
+	PFN_vkCmdSetDepthCompareOpEXT m_cmd_set_depth_compare_op{ nullptr };
+	PFN_vkCmdSetCullModeEXT m_cmd_set_cull_mode{ nullptr };
+	PFN_vkCmdSetPolygonModeEXT m_cmd_set_polygon_mode{ nullptr };
+	mutable std::optional<RenderState> m_cur_render_state; // of the command buffer being recorded, empty when unknown
+
+	bool m_pipeline_library_supported{ false }; // VK_EXT_graphics_pipeline_library is optional as well
+	mutable std::mutex m_shared_pipeline_libraries_mutex;
+	mutable std::unordered_map<std::string, VkPipeline> m_shared_pipeline_libraries;
 
 	std::vector<char const *> const m_validation_layers = {
 		"VK_LAYER_KHRONOS_validation"
@@ -3,13 +3,19 @@
 module;
 
 #include <algorithm>
-#include <iostream>
+#include <chrono>
+#include <future>
+#include <span>
+#include <string>
+#include <utility>
 
 #include <vulkan/vulkan.h>
 
 module GraphicsPipeline;
 
 import GraphicsApi;
+import Log;
+import Profiler;
 
 namespace
 {
@@ -29,7 +35,7 @@ namespace
 		VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
 		VkResult result = vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pipeline_layout);
 		if (result != VK_SUCCESS)
-			std::cout << "Failed to create pipeline layout" << std::endl;
+			LogError("Failed to create pipeline layout");
 
 		return pipeline_layout;
 	}
@@ -38,16 +44,32 @@ namespace
 		VkDevice device,
 		VkRenderPass render_pass,
 		VkPipelineLayout pipeline_layout,
-		std::vector<VkPipelineShaderStageCreateInfo> const & shader_stages,
+		std::span<VkPipelineShaderStageCreateInfo const> shader_stages,
 		VkVertexInputBindingDescription const & binding_desc,
 		std::vector<VkVertexInputAttributeDescription> const & attrib_descs,
-		DepthTestOptions const & depth_options)
+		RenderState const & render_state,
+		DynamicRenderStateSupport const & dynamic_support,
+		BlendOptions const & blend_options,
+		VkGraphicsPipelineLibraryFlagsEXT library_part = 0) // a whole pipeline when 0
 	{
 		std::vector<VkDynamicState> dynamic_states = {
 			VK_DYNAMIC_STATE_VIEWPORT,
 			VK_DYNAMIC_STATE_SCISSOR
 		};
 
+		// the static values below are ignored for the states that are dynamic, GraphicsApi::CmdSetRenderState() sets those
+		if (dynamic_support.m_depth_and_cull)
+		{
+			dynamic_states.insert(dynamic_states.end(), {
+				VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT,
+				VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT,
+				VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT,
+				VK_DYNAMIC_STATE_CULL_MODE_EXT
+			});
+		}
+		if (dynamic_support.m_polygon_mode)
+			dynamic_states.push_back(VK_DYNAMIC_STATE_POLYGON_MODE_EXT);
+
 		VkPipelineDynamicStateCreateInfo dynamic_state{
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
 			.dynamicStateCount = static_cast<std::uint32_t>(dynamic_states.size()),
@@ -78,8 +100,8 @@ namespace
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
 			.depthClampEnable = VK_FALSE,
 			.rasterizerDiscardEnable = VK_FALSE,
-			.polygonMode = VK_POLYGON_MODE_FILL,
-			.cullMode = VK_CULL_MODE_BACK_BIT,
+			.polygonMode = render_state.m_polygon_mode,
+			.cullMode = render_state.m_cull_mode,
 			.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
 			.depthBiasEnable = VK_FALSE,
 			.depthBiasConstantFactor = 0.0f,
@@ -98,21 +120,15 @@ namespace
 			.alphaToOneEnable = VK_FALSE
 		};
 
+		bool const alpha_blending = blend_options.m_enable_alpha_blending;
 		VkPipelineColorBlendAttachmentState color_blend_attachment{ // per framebuffer blending options
-			.blendEnable = VK_FALSE,
-			.srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
-			.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+			.blendEnable = alpha_blending ? VK_TRUE : VK_FALSE,
+			.srcColorBlendFactor = alpha_blending ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE,
+			.dstColorBlendFactor = alpha_blending ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO,
 			.colorBlendOp = VK_BLEND_OP_ADD,
 			.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
 			.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
 			.alphaBlendOp = VK_BLEND_OP_ADD,
-			//.blendEnable = VK_TRUE,
-			//.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
-			//.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
-			//.colorBlendOp = VK_BLEND_OP_ADD,
-			//.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-			//.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-			//.alphaBlendOp = VK_BLEND_OP_ADD,
 			.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
 		};
 
@@ -127,15 +143,25 @@ namespace
 
 		VkPipelineDepthStencilStateCreateInfo depth_stencil{
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-			.depthTestEnable = depth_options.m_enable_depth_test ? VK_TRUE : VK_FALSE,
-			.depthWriteEnable = depth_options.m_enable_depth_write ? VK_TRUE : VK_FALSE,
-			.depthCompareOp = static_cast<VkCompareOp>(depth_options.m_depth_compare_op),
+			.depthTestEnable = render_state.m_depth_test_enable ? VK_TRUE : VK_FALSE,
+			.depthWriteEnable = render_state.m_depth_write_enable ? VK_TRUE : VK_FALSE,
+			.depthCompareOp = render_state.m_depth_compare_op,
 			.depthBoundsTestEnable = VK_FALSE,
 			.stencilTestEnable = VK_FALSE
 		};
 
+		// a library part only takes the state that belongs to it, the rest is ignored
+		VkGraphicsPipelineLibraryCreateInfoEXT library_info{
+			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+			.flags = library_part
+		};
+
 		VkGraphicsPipelineCreateInfo pipeline_info{
 			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+			.pNext = library_part != 0 ? &library_info : nullptr,
+			.flags = library_part != 0
+				? VkPipelineCreateFlags{ VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT }
+				: VkPipelineCreateFlags{ 0 },
 			.stageCount = static_cast<std::uint32_t>(shader_stages.size()),
 			.pStages = shader_stages.data(),
 			.pVertexInputState = &vertex_input_info,
@@ -153,14 +179,54 @@ namespace
 			.basePipelineIndex = -1
 		};
 
+		ProfileZone zone{ "vkCreateGraphicsPipelines" }; // shaders are compiled here, possibly for seconds without a cache
+
+		VkPipeline graphics_pipeline = VK_NULL_HANDLE;
+		VkResult result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &graphics_pipeline);
+		if (result != VK_SUCCESS)
+			LogError("Failed to create graphics pipeline");
+
+		return graphics_pipeline;
+	}
+
+	VkPipeline link_graphics_pipeline(
+		VkDevice device,
+		VkPipelineLayout pipeline_layout,
+		std::span<VkPipeline const> library_parts,
+		bool optimize)
+	{
+		VkPipelineLibraryCreateInfoKHR library_info{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+			.libraryCount = static_cast<std::uint32_t>(library_parts.size()),
+			.pLibraries = library_parts.data()
+		};
+
+		VkGraphicsPipelineCreateInfo pipeline_info{
+			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+			.pNext = &library_info,
+			.flags = optimize ? VkPipelineCreateFlags{ VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT } : VkPipelineCreateFlags{ 0 },
+			.layout = pipeline_layout,
+			.basePipelineHandle = VK_NULL_HANDLE,
+			.basePipelineIndex = -1
+		};
+
+		ProfileZone zone{ optimize ? "optimized pipeline link" : "fast pipeline link" };
+
 		VkPipeline graphics_pipeline = VK_NULL_HANDLE;
 		VkResult result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &graphics_pipeline);
 		if (result != VK_SUCCESS)
-			std::cout << "Failed to create graphics pipeline" << std::endl;
+			LogError("Failed to link graphics pipeline");
 
 		return graphics_pipeline;
 	}
 
+	// The description structs are plain 32-bit fields, so their bytes make an exact key
+	template <typename T>
+	void append_key(std::string & key, std::span<T const> values)
+	{
+		key.append(reinterpret_cast<char const *>(values.data()), values.size_bytes());
+	}
+
 	VkDescriptorSetLayout create_descriptor_set_layout(
 		VkDevice device,
 		std::uint32_t vs_descriptor_set_count,
@@ -214,7 +280,7 @@ namespace
 		VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
 		VkResult result = vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &descriptor_set_layout);
 		if (result != VK_SUCCESS)
-			std::cout << "Failed to create ubo descriptor set layout";
+			LogError("Failed to create ubo descriptor set layout");
 
 		return descriptor_set_layout;
 	}
@@ -222,12 +288,16 @@ namespace
 	VkDescriptorPool create_descriptor_pool(VkDevice device,
 		std::uint32_t uniform_count, std::uint32_t descriptor_set_count, bool has_texture)
 	{
-		std::vector<VkDescriptorPoolSize> pool_sizes{
-			VkDescriptorPoolSize{
-				.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				.descriptorCount = uniform_count * descriptor_set_count
-			}
-		};
+		std::vector<VkDescriptorPoolSize> pool_sizes;
+
+		if (uniform_count > 0) // pool sizes must not be empty
+		{
+			pool_sizes.emplace_back(
+				VkDescriptorPoolSize{
+					.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+					.descriptorCount = uniform_count * descriptor_set_count
+				});
+		}
 
 		if (has_texture)
 		{
@@ -379,11 +449,17 @@ GraphicsPipeline::GraphicsPipeline(GraphicsApi const & graphics_api,
 	std::vector<VkDeviceSize> fs_uniform_sizes,
 	Texture const * texture,
 	DepthTestOptions const & depth_options,
+	BlendOptions const & blend_options,
 	PerFrameConstantsCallback per_frame_constants_callback,
-	PerObjectConstantsCallback per_object_constants_callback)
+	DrawObjectsFn draw_objects)
 	: m_graphics_api(graphics_api)
 	, m_per_frame_constants_callback(per_frame_constants_callback)
-	, m_per_object_constants_callback(per_object_constants_callback)
+	, m_draw_objects(draw_objects)
+	, m_has_texture(texture != nullptr)
+	, m_render_state{
+		.m_depth_test_enable = depth_options.m_enable_depth_test,
+		.m_depth_write_enable = depth_options.m_enable_depth_write,
+		.m_depth_compare_op = static_cast<VkCompareOp>(depth_options.m_depth_compare_op) }
 {
 	VkDevice device = m_graphics_api.GetDevice();
 
@@ -401,6 +477,7 @@ GraphicsPipeline::GraphicsPipeline(GraphicsApi const & graphics_api,
 		texture != nullptr);
 
 	std::array<std::vector<VkBuffer>, GraphicsApi::m_max_frames_in_flight> uniform_buffers;
+	VkDeviceSize uniform_memory_size = 0;
 	for (size_t frame = 0; frame < GraphicsApi::m_max_frames_in_flight; ++frame)
 	{
 		m_descriptor_sets[frame].m_uniform_buffers.resize(uniform_sizes.size());
@@ -410,8 +487,10 @@ GraphicsPipeline::GraphicsPipeline(GraphicsApi const & graphics_api,
 			create_uniform_buffer(m_graphics_api, uniform_sizes[binding],
 				uniform.m_buffer, uniform.m_memory, uniform.m_mapping);
 			uniform_buffers[frame].push_back(uniform.m_buffer);
+			uniform_memory_size += m_graphics_api.GetMemorySize(uniform.m_buffer);
 		}
 	}
+	m_uniform_allocation = TrackedAllocation{ MemoryCategory::UNIFORM_BUFFER, "pipeline uniforms", uniform_memory_size };
 
 	std::array<VkDescriptorSet, GraphicsApi::m_max_frames_in_flight> descriptor_sets
 		= create_descriptor_sets<GraphicsApi::m_max_frames_in_flight>(device,
@@ -443,14 +522,70 @@ GraphicsPipeline::GraphicsPipeline(GraphicsApi const & graphics_api,
 		frag_shader_stage_info
 	};
 
-	m_graphics_pipeline = create_graphics_pipeline(
-		device,
-		m_graphics_api.GetRenderPass(),
-		m_pipeline_layout,
-		shader_stages,
-		binding_desc,
-		attrib_descs,
-		depth_options);
+	DynamicRenderStateSupport const & dynamic_support = m_graphics_api.GetDynamicRenderStateSupport();
+
+	// Without a dynamic polygon mode wireframe objects need a permutation of their own. Built up front since the
+	// shader modules are gone by the time an object turns wireframe
+	bool const wireframe_permutation = dynamic_support.m_wireframe && !dynamic_support.m_polygon_mode;
+	RenderState wireframe_state{ m_render_state };
+	wireframe_state.m_polygon_mode = VK_POLYGON_MODE_LINE;
+
+	auto create_part = [&](VkGraphicsPipelineLibraryFlagsEXT library_part, VkPipelineLayout pipeline_layout,
+		std::span<VkPipelineShaderStageCreateInfo const> stages, RenderState const & render_state)
+		{
+			return create_graphics_pipeline(device, m_graphics_api.GetRenderPass(), pipeline_layout, stages,
+				binding_desc, attrib_descs, render_state, dynamic_support, blend_options, library_part);
+		};
+
+	if (!m_graphics_api.SupportsPipelineLibraries())
+	{
+		m_graphics_pipeline = create_part(0 /*whole pipeline*/, m_pipeline_layout, shader_stages, m_render_state);
+		if (m_graphics_pipeline != VK_NULL_HANDLE && wireframe_permutation)
+			m_wireframe_pipeline = create_part(0 /*whole pipeline*/, m_pipeline_layout, shader_stages, wireframe_state);
+		return;
+	}
+
+	// The parts that don't depend on the shaders are shared by every pipeline with the same vertex type or blending
+	std::string vertex_input_key{ "vertex input" };
+	append_key(vertex_input_key, std::span{ &binding_desc, 1 });
+	append_key(vertex_input_key, std::span{ attrib_descs });
+	VkPipeline const vertex_input = m_graphics_api.GetSharedPipelineLibrary(vertex_input_key, [&]()
+		{ return create_part(VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT, VK_NULL_HANDLE, {}, m_render_state); });
+
+	std::string const fragment_output_key{ blend_options.m_enable_alpha_blending ? "fragment output, alpha blended" : "fragment output" };
+	VkPipeline const fragment_output = m_graphics_api.GetSharedPipelineLibrary(fragment_output_key, [&]()
+		{ return create_part(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT, VK_NULL_HANDLE, {}, m_render_state); });
+
+	m_library_parts = {
+		create_part(VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, m_pipeline_layout, { &vert_shader_stage_info, 1 }, m_render_state),
+		create_part(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, m_pipeline_layout, { &frag_shader_stage_info, 1 }, m_render_state)
+	};
+	if (wireframe_permutation)
+		m_library_parts.push_back(create_part(VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, m_pipeline_layout, { &vert_shader_stage_info, 1 }, wireframe_state));
+
+	if (vertex_input == VK_NULL_HANDLE || fragment_output == VK_NULL_HANDLE
+		|| std::ranges::find(m_library_parts, VK_NULL_HANDLE) != m_library_parts.end())
+	{
+		return;
+	}
+
+	std::array<VkPipeline, 4> const parts{ vertex_input, m_library_parts[0], m_library_parts[1], fragment_output };
+	std::array<VkPipeline, 4> const wireframe_parts{ vertex_input, wireframe_permutation ? m_library_parts[2] : VK_NULL_HANDLE, m_library_parts[1], fragment_output };
+
+	// Linking the parts as they are is near instant, so the pipeline can draw right away. The optimized link runs in
+	// the background and takes over on the first Activate() after it's done
+	m_graphics_pipeline = link_graphics_pipeline(device, m_pipeline_layout, parts, false /*optimize*/);
+	if (wireframe_permutation)
+		m_wireframe_pipeline = link_graphics_pipeline(device, m_pipeline_layout, wireframe_parts, false /*optimize*/);
+
+	m_optimized_link = std::async(std::launch::async,
+		[device, pipeline_layout = m_pipeline_layout, parts, wireframe_parts, wireframe_permutation]()
+		{
+			return std::array<VkPipeline, 2>{
+				link_graphics_pipeline(device, pipeline_layout, parts, true /*optimize*/),
+				wireframe_permutation ? link_graphics_pipeline(device, pipeline_layout, wireframe_parts, true /*optimize*/) : VK_NULL_HANDLE
+			};
+		});
 }
 
 GraphicsPipeline::~GraphicsPipeline()
@@ -460,22 +595,56 @@ GraphicsPipeline::~GraphicsPipeline()
 
 void GraphicsPipeline::destroy_pipeline()
 {
-	VkDevice device = m_graphics_api.GetDevice();
+	if (m_graphics_pipeline == VK_NULL_HANDLE && m_pipeline_layout == VK_NULL_HANDLE
+		&& m_descriptor_set_layout == VK_NULL_HANDLE && m_descriptor_pool == VK_NULL_HANDLE)
+	{
+		return; // nothing to destroy, e.g. moved from
+	}
 
+	// an optimized link that's still running reads the library parts
+	std::array<VkPipeline, 2> optimized_pipelines{};
+	if (m_optimized_link.valid())
+		optimized_pipelines = m_optimized_link.get();
+
+	std::vector<UniformBuffer> uniform_buffers;
 	for (DescriptorSet & descriptor_set : m_descriptor_sets)
 	{
-		for (UniformBuffer & uniform : descriptor_set.m_uniform_buffers)
-		{
-			vkDestroyBuffer(device, uniform.m_buffer, nullptr);
-			vkFreeMemory(device, uniform.m_memory, nullptr);
-		}
+		uniform_buffers.insert(uniform_buffers.end(),
+			descriptor_set.m_uniform_buffers.begin(), descriptor_set.m_uniform_buffers.end());
 	}
 
-	vkDestroyDescriptorPool(device, m_descriptor_pool, nullptr);
-	vkDestroyDescriptorSetLayout(device, m_descriptor_set_layout, nullptr);
+	m_graphics_api.DestroyDeferred(
+		[uniform_buffers = std::move(uniform_buffers),
+		descriptor_pool = m_descriptor_pool, descriptor_set_layout = m_descriptor_set_layout,
+		graphics_pipeline = m_graphics_pipeline, wireframe_pipeline = m_wireframe_pipeline, optimized_pipelines,
+		library_parts = std::move(m_library_parts), pipeline_layout = m_pipeline_layout](VkDevice device)
+		{
+			for (UniformBuffer const & uniform : uniform_buffers)
+			{
+				vkDestroyBuffer(device, uniform.m_buffer, nullptr);
+				vkFreeMemory(device, uniform.m_memory, nullptr); // implicitly unmaps
+			}
 
-	vkDestroyPipeline(device, m_graphics_pipeline, nullptr);
-	vkDestroyPipelineLayout(device, m_pipeline_layout, nullptr);
+			vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+			vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
+
+			vkDestroyPipeline(device, graphics_pipeline, nullptr);
+			vkDestroyPipeline(device, wireframe_pipeline, nullptr);
+			for (VkPipeline pipeline : optimized_pipelines)
+				vkDestroyPipeline(device, pipeline, nullptr);
+			for (VkPipeline library_part : library_parts)
+				vkDestroyPipeline(device, library_part, nullptr);
+			vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+		});
+
+	m_descriptor_sets.fill(DescriptorSet{});
+	m_uniform_allocation.Reset();
+	m_descriptor_pool = VK_NULL_HANDLE;
+	m_descriptor_set_layout = VK_NULL_HANDLE;
+	m_graphics_pipeline = VK_NULL_HANDLE;
+	m_wireframe_pipeline = VK_NULL_HANDLE;
+	m_library_parts.clear();
+	m_pipeline_layout = VK_NULL_HANDLE;
 }
 
 GraphicsPipeline::GraphicsPipeline(GraphicsPipeline && other)
@@ -492,20 +661,28 @@ GraphicsPipeline & GraphicsPipeline::operator=(GraphicsPipeline && other)
 	destroy_pipeline();
 
 	m_graphics_pipeline = other.m_graphics_pipeline;
+	m_wireframe_pipeline = other.m_wireframe_pipeline;
+	m_library_parts = std::move(other.m_library_parts);
+	m_optimized_link = std::move(other.m_optimized_link);
 	m_pipeline_layout = other.m_pipeline_layout;
 	m_descriptor_set_layout = other.m_descriptor_set_layout;
 	m_descriptor_pool = other.m_descriptor_pool;
 	m_descriptor_sets = std::move(other.m_descriptor_sets);
+	m_uniform_allocation = std::move(other.m_uniform_allocation);
 	m_per_frame_constants_callback = other.m_per_frame_constants_callback;
-	m_per_object_constants_callback = other.m_per_object_constants_callback;
+	m_draw_objects = other.m_draw_objects;
+	m_has_texture = other.m_has_texture;
+	m_render_state = other.m_render_state;
 
 	other.m_graphics_pipeline = VK_NULL_HANDLE;
+	other.m_wireframe_pipeline = VK_NULL_HANDLE;
+	other.m_library_parts.clear();
 	other.m_pipeline_layout = VK_NULL_HANDLE;
 	other.m_descriptor_set_layout = VK_NULL_HANDLE;
 	other.m_descriptor_pool = VK_NULL_HANDLE;
 	other.m_descriptor_sets.fill(DescriptorSet{});
 	other.m_per_frame_constants_callback = nullptr;
-	other.m_per_object_constants_callback = nullptr;
+	other.m_draw_objects = MakeDrawObjectsFn();
 
 	return *this;
 }
@@ -514,13 +691,17 @@ void GraphicsPipeline::Activate() const
 {
 	if (m_graphics_pipeline == VK_NULL_HANDLE)
 	{
-		std::cout << "Activating invalid graphics pipeline" << std::endl;
+		LogError("Activating invalid graphics pipeline");
 		return;
 	}
 
+	adopt_optimized_link();
+
 	VkCommandBuffer command_buffer = m_graphics_api.GetCurCommandBuffer();
 
 	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphics_pipeline);
+	m_graphics_api.CmdSetRenderState(command_buffer, m_render_state);
+	m_wireframe_active = false;
 
 	vkCmdBindDescriptorSets(command_buffer,
 		VK_PIPELINE_BIND_POINT_GRAPHICS,
@@ -530,16 +711,59 @@ void GraphicsPipeline::Activate() const
 		&m_descriptor_sets[m_graphics_api.GetCurFrameIndex()].m_descriptor_set,
 		0 /*dynamicOffsetCount*/,
 		nullptr);
+
+	RenderStats & stats = FrameStats::Current();
+	stats.m_pipeline_binds += 1;
+	if (m_has_texture)
+		stats.m_texture_binds += 1;
 }
 
-void GraphicsPipeline::UpdatePerFrameConstants() const
+void GraphicsPipeline::adopt_optimized_link() const
 {
-	if (m_per_frame_constants_callback)
-		m_per_frame_constants_callback(*this);
+	if (!m_optimized_link.valid() || m_optimized_link.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready)
+		return;
+
+	// a link that failed leaves the fast one in place
+	std::array<VkPipeline, 2> const optimized_pipelines = m_optimized_link.get();
+	std::array<VkPipeline, 2> replaced_pipelines{};
+	if (optimized_pipelines[0] != VK_NULL_HANDLE)
+		replaced_pipelines[0] = std::exchange(m_graphics_pipeline, optimized_pipelines[0]);
+	if (optimized_pipelines[1] != VK_NULL_HANDLE)
+		replaced_pipelines[1] = std::exchange(m_wireframe_pipeline, optimized_pipelines[1]);
+
+	m_graphics_api.DestroyDeferred([replaced_pipelines](VkDevice device)
+		{
+			for (VkPipeline pipeline : replaced_pipelines)
+				vkDestroyPipeline(device, pipeline, nullptr);
+		});
+}
+
+void GraphicsPipeline::set_wireframe(bool wireframe) const
+{
+	if (wireframe == m_wireframe_active)
+		return;
+
+	DynamicRenderStateSupport const & dynamic_support = m_graphics_api.GetDynamicRenderStateSupport();
+	if (!dynamic_support.m_polygon_mode && m_wireframe_pipeline == VK_NULL_HANDLE)
+		return;
+	m_wireframe_active = wireframe;
+
+	VkCommandBuffer command_buffer = m_graphics_api.GetCurCommandBuffer();
+	if (dynamic_support.m_polygon_mode)
+	{
+		RenderState state{ m_render_state };
+		state.m_polygon_mode = wireframe ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+		m_graphics_api.CmdSetRenderState(command_buffer, state);
+		return;
+	}
+
+	// the permutation shares the layout, so the bound descriptor set and push constants stay valid
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, wireframe ? m_wireframe_pipeline : m_graphics_pipeline);
+	FrameStats::Current().m_pipeline_binds += 1;
 }
 
-void GraphicsPipeline::UpdatePerObjectConstants(RenderObject const & obj) const
+void GraphicsPipeline::UpdatePerFrameConstants() const
 {
-	if (m_per_object_constants_callback)
-		m_per_object_constants_callback(*this, obj);
+	if (m_per_frame_constants_callback)
+		m_per_frame_constants_callback(*this);
 }
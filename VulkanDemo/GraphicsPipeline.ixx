@@ -3,15 +3,21 @@
 module;
 
 #include <array>
+#include <concepts>
 #include <functional>
+#include <future>
 #include <optional>
+#include <span>
 
 #include <vulkan/vulkan.h>
 
 export module GraphicsPipeline;
 
 import GraphicsApi;
-import RenderObject;
+import MemoryLedger;
+import Mesh;
+import RenderPacket;
+import RenderStats;
 import Texture;
 
 struct UniformBuffer
@@ -19,6 +25,7 @@ struct UniformBuffer
 	VkBuffer m_buffer{ VK_NULL_HANDLE };
 	VkDeviceMemory m_memory{ VK_NULL_HANDLE };
 	void * m_mapping{ nullptr };
+	mutable std::uint64_t m_version{ 0 }; // of the constants last copied in, 0 when unknown
 };
 
 struct DescriptorSet
@@ -46,11 +53,36 @@ export struct DepthTestOptions
 	DepthCompareOp m_depth_compare_op{ DepthCompareOp::LESS };
 };
 
+export struct BlendOptions
+{
+	bool m_enable_alpha_blending{ false }; // src * src_alpha + dst * (1 - src_alpha)
+};
+
+// A block of per-object push constants, laid out like the shader's, that FromDraw() fills from a draw.
+// std::nullopt_t stands for a stage without one
+export template <typename T>
+concept PerObjectBlock = std::same_as<T, std::nullopt_t> || requires(DrawPacket const & draw)
+{
+	{ T::FromDraw(draw) } -> std::same_as<T>;
+};
+
+template <PerObjectBlock Block>
+auto make_per_object_block(DrawPacket const & draw)
+{
+	if constexpr (std::same_as<Block, std::nullopt_t>)
+		return std::nullopt;
+	else
+		return Block::FromDraw(draw);
+}
+
 export class GraphicsPipeline
 {
 public:
 	using PerFrameConstantsCallback = std::function<void(GraphicsPipeline const & pipeline)>;
-	using PerObjectConstantsCallback = std::function<void(GraphicsPipeline const & pipeline, RenderObject const &)>;
+
+	// Pushes each draw's per-object constants and draws its mesh. Generated from the pipeline's block types, see
+	// MakeDrawObjectsFn(), so there's one indirect call per pipeline rather than one per object
+	using DrawObjectsFn = void (*)(GraphicsPipeline const & pipeline, std::span<DrawPacket const> draws, std::span<Mesh const> meshes);
 
 	GraphicsPipeline(GraphicsApi const & graphics_api,
 		VkShaderModule vert_shader_module,
@@ -62,8 +94,9 @@ public:
 		std::vector<VkDeviceSize> fs_uniform_sizes,
 		Texture const * texture,
 		DepthTestOptions const & depth_options,
+		BlendOptions const & blend_options,
 		PerFrameConstantsCallback per_frame_constants_callback,
-		PerObjectConstantsCallback per_object_constants_callback);
+		DrawObjectsFn draw_objects);
 	~GraphicsPipeline();
 
 	GraphicsPipeline(GraphicsPipeline && other);
@@ -76,30 +109,59 @@ public:
 
 	void Activate() const;
 	void UpdatePerFrameConstants() const;
-	void UpdatePerObjectConstants(RenderObject const & obj) const;
+	void DrawObjects(std::span<DrawPacket const> draws, std::span<Mesh const> meshes) const { m_draw_objects(*this, draws, meshes); }
+
+	template <PerObjectBlock VSBlock = std::nullopt_t, PerObjectBlock FSBlock = std::nullopt_t>
+	static DrawObjectsFn MakeDrawObjectsFn() { return &draw_objects<VSBlock, FSBlock>; }
 
 	template <typename UniformData>
 	void SetUniform(std::uint32_t binding, UniformData const & data) const;
 
+	// Skips the copy when the current frame's buffer already holds this version of the data, see VersionedBlock
+	template <typename UniformData>
+	void SetUniform(std::uint32_t binding, UniformData const & data, std::uint64_t version) const;
+
 	template <typename VSConstantData = std::nullopt_t, typename FSConstantData = std::nullopt_t>
 	void SetPushConstants(VSConstantData const & vs_data, FSConstantData const & fs_data) const;
 
 private:
 	void destroy_pipeline();
 
+	// Swaps the fast-linked pipelines for the optimized ones once the background link is done
+	void adopt_optimized_link() const;
+
+	// Polygon mode of the draws that follow, dynamic or a switch to the wireframe permutation. A no-op when the
+	// device can't draw lines, those objects are drawn filled
+	void set_wireframe(bool wireframe) const;
+
+	template <PerObjectBlock VSBlock, PerObjectBlock FSBlock>
+	static void draw_objects(GraphicsPipeline const & pipeline, std::span<DrawPacket const> draws, std::span<Mesh const> meshes);
+
 private:
 	GraphicsApi const & m_graphics_api;
 
 	VkPipelineLayout m_pipeline_layout = VK_NULL_HANDLE;
-	VkPipeline m_graphics_pipeline = VK_NULL_HANDLE;
+	mutable VkPipeline m_graphics_pipeline = VK_NULL_HANDLE;
+	mutable VkPipeline m_wireframe_pipeline = VK_NULL_HANDLE; // only when the polygon mode isn't dynamic and lines can be drawn
+
+	// With pipeline libraries: this pipeline's shader parts, the shared ones belong to GraphicsApi. The pipelines
+	// above are fast-linked from them until the optimized link, the pipeline and its wireframe permutation, is done
+	std::vector<VkPipeline> m_library_parts;
+	mutable std::future<std::array<VkPipeline, 2>> m_optimized_link;
 
 	VkDescriptorSetLayout m_descriptor_set_layout = VK_NULL_HANDLE;
 	VkDescriptorPool m_descriptor_pool = VK_NULL_HANDLE;
 
 	std::array<DescriptorSet, GraphicsApi::m_max_frames_in_flight> m_descriptor_sets;
+	TrackedAllocation m_uniform_allocation; // every uniform buffer of every frame in flight
 
 	PerFrameConstantsCallback m_per_frame_constants_callback;
-	PerObjectConstantsCallback m_per_object_constants_callback;
+	DrawObjectsFn m_draw_objects{ MakeDrawObjectsFn() };
+
+	bool m_has_texture{ false }; // the texture is bound with the descriptor set
+
+	RenderState m_render_state; // set on Activate(), dynamic where the device allows it and baked in otherwise
+	mutable bool m_wireframe_active{ false };
 };
 
 template <typename UniformData>
@@ -107,6 +169,34 @@ void GraphicsPipeline::SetUniform(std::uint32_t binding, UniformData const & dat
 {
 	UniformBuffer const & buffer = m_descriptor_sets[m_graphics_api.GetCurFrameIndex()].m_uniform_buffers[binding];
 	memcpy(buffer.m_mapping, &data, sizeof(data));
+	buffer.m_version = 0;
+	FrameStats::Current().m_constant_bytes += sizeof(data);
+}
+
+template <typename UniformData>
+void GraphicsPipeline::SetUniform(std::uint32_t binding, UniformData const & data, std::uint64_t version) const
+{
+	// each frame in flight has its own buffers, one that was current a few frames ago may hold older data than the others
+	UniformBuffer const & buffer = m_descriptor_sets[m_graphics_api.GetCurFrameIndex()].m_uniform_buffers[binding];
+	if (buffer.m_version == version)
+		return;
+
+	SetUniform(binding, data);
+	buffer.m_version = version;
+}
+
+template <PerObjectBlock VSBlock, PerObjectBlock FSBlock>
+void GraphicsPipeline::draw_objects(GraphicsPipeline const & pipeline, std::span<DrawPacket const> draws, std::span<Mesh const> meshes)
+{
+	constexpr bool has_push_constants = !std::same_as<VSBlock, std::nullopt_t> || !std::same_as<FSBlock, std::nullopt_t>;
+
+	for (DrawPacket const & draw : draws)
+	{
+		if constexpr (has_push_constants)
+			pipeline.SetPushConstants(make_per_object_block<VSBlock>(draw), make_per_object_block<FSBlock>(draw));
+		pipeline.set_wireframe(draw.m_draw_wireframe);
+		meshes[draw.m_mesh_id].Render();
+	}
 }
 
 template <typename VSConstantData /*= std::nullopt_t*/, typename FSConstantData /*= std::nullopt_t*/>
@@ -122,6 +212,7 @@ void GraphicsPipeline::SetPushConstants(VSConstantData const & vs_data, FSConsta
 	{
 		vkCmdPushConstants(command_buffer, m_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT,
 			offset, sizeof(VSConstantData), &vs_data);
+		FrameStats::Current().m_constant_bytes += sizeof(VSConstantData);
 
 		offset += static_cast<std::uint32_t>(sizeof(VSConstantData));
 	}
@@ -130,5 +221,6 @@ void GraphicsPipeline::SetPushConstants(VSConstantData const & vs_data, FSConsta
 	{
 		vkCmdPushConstants(command_buffer, m_pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT,
 			offset, sizeof(FSConstantData), &fs_data);
+		FrameStats::Current().m_constant_bytes += sizeof(FSConstantData);
 	}
 }
@@ -0,0 +1,86 @@
+// Hud.ixx
+
+module;
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+export module Hud;
+
+import GraphicsApi;
+import GraphicsPipeline;
+import MemoryLedger;
+import Texture;
+import Vertex;
+
+// Performance overlay with frame time graphs, the renderer counters and the cpu and gpu timings.
+// Everything is one draw call, from a dynamic vertex buffer and a font atlas generated at startup.
+export class Hud
+{
+public:
+	constexpr static std::size_t m_history_size = 120; // frames shown by the graphs
+
+	Hud(GraphicsApi const & graphics_api, std::filesystem::path const & shaders_path);
+	~Hud();
+
+	Hud(Hud const &) = delete;
+	Hud & operator=(Hud const &) = delete;
+
+	bool IsValid() const { return m_pipeline.has_value() && m_vertex_mapping != nullptr; }
+
+	void SetVisible(bool visible) { m_visible = visible; }
+	bool IsVisible() const { return m_visible; }
+
+	// Records the timings every frame so the graphs are full when shown, only builds the vertices while visible.
+	// cpu_time_ms is the time spent updating and recording the previous frame.
+	// The renderer times the overlay as one more pipeline, overlay_pipeline_index labels that row.
+	void Update(double frame_time_ms, double cpu_time_ms, int overlay_pipeline_index);
+
+	// Call from the renderer's overlay callback, inside the render pass
+	void Render() const;
+
+private:
+	constexpr static std::size_t m_max_quads = 2048;
+
+	using History = std::array<float, m_history_size>;
+
+	void add_quad(glm::vec2 pos, glm::vec2 size, glm::vec2 uv_min, glm::vec2 uv_max, glm::vec3 const & color);
+	void add_rect(glm::vec2 pos, glm::vec2 size, glm::vec3 const & color, bool translucent = false);
+	void add_text(glm::vec2 pos, std::string_view text, glm::vec3 const & color);
+	void add_graph(glm::vec2 pos, History const & history, bool budget_colors, glm::vec3 const & color);
+
+	float average(History const & history) const;
+
+private:
+	GraphicsApi const & m_graphics_api;
+
+	Texture m_font_atlas;
+	std::optional<GraphicsPipeline> m_pipeline; // after the atlas, its descriptor set references it
+
+	// One region of m_max_quads per frame in flight, so a frame never overwrites vertices the gpu may still read
+	VkBuffer m_vertex_buffer{ VK_NULL_HANDLE };
+	VkDeviceMemory m_vertex_buffer_memory{ VK_NULL_HANDLE };
+	void * m_vertex_mapping{ nullptr }; // host coherent, mapped for the lifetime of the hud
+	TrackedAllocation m_vertex_allocation;
+
+	bool m_visible{ false };
+
+	History m_frame_times{};
+	History m_cpu_times{};
+	History m_gpu_times{};
+	std::size_t m_history_count{ 0 };
+	std::size_t m_history_next{ 0 };
+
+	std::vector<OverlayVertex> m_vertices;
+	std::string m_line; // reused to format each line without allocating
+};
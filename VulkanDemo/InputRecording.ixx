@@ -0,0 +1,154 @@
+// InputRecording.ixx
+
+module;
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+export module InputRecording;
+
+import Input;
+
+// Binary layout, native endianness:
+//   header: char[4] "GDIR", uint32 version
+//   per frame: float64 delta_time, uint8 key_count, int16 keys[key_count]
+namespace
+{
+	constexpr std::array<char, 4> g_magic{ 'G', 'D', 'I', 'R' };
+	constexpr std::uint32_t g_version = 1;
+}
+
+// Logs the delta time and key state each frame so a run can be replayed exactly
+export class InputRecorder
+{
+public:
+	explicit InputRecorder(std::filesystem::path const & path);
+
+	bool IsValid() const { return m_file.good(); }
+
+	void RecordFrame(double delta_time, Input const & input);
+
+private:
+	std::ofstream m_file;
+};
+
+// Feeds a recording back frame by frame, in place of the wall clock and live input
+export class InputReplayer
+{
+public:
+	explicit InputReplayer(std::filesystem::path const & path);
+
+	bool IsValid() const { return m_valid; }
+	bool IsFinished() const { return m_next_frame >= m_frames.size(); }
+	int GetFrameCount() const { return static_cast<int>(m_frames.size()); }
+
+	// Sets the recorded key state on input and returns the recorded delta time
+	double NextFrame(Input & input);
+
+private:
+	struct Frame
+	{
+		double m_delta_time{ 0.0 };
+		std::vector<int> m_pressed_keys;
+	};
+
+	bool m_valid{ false };
+	std::vector<Frame> m_frames;
+	std::size_t m_next_frame{ 0 };
+};
+
+InputRecorder::InputRecorder(std::filesystem::path const & path)
+	: m_file(path, std::ios::binary)
+{
+	if (!m_file)
+	{
+		std::cout << "InputRecorder: failed to open " << path << std::endl;
+		return;
+	}
+
+	m_file.write(g_magic.data(), g_magic.size());
+	m_file.write(reinterpret_cast<char const *>(&g_version), sizeof(g_version));
+}
+
+void InputRecorder::RecordFrame(double delta_time, Input const & input)
+{
+	if (!IsValid())
+		return;
+
+	std::uint8_t const key_count = static_cast<std::uint8_t>(std::min(input.GetPressedKeyCount(), UINT8_MAX));
+
+	m_file.write(reinterpret_cast<char const *>(&delta_time), sizeof(delta_time));
+	m_file.write(reinterpret_cast<char const *>(&key_count), sizeof(key_count));
+
+	std::uint8_t written_count = 0;
+	input.ForEachPressedKey([this, key_count, &written_count](int pressed_key)
+		{
+			if (written_count == key_count)
+				return;
+
+			std::int16_t const key = static_cast<std::int16_t>(pressed_key); // signed, GLFW_KEY_UNKNOWN is -1
+			m_file.write(reinterpret_cast<char const *>(&key), sizeof(key));
+			++written_count;
+		});
+}
+
+InputReplayer::InputReplayer(std::filesystem::path const & path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		std::cout << "InputReplayer: failed to open " << path << std::endl;
+		return;
+	}
+
+	std::array<char, 4> magic{};
+	std::uint32_t version = 0;
+	file.read(magic.data(), magic.size());
+	file.read(reinterpret_cast<char *>(&version), sizeof(version));
+	if (!file || magic != g_magic || version != g_version)
+	{
+		std::cout << "InputReplayer: not an input recording: " << path << std::endl;
+		return;
+	}
+
+	while (true)
+	{
+		Frame frame;
+		std::uint8_t key_count = 0;
+		file.read(reinterpret_cast<char *>(&frame.m_delta_time), sizeof(frame.m_delta_time));
+		file.read(reinterpret_cast<char *>(&key_count), sizeof(key_count));
+		if (!file)
+			break;
+
+		for (std::uint8_t i = 0; i < key_count; ++i)
+		{
+			std::int16_t key = 0;
+			file.read(reinterpret_cast<char *>(&key), sizeof(key));
+			frame.m_pressed_keys.push_back(key);
+		}
+		if (!file)
+		{
+			std::cout << "InputReplayer: recording is truncated, ignoring the last frame" << std::endl;
+			break;
+		}
+
+		m_frames.push_back(std::move(frame));
+	}
+
+	m_valid = true;
+}
+
+double InputReplayer::NextFrame(Input & input)
+{
+	if (IsFinished())
+		return 0.0;
+
+	Frame const & frame = m_frames[m_next_frame++];
+	input.SetPressedKeys(frame.m_pressed_keys);
+	return frame.m_delta_time;
+}
@@ -0,0 +1,34 @@
+// Json.ixx
+
+module;
+
+#include <format>
+#include <string>
+#include <string_view>
+
+export module Json;
+
+// For arbitrary text written into a JSON string, e.g. device, asset and thread names.
+// Quotes, backslashes and control characters are escaped, everything else is copied as is.
+export std::string EscapeJson(std::string_view text)
+{
+	std::string escaped;
+	escaped.reserve(text.size());
+	for (char c : text)
+	{
+		switch (c)
+		{
+		case '"': escaped += "\\\""; break;
+		case '\\': escaped += "\\\\"; break;
+		case '\n': escaped += "\\n"; break;
+		case '\r': escaped += "\\r"; break;
+		case '\t': escaped += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+				escaped += std::format("\\u{:04x}", static_cast<unsigned char>(c));
+			else
+				escaped += c;
+		}
+	}
+	return escaped;
+}
@@ -0,0 +1,381 @@
+// Log.ixx
+
+module;
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <source_location>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+export module Log;
+
+export enum class LogLevel
+{
+	VERBOSE,
+	INFO,
+	WARNING,
+	ERROR
+};
+
+// Logging for code that may run every frame. A message is formatted into a fixed buffer on the calling thread and
+// pushed on that thread's lock-free queue, a writer thread prints it later. Each call site may only log a few messages
+// per second, the rest are counted and the count is added to the next message that gets through.
+// Without a LogWriter running, messages are printed right away.
+export class Log
+{
+public:
+	// A message let through by Admit(), what Write() needs to know about it besides its text
+	struct Admission
+	{
+		std::int64_t m_time_ns{ 0 };
+		std::uint32_t m_suppressed_count{ 0 };
+	};
+
+	constexpr static std::size_t m_max_message_length = 240; // longer messages are cut
+
+	static void SetMinLevel(LogLevel level);
+	static bool IsEnabled(LogLevel level);
+
+	// text is copied, prefer the LogInfo() style functions which format without allocating
+	static void Write(LogLevel level, std::source_location const & location, std::string_view text);
+
+	// Write() in two steps, so a message over its level or rate limit isn't even formatted
+	static bool Admit(LogLevel level, std::source_location const & location, Admission & out_admission);
+	static void Write(LogLevel level, Admission const & admission, std::string_view text);
+
+	static char const * GetLevelName(LogLevel level);
+};
+
+// Prints the queued messages on its own thread while it lives, the messages left are printed when it's destroyed.
+// Create one at the start of main() so everything logged until the end of the app goes through it
+export class LogWriter
+{
+public:
+	LogWriter();
+	~LogWriter();
+
+	LogWriter(LogWriter const &) = delete;
+	LogWriter & operator=(LogWriter const &) = delete;
+
+private:
+	std::jthread m_thread;
+};
+
+// A format string that also remembers where it was written, the call site the rate limit applies to.
+// Args are the argument types as format_to_n() deduces them, const references
+export template <typename... Args>
+struct LogFormat
+{
+	template <typename T>
+	consteval LogFormat(T const & format, std::source_location location = std::source_location::current())
+		: m_format(format)
+		, m_location(location)
+	{
+	}
+
+	std::format_string<Args...> m_format;
+	std::source_location m_location;
+};
+
+// For a level only known at runtime, e.g. from a graphics api's severity
+export template <typename... Args>
+void LogMessage(LogLevel level, LogFormat<std::type_identity_t<Args const &>...> const & format, Args const &... args)
+{
+	Log::Admission admission;
+	if (!Log::Admit(level, format.m_location, admission))
+		return;
+
+	std::array<char, Log::m_max_message_length> text;
+	auto const result = std::format_to_n(text.data(), static_cast<std::ptrdiff_t>(text.size()), format.m_format, args...);
+	std::size_t length = static_cast<std::size_t>(result.size);
+	if (length > text.size())
+	{
+		length = text.size();
+		std::fill(text.end() - 3, text.end(), '.');
+	}
+
+	Log::Write(level, admission, std::string_view(text.data(), length));
+}
+
+export template <typename... Args>
+void LogVerbose(LogFormat<std::type_identity_t<Args const &>...> format, Args const &... args)
+{
+	LogMessage(LogLevel::VERBOSE, format, args...);
+}
+
+export template <typename... Args>
+void LogInfo(LogFormat<std::type_identity_t<Args const &>...> format, Args const &... args)
+{
+	LogMessage(LogLevel::INFO, format, args...);
+}
+
+export template <typename... Args>
+void LogWarning(LogFormat<std::type_identity_t<Args const &>...> format, Args const &... args)
+{
+	LogMessage(LogLevel::WARNING, format, args...);
+}
+
+export template <typename... Args>
+void LogError(LogFormat<std::type_identity_t<Args const &>...> format, Args const &... args)
+{
+	LogMessage(LogLevel::ERROR, format, args...);
+}
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	constexpr std::size_t g_call_site_count = 1024; // call sites hashing to the same slot share their rate limit
+	constexpr std::uint32_t g_max_messages_per_call_site = 5;
+	constexpr std::int64_t g_rate_limit_window_ns = 1'000'000'000;
+
+	struct LogEntry
+	{
+		std::uint64_t m_sequence{ 0 }; // orders the entries of different threads
+		std::int64_t m_time_ns{ 0 };
+		LogLevel m_level{ LogLevel::INFO };
+		std::uint32_t m_suppressed_count{ 0 }; // messages from the same call site dropped before this one
+		std::uint32_t m_length{ 0 };
+		std::array<char, Log::m_max_message_length> m_text;
+	};
+
+	// Single producer, single consumer ring. Only its thread writes entries and only the writer thread reads them
+	struct LogQueue
+	{
+		static constexpr std::uint64_t m_capacity = 256;
+
+		std::array<LogEntry, m_capacity> m_entries;
+		std::atomic<std::uint64_t> m_write_count{ 0 };
+		std::atomic<std::uint64_t> m_read_count{ 0 };
+		std::atomic<std::uint64_t> m_dropped_count{ 0 }; // the ring was full
+	};
+
+	struct CallSite
+	{
+		std::atomic<std::int64_t> m_window_begin_ns{ 0 };
+		std::atomic<std::uint32_t> m_message_count{ 0 };
+		std::atomic<std::uint32_t> m_suppressed_count{ 0 };
+	};
+
+	Clock::time_point const g_epoch = Clock::now();
+	std::atomic<LogLevel> g_min_level{ LogLevel::INFO };
+	std::atomic<std::uint64_t> g_sequence{ 0 };
+
+	std::array<CallSite, g_call_site_count> g_call_sites;
+
+	std::mutex g_registry_mutex;
+	std::vector<std::shared_ptr<LogQueue>> g_queues;
+
+	std::atomic<bool> g_writer_running{ false };
+	std::atomic<std::uint64_t> g_pending_generation{ 0 }; // bumped for every message, the writer thread waits on it
+
+	std::mutex g_print_mutex; // only for printing right away, when no writer thread runs
+
+	std::int64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - g_epoch).count();
+	}
+
+	LogQueue & thread_queue()
+	{
+		thread_local std::shared_ptr<LogQueue> const queue = []()
+			{
+				std::shared_ptr<LogQueue> new_queue = std::make_shared<LogQueue>();
+				std::lock_guard lock(g_registry_mutex);
+				g_queues.push_back(new_queue);
+				return new_queue;
+			}();
+		return *queue;
+	}
+
+	// Returns false when the call site is over its limit. The window restarts after racing threads too, so the
+	// limit is only approximate, which is all it needs to be
+	bool pass_rate_limit(std::source_location const & location, std::int64_t time_ns, std::uint32_t & out_suppressed_count)
+	{
+		std::size_t const hash = std::hash<void const *>{}(location.file_name())
+			^ (static_cast<std::size_t>(location.line()) * 0x9E3779B97F4A7C15ull)
+			^ location.column();
+		CallSite & call_site = g_call_sites[hash % g_call_site_count];
+
+		std::int64_t window_begin_ns = call_site.m_window_begin_ns.load(std::memory_order_relaxed);
+		if (time_ns - window_begin_ns >= g_rate_limit_window_ns
+			&& call_site.m_window_begin_ns.compare_exchange_strong(window_begin_ns, time_ns, std::memory_order_relaxed))
+		{
+			call_site.m_message_count.store(0, std::memory_order_relaxed);
+		}
+
+		if (call_site.m_message_count.fetch_add(1, std::memory_order_relaxed) >= g_max_messages_per_call_site)
+		{
+			call_site.m_suppressed_count.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		out_suppressed_count = call_site.m_suppressed_count.exchange(0, std::memory_order_relaxed);
+		return true;
+	}
+
+	void format_line(std::string & out, LogEntry const & entry)
+	{
+		std::format_to(std::back_inserter(out), "[{:9.3f}] {}: {}",
+			static_cast<double>(entry.m_time_ns) / 1e9, Log::GetLevelName(entry.m_level),
+			std::string_view(entry.m_text.data(), entry.m_length));
+		if (entry.m_suppressed_count > 0)
+			std::format_to(std::back_inserter(out), " ({} similar messages suppressed)", entry.m_suppressed_count);
+		out += '\n';
+	}
+
+	// Empties every queue into out_entries, oldest first, and reports the messages dropped on full queues
+	void drain_queues(std::vector<LogEntry> & out_entries, std::string & out_text)
+	{
+		out_entries.clear();
+		{
+			std::lock_guard lock(g_registry_mutex);
+			for (std::shared_ptr<LogQueue> const & queue : g_queues)
+			{
+				std::uint64_t const read_count = queue->m_read_count.load(std::memory_order_relaxed);
+				std::uint64_t const write_count = queue->m_write_count.load(std::memory_order_acquire);
+				for (std::uint64_t i = read_count; i < write_count; ++i)
+					out_entries.push_back(queue->m_entries[i % LogQueue::m_capacity]);
+				queue->m_read_count.store(write_count, std::memory_order_release);
+
+				if (std::uint64_t const dropped = queue->m_dropped_count.exchange(0, std::memory_order_relaxed))
+					std::format_to(std::back_inserter(out_text), "Log: {} messages dropped, a queue was full\n", dropped);
+			}
+		}
+
+		std::ranges::sort(out_entries, {}, &LogEntry::m_sequence);
+	}
+
+	void write_pending(std::vector<LogEntry> & entries, std::string & text)
+	{
+		text.clear();
+		drain_queues(entries, text);
+		for (LogEntry const & entry : entries)
+			format_line(text, entry);
+		if (!text.empty())
+			std::cout << text << std::flush;
+	}
+
+	void write_loop(std::stop_token stop_token)
+	{
+		std::vector<LogEntry> entries;
+		std::string text;
+		while (!stop_token.stop_requested())
+		{
+			std::uint64_t const generation = g_pending_generation.load(std::memory_order_acquire);
+			write_pending(entries, text);
+
+			g_pending_generation.wait(generation, std::memory_order_acquire);
+		}
+	}
+}
+
+void Log::SetMinLevel(LogLevel level)
+{
+	g_min_level.store(level, std::memory_order_relaxed);
+}
+
+bool Log::IsEnabled(LogLevel level)
+{
+	return level >= g_min_level.load(std::memory_order_relaxed);
+}
+
+void Log::Write(LogLevel level, std::source_location const & location, std::string_view text)
+{
+	Admission admission;
+	if (Admit(level, location, admission))
+		Write(level, admission, text);
+}
+
+bool Log::Admit(LogLevel level, std::source_location const & location, Admission & out_admission)
+{
+	if (!IsEnabled(level))
+		return false;
+
+	out_admission.m_time_ns = now_ns();
+	return pass_rate_limit(location, out_admission.m_time_ns, out_admission.m_suppressed_count);
+}
+
+void Log::Write(LogLevel level, Admission const & admission, std::string_view text)
+{
+	LogEntry entry{
+		.m_time_ns = admission.m_time_ns,
+		.m_level = level,
+		.m_suppressed_count = admission.m_suppressed_count
+	};
+	entry.m_length = static_cast<std::uint32_t>(std::min(text.size(), entry.m_text.size()));
+	std::copy_n(text.data(), entry.m_length, entry.m_text.data());
+
+	if (!g_writer_running.load(std::memory_order_acquire))
+	{
+		std::string line;
+		format_line(line, entry);
+		std::lock_guard lock(g_print_mutex);
+		std::cout << line << std::flush;
+		return;
+	}
+
+	LogQueue & queue = thread_queue();
+	std::uint64_t const write_count = queue.m_write_count.load(std::memory_order_relaxed);
+	if (write_count - queue.m_read_count.load(std::memory_order_acquire) >= LogQueue::m_capacity)
+	{
+		queue.m_dropped_count.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	entry.m_sequence = g_sequence.fetch_add(1, std::memory_order_relaxed);
+	queue.m_entries[write_count % LogQueue::m_capacity] = entry;
+	queue.m_write_count.store(write_count + 1, std::memory_order_release);
+
+	g_pending_generation.fetch_add(1, std::memory_order_release);
+	g_pending_generation.notify_one();
+}
+
+char const * Log::GetLevelName(LogLevel level)
+{
+	switch (level)
+	{
+	case LogLevel::VERBOSE: return "verbose";
+	case LogLevel::INFO: return "info";
+	case LogLevel::WARNING: return "warning";
+	case LogLevel::ERROR: return "error";
+	default: return "unknown";
+	}
+}
+
+LogWriter::LogWriter()
+{
+	m_thread = std::jthread(write_loop);
+	g_writer_running.store(true, std::memory_order_release);
+}
+
+LogWriter::~LogWriter()
+{
+	// messages logged from now on are printed right away, the writer prints whatever was queued before
+	g_writer_running.store(false, std::memory_order_release);
+
+	m_thread.request_stop();
+	g_pending_generation.fetch_add(1, std::memory_order_release);
+	g_pending_generation.notify_one();
+	m_thread.join();
+
+	// a thread may have queued a message just before the writer stopped
+	std::vector<LogEntry> entries;
+	std::string text;
+	write_pending(entries, text);
+}
@@ -0,0 +1,311 @@
+// MemoryLedger.ixx
+
+module;
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+export module MemoryLedger;
+
+import Log;
+
+export enum class MemoryCategory
+{
+	MESH,
+	TEXTURE,
+	UNIFORM_BUFFER,
+	STAGING,
+	DYNAMIC, // rewritten every frame, e.g. the hud's vertices
+	RENDER_TARGET,
+	COUNT
+};
+
+export struct MemoryUsage
+{
+	std::uint64_t m_current_bytes{ 0 };
+	std::uint64_t m_peak_bytes{ 0 };
+	std::uint64_t m_allocation_count{ 0 }; // still alive
+};
+
+export struct AssetMemoryUsage
+{
+	MemoryCategory m_category{ MemoryCategory::MESH };
+	std::string m_name;
+	MemoryUsage m_usage;
+};
+
+// One memory heap of the device. Budget and usage cover every process and are only there when the driver reports them
+export struct MemoryHeapBudget
+{
+	std::uint64_t m_size{ 0 };
+	std::optional<std::uint64_t> m_budget;
+	std::optional<std::uint64_t> m_usage;
+	bool m_device_local{ false };
+};
+
+// Live ledger of the gpu memory the demo allocates, by category and by asset name, with peaks.
+// Sizes are what the driver asked for where the backend can tell, so they include alignment padding.
+// Can be called from any thread.
+export class MemoryLedger
+{
+public:
+	static void Allocate(MemoryCategory category, std::string_view name, std::uint64_t bytes);
+	static void Free(MemoryCategory category, std::string_view name, std::uint64_t bytes);
+
+	static MemoryUsage GetUsage(MemoryCategory category);
+	static MemoryUsage GetTotalUsage();
+
+	// Every asset that has allocated so far, the largest current usage first
+	static std::vector<AssetMemoryUsage> GetAssetUsage();
+
+	// Warns with the largest assets when the current total goes over the budget, 0 disables it
+	static void SetBudget(std::uint64_t bytes);
+	static std::uint64_t GetBudget();
+
+	// Prints the allocations still alive, call once every resource should have been destroyed. Returns false on leaks
+	static bool ReportLeaks();
+
+	static char const * GetCategoryName(MemoryCategory category);
+};
+
+// A ledger entry owned by the resource it describes, freed along with it
+export class TrackedAllocation
+{
+public:
+	TrackedAllocation() = default;
+	TrackedAllocation(MemoryCategory category, std::string name, std::uint64_t bytes);
+	~TrackedAllocation();
+
+	TrackedAllocation(TrackedAllocation && other);
+	TrackedAllocation & operator=(TrackedAllocation && other);
+
+	TrackedAllocation(TrackedAllocation const &) = delete;
+	TrackedAllocation & operator=(TrackedAllocation const &) = delete;
+
+	void Reset();
+
+	std::uint64_t GetBytes() const { return m_bytes; }
+
+private:
+	MemoryCategory m_category{ MemoryCategory::MESH };
+	std::string m_name;
+	std::uint64_t m_bytes{ 0 };
+};
+
+namespace
+{
+	constexpr std::size_t g_category_count = static_cast<std::size_t>(MemoryCategory::COUNT);
+	constexpr std::size_t g_budget_report_assets = 5;
+
+	std::mutex g_ledger_mutex;
+	std::array<MemoryUsage, g_category_count> g_categories;
+	MemoryUsage g_total;
+	std::map<std::pair<MemoryCategory, std::string>, MemoryUsage> g_assets;
+
+	std::uint64_t g_budget_bytes{ 0 };
+	bool g_over_budget{ false }; // warned already, until the total drops back under the budget
+
+	void add_bytes(MemoryUsage & usage, std::uint64_t bytes)
+	{
+		usage.m_current_bytes += bytes;
+		usage.m_peak_bytes = std::max(usage.m_peak_bytes, usage.m_current_bytes);
+		++usage.m_allocation_count;
+	}
+
+	void remove_bytes(MemoryUsage & usage, std::uint64_t bytes)
+	{
+		usage.m_current_bytes -= std::min(usage.m_current_bytes, bytes);
+		usage.m_allocation_count -= std::min<std::uint64_t>(usage.m_allocation_count, 1);
+	}
+
+	double to_mb(std::uint64_t bytes)
+	{
+		return static_cast<double>(bytes) / (1024.0 * 1024.0);
+	}
+
+	// g_ledger_mutex must be held
+	std::vector<AssetMemoryUsage> sorted_assets()
+	{
+		std::vector<AssetMemoryUsage> assets;
+		assets.reserve(g_assets.size());
+		for (auto const & [key, usage] : g_assets)
+			assets.push_back(AssetMemoryUsage{ .m_category = key.first, .m_name = key.second, .m_usage = usage });
+
+		std::ranges::sort(assets, [](AssetMemoryUsage const & a, AssetMemoryUsage const & b)
+			{
+				if (a.m_usage.m_current_bytes != b.m_usage.m_current_bytes)
+					return a.m_usage.m_current_bytes > b.m_usage.m_current_bytes;
+				return a.m_usage.m_peak_bytes > b.m_usage.m_peak_bytes;
+			});
+		return assets;
+	}
+
+	// g_ledger_mutex must be held
+	void check_budget()
+	{
+		if (g_budget_bytes == 0 || g_over_budget || g_total.m_current_bytes <= g_budget_bytes)
+			return;
+
+		g_over_budget = true;
+		LogWarning("MemoryLedger: {:.2f} MB allocated, over the budget of {:.2f} MB. Largest assets:",
+			to_mb(g_total.m_current_bytes), to_mb(g_budget_bytes));
+
+		std::vector<AssetMemoryUsage> const assets = sorted_assets();
+		for (std::size_t i = 0; i < std::min(assets.size(), g_budget_report_assets); ++i)
+		{
+			LogInfo("\t{:<16} {:<24} {:>10.2f} MB",
+				MemoryLedger::GetCategoryName(assets[i].m_category), assets[i].m_name, to_mb(assets[i].m_usage.m_current_bytes));
+		}
+	}
+}
+
+void MemoryLedger::Allocate(MemoryCategory category, std::string_view name, std::uint64_t bytes)
+{
+	std::lock_guard lock(g_ledger_mutex);
+	add_bytes(g_categories[static_cast<std::size_t>(category)], bytes);
+	add_bytes(g_total, bytes);
+	add_bytes(g_assets[{ category, std::string{ name } }], bytes);
+	check_budget();
+}
+
+void MemoryLedger::Free(MemoryCategory category, std::string_view name, std::uint64_t bytes)
+{
+	std::lock_guard lock(g_ledger_mutex);
+
+	// a free without its allocation would otherwise add an empty asset, and take bytes off totals that never had them
+	auto const asset = g_assets.find({ category, std::string{ name } });
+	if (asset == g_assets.end())
+	{
+		LogWarning("MemoryLedger: freed {} bytes of {} '{}', which was never allocated", bytes, GetCategoryName(category), name);
+		return;
+	}
+
+	remove_bytes(g_categories[static_cast<std::size_t>(category)], bytes);
+	remove_bytes(g_total, bytes);
+	remove_bytes(asset->second, bytes);
+
+	if (g_total.m_current_bytes <= g_budget_bytes)
+		g_over_budget = false;
+}
+
+MemoryUsage MemoryLedger::GetUsage(MemoryCategory category)
+{
+	std::lock_guard lock(g_ledger_mutex);
+	return g_categories[static_cast<std::size_t>(category)];
+}
+
+MemoryUsage MemoryLedger::GetTotalUsage()
+{
+	std::lock_guard lock(g_ledger_mutex);
+	return g_total;
+}
+
+std::vector<AssetMemoryUsage> MemoryLedger::GetAssetUsage()
+{
+	std::lock_guard lock(g_ledger_mutex);
+	return sorted_assets();
+}
+
+void MemoryLedger::SetBudget(std::uint64_t bytes)
+{
+	std::lock_guard lock(g_ledger_mutex);
+	g_budget_bytes = bytes;
+	g_over_budget = false;
+	check_budget();
+}
+
+std::uint64_t MemoryLedger::GetBudget()
+{
+	std::lock_guard lock(g_ledger_mutex);
+	return g_budget_bytes;
+}
+
+bool MemoryLedger::ReportLeaks()
+{
+	std::lock_guard lock(g_ledger_mutex);
+	if (g_total.m_allocation_count == 0)
+		return true;
+
+	std::cout << std::format("MemoryLedger: {} allocations still alive, {:.2f} MB\n",
+		g_total.m_allocation_count, to_mb(g_total.m_current_bytes));
+	for (AssetMemoryUsage const & asset : sorted_assets())
+	{
+		if (asset.m_usage.m_allocation_count == 0)
+			continue;
+
+		std::cout << std::format("\t{:<16} {:<24} {} x, {} bytes\n",
+			GetCategoryName(asset.m_category), asset.m_name, asset.m_usage.m_allocation_count, asset.m_usage.m_current_bytes);
+	}
+	std::cout << std::flush;
+	return false;
+}
+
+char const * MemoryLedger::GetCategoryName(MemoryCategory category)
+{
+	switch (category)
+	{
+	case MemoryCategory::MESH: return "mesh";
+	case MemoryCategory::TEXTURE: return "texture";
+	case MemoryCategory::UNIFORM_BUFFER: return "uniform buffer";
+	case MemoryCategory::STAGING: return "staging";
+	case MemoryCategory::DYNAMIC: return "dynamic";
+	case MemoryCategory::RENDER_TARGET: return "render target";
+	default: return "unknown";
+	}
+}
+
+TrackedAllocation::TrackedAllocation(MemoryCategory category, std::string name, std::uint64_t bytes)
+	: m_category(category)
+	, m_name(std::move(name))
+	, m_bytes(bytes)
+{
+	if (m_bytes > 0)
+		MemoryLedger::Allocate(m_category, m_name, m_bytes);
+}
+
+TrackedAllocation::~TrackedAllocation()
+{
+	Reset();
+}
+
+TrackedAllocation::TrackedAllocation(TrackedAllocation && other)
+{
+	*this = std::move(other);
+}
+
+TrackedAllocation & TrackedAllocation::operator=(TrackedAllocation && other)
+{
+	if (this == &other)
+		return *this;
+
+	Reset();
+
+	m_category = other.m_category;
+	m_name = std::move(other.m_name);
+	m_bytes = other.m_bytes;
+
+	other.m_name.clear();
+	other.m_bytes = 0;
+
+	return *this;
+}
+
+void TrackedAllocation::Reset()
+{
+	if (m_bytes == 0)
+		return; // nothing tracked, e.g. moved from
+
+	MemoryLedger::Free(m_category, m_name, m_bytes);
+	m_name.clear();
+	m_bytes = 0;
+}
@@ -2,26 +2,43 @@
 
 module;
 
+#include <algorithm>
 #include <iostream>
+#include <string>
 #include <vector>
 
 #include <vulkan/vulkan.h>
 
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
 export module Mesh;
 
 import GraphicsApi;
+import MemoryLedger;
+import RenderStats;
 import Vertex;
 
+// Local space bounds, centred on the vertices' bounding box
+export struct BoundingSphere
+{
+	glm::vec3 m_center{ 0.0f, 0.0f, 0.0f };
+	float m_radius{ 0.0f };
+};
+
 export class Mesh
 {
 public:
 	using IndexT = std::uint16_t;
 
+	// name identifies the mesh in the memory ledger
 	template <IsVertex VertexT>
 	Mesh(
 		GraphicsApi const & graphics_api,
 		std::vector<VertexT> const & vertices,
-		std::vector<IndexT> const & indices);
+		std::vector<IndexT> const & indices,
+		std::string const & name);
 	~Mesh();
 
 	Mesh(Mesh && other);
@@ -31,8 +48,9 @@ public:
 	Mesh & operator=(Mesh &) = delete;
 
 	bool IsInitialized() const;
+	BoundingSphere const & GetBounds() const { return m_bounds; }
 
-	void Render(bool wireframe) const;
+	void Render() const; // wireframe is pipeline state, see GraphicsPipeline
 
 private:
 	void destroy_buffers();
@@ -46,6 +64,10 @@ private:
 	VkDeviceMemory m_index_buffer_memory = VK_NULL_HANDLE;
 
 	std::uint32_t m_index_count = 0;
+
+	BoundingSphere m_bounds;
+
+	TrackedAllocation m_allocation; // both buffers
 };
 
 namespace
@@ -55,6 +77,7 @@ namespace
 		GraphicsApi const & graphics_api,
 		std::vector<T> objects,
 		VkBufferUsageFlags buffer_usage,
+		std::string const & name,
 		VkBuffer & out_buffer,
 		VkDeviceMemory & out_buffer_memory
 		)
@@ -76,6 +99,7 @@ namespace
 			std::cout << "Failed to create staging buffer" << std::endl;
 			return result;
 		}
+		TrackedAllocation staging_allocation{ MemoryCategory::STAGING, name, graphics_api.GetMemorySize(staging_buffer) };
 
 		void * data;
 		vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0, &data);
@@ -101,13 +125,34 @@ namespace
 
 		return VK_SUCCESS;
 	}
+
+	template <IsVertex VertexT>
+	BoundingSphere compute_bounds(std::vector<VertexT> const & vertices)
+	{
+		if (vertices.empty())
+			return BoundingSphere{};
+
+		glm::vec3 min_pos = vertices[0].m_pos;
+		glm::vec3 max_pos = vertices[0].m_pos;
+		for (VertexT const & vertex : vertices)
+		{
+			min_pos = glm::min(min_pos, vertex.m_pos);
+			max_pos = glm::max(max_pos, vertex.m_pos);
+		}
+
+		BoundingSphere bounds{ .m_center = (min_pos + max_pos) * 0.5f };
+		for (VertexT const & vertex : vertices)
+			bounds.m_radius = std::max(bounds.m_radius, glm::length(vertex.m_pos - bounds.m_center));
+		return bounds;
+	}
 }
 
 template<IsVertex VertexT>
 Mesh::Mesh(
 	GraphicsApi const & graphics_api,
 	std::vector<VertexT> const & vertices,
-	std::vector<IndexT> const & indices)
+	std::vector<IndexT> const & indices,
+	std::string const & name)
 	: m_graphics_api{ graphics_api }
 {
 	if (vertices.empty())
@@ -125,6 +170,7 @@ Mesh::Mesh(
 		m_graphics_api,
 		vertices,
 		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		name,
 		m_vertex_buffer,
 		m_vertex_buffer_memory);
 	if (result != VK_SUCCESS)
@@ -137,6 +183,7 @@ Mesh::Mesh(
 		m_graphics_api,
 		indices,
 		VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		name,
 		m_index_buffer,
 		m_index_buffer_memory);
 	if (result != VK_SUCCESS)
@@ -146,6 +193,9 @@ Mesh::Mesh(
 	}
 
 	m_index_count = static_cast<std::uint32_t>(indices.size());
+	m_bounds = compute_bounds(vertices);
+	m_allocation = TrackedAllocation{ MemoryCategory::MESH, name,
+		m_graphics_api.GetMemorySize(m_vertex_buffer) + m_graphics_api.GetMemorySize(m_index_buffer) };
 }
 
 Mesh::~Mesh()
@@ -155,17 +205,29 @@ Mesh::~Mesh()
 
 void Mesh::destroy_buffers()
 {
-	VkDevice device = m_graphics_api.GetDevice();
+	if (m_vertex_buffer == VK_NULL_HANDLE && m_vertex_buffer_memory == VK_NULL_HANDLE
+		&& m_index_buffer == VK_NULL_HANDLE && m_index_buffer_memory == VK_NULL_HANDLE)
+	{
+		return; // nothing to destroy, e.g. moved from
+	}
+
+	m_graphics_api.DestroyDeferred(
+		[index_buffer = m_index_buffer, index_buffer_memory = m_index_buffer_memory,
+		vertex_buffer = m_vertex_buffer, vertex_buffer_memory = m_vertex_buffer_memory](VkDevice device)
+		{
+			vkDestroyBuffer(device, index_buffer, nullptr);
+			vkFreeMemory(device, index_buffer_memory, nullptr);
+
+			vkDestroyBuffer(device, vertex_buffer, nullptr);
+			vkFreeMemory(device, vertex_buffer_memory, nullptr);
+		});
 
-	vkDestroyBuffer(device, m_index_buffer, nullptr);
 	m_index_buffer = VK_NULL_HANDLE;
-	vkFreeMemory(device, m_index_buffer_memory, nullptr);
 	m_index_buffer_memory = VK_NULL_HANDLE;
-
-	vkDestroyBuffer(device, m_vertex_buffer, nullptr);
 	m_vertex_buffer = VK_NULL_HANDLE;
-	vkFreeMemory(device, m_vertex_buffer_memory, nullptr);
 	m_vertex_buffer_memory = VK_NULL_HANDLE;
+	m_index_count = 0;
+	m_allocation.Reset();
 }
 
 Mesh::Mesh(Mesh && other)
@@ -186,6 +248,8 @@ Mesh & Mesh::operator=(Mesh && other)
 	m_index_buffer = other.m_index_buffer;
 	m_index_buffer_memory = other.m_index_buffer_memory;
 	m_index_count = other.m_index_count;
+	m_bounds = other.m_bounds;
+	m_allocation = std::move(other.m_allocation);
 
 	other.m_vertex_buffer = VK_NULL_HANDLE;
 	other.m_vertex_buffer_memory = VK_NULL_HANDLE;
@@ -205,7 +269,7 @@ bool Mesh::IsInitialized() const
 		&& m_index_count > 0;
 }
 
-void Mesh::Render(bool /*wireframe*/) const
+void Mesh::Render() const
 {
 	if (!IsInitialized())
 		return;
@@ -235,4 +299,9 @@ void Mesh::Render(bool /*wireframe*/) const
 		0 /*firstIndex*/,
 		0 /*vertexOffset*/,
 		0 /*firstInstance*/);
+
+	RenderStats & stats = FrameStats::Current();
+	stats.m_draw_calls += 1;
+	stats.m_instances += 1;
+	stats.m_triangles += m_index_count / 3;
 }
@@ -11,6 +11,7 @@ module;
 module PipelineBuilder;
 
 import GraphicsApi;
+import Profiler;
 
 namespace
 {
@@ -79,6 +80,8 @@ PipelineBuilder::~PipelineBuilder()
 
 void PipelineBuilder::LoadShaders(std::filesystem::path const & vs_path, std::filesystem::path const & fs_path)
 {
+	ProfileZone zone{ "load shaders" };
+
 	VkDevice device = m_graphics_api.GetDevice();
 
 	m_vert_shader_module = load_shader(vs_path, device);
@@ -105,6 +108,7 @@ std::optional<GraphicsPipeline> PipelineBuilder::CreatePipeline() const
 		m_fs_uniform_sizes,
 		m_texture,
 		m_depth_test_options,
+		m_blend_options,
 		m_per_frame_constants_callback,
-		m_per_object_constants_callback };
+		m_draw_objects };
 }
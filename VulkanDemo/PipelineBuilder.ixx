@@ -10,7 +10,7 @@ export module PipelineBuilder;
 
 import GraphicsApi;
 import GraphicsPipeline;
-import RenderObject;
+import RenderPacket;
 import Texture;
 import Vertex;
 
@@ -18,7 +18,6 @@ export class PipelineBuilder
 {
 public:
 	using PerFrameConstantsCallback = GraphicsPipeline::PerFrameConstantsCallback;
-	using PerObjectConstantsCallback = GraphicsPipeline::PerObjectConstantsCallback;
 
 	explicit PipelineBuilder(GraphicsApi const & graphics_api);
 	~PipelineBuilder();
@@ -31,6 +30,10 @@ public:
 	template <typename VSConstantData = std::nullopt_t, typename FSConstantData = std::nullopt_t>
 	void SetPushConstantTypes();
 
+	// Push constants the renderer fills from each draw, the code that does it is generated for these types
+	template <PerObjectBlock VSBlock = std::nullopt_t, PerObjectBlock FSBlock = std::nullopt_t>
+	void SetPerObjectBlockTypes();
+
 	template <typename... UniformTypes>
 	void SetVSUniformTypes();
 
@@ -39,9 +42,9 @@ public:
 
 	void SetTexture(Texture const & texture) { m_texture = &texture; }
 	void SetDepthTestOptions(DepthTestOptions const & options) { m_depth_test_options = options; }
+	void SetBlendOptions(BlendOptions const & options) { m_blend_options = options; }
 
 	void SetPerFrameConstantsCallback(PerFrameConstantsCallback callback) { m_per_frame_constants_callback = callback; }
-	void SetPerObjectConstantsCallback(PerObjectConstantsCallback callback) { m_per_object_constants_callback = callback; }
 
 	std::optional<GraphicsPipeline> CreatePipeline() const;
 
@@ -60,9 +63,10 @@ private:
 	Texture const * m_texture{ nullptr };
 
 	DepthTestOptions m_depth_test_options;
+	BlendOptions m_blend_options;
 
 	PerFrameConstantsCallback m_per_frame_constants_callback;
-	PerObjectConstantsCallback m_per_object_constants_callback;
+	GraphicsPipeline::DrawObjectsFn m_draw_objects{ GraphicsPipeline::MakeDrawObjectsFn() };
 };
 
 template <IsVertex VertexT>
@@ -103,6 +107,13 @@ void PipelineBuilder::SetPushConstantTypes()
 	}
 }
 
+template <PerObjectBlock VSBlock /*= std::nullopt_t*/, PerObjectBlock FSBlock /*= std::nullopt_t*/>
+void PipelineBuilder::SetPerObjectBlockTypes()
+{
+	SetPushConstantTypes<VSBlock, FSBlock>();
+	m_draw_objects = GraphicsPipeline::MakeDrawObjectsFn<VSBlock, FSBlock>();
+}
+
 template <typename... UniformTypes>
 void PipelineBuilder::SetVSUniformTypes()
 {
@@ -0,0 +1,307 @@
+// Profiler.ixx
+
+module;
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+export module Profiler;
+
+import Json;
+
+// Scoped CPU zones, recorded per thread and exported as Chrome trace event JSON (also opens in ui.perfetto.dev)
+export class Profiler
+{
+public:
+	static void SetEnabled(bool enabled);
+	static bool IsEnabled();
+
+	// Shown as the track name in the trace, call from the thread being named after enabling the profiler
+	static void SetThreadName(std::string name);
+
+	// Cpu time on the clock the trace uses
+	static std::int64_t Now();
+
+	// Gpu work already converted to the trace clock, shown on its own "gpu" track. Only call from one thread
+	static void RecordGpuZone(char const * name, int detail, std::int64_t start_ns, std::int64_t end_ns);
+
+	// A value shown as a graph in the trace, e.g. frame time or draw calls. name must be a string literal.
+	// Only call from one thread
+	static void RecordCounter(char const * name, double value);
+
+	// Can run while other threads are recording, events they overwrite during the read are left out
+	static bool WriteChromeTrace(std::string const & path);
+
+	// Only the zones overlapping [begin_ns, end_ns] and the counters inside it, on the clock of Now()
+	static bool WriteChromeTrace(std::string const & path, std::int64_t begin_ns, std::int64_t end_ns);
+};
+
+// Records the time between construction and destruction on the calling thread's ring buffer.
+// Costs a single relaxed atomic load when profiling is disabled.
+export class ProfileZone
+{
+public:
+	// name must outlive the profiler, use string literals. detail shows up as an argument of the zone when >= 0
+	explicit ProfileZone(char const * name, int detail = -1);
+	~ProfileZone();
+
+	ProfileZone(ProfileZone const &) = delete;
+	ProfileZone & operator=(ProfileZone const &) = delete;
+
+private:
+	char const * m_name{ nullptr }; // null when profiling was disabled at construction
+	int m_detail{ -1 };
+	std::int64_t m_start_ns{ 0 };
+};
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	struct ZoneEvent
+	{
+		char const * m_name{ nullptr };
+		int m_detail{ -1 };
+		std::int64_t m_start_ns{ 0 };
+		std::int64_t m_end_ns{ 0 };
+	};
+
+	// Single producer ring, only the owning thread writes. Kept alive by the registry after the thread exits
+	struct ThreadBuffer
+	{
+		static constexpr std::uint64_t m_capacity = 1 << 16; // power of two, 2 MB per thread
+
+		std::array<ZoneEvent, m_capacity> m_events;
+		std::atomic<std::uint64_t> m_write_count{ 0 };
+		std::uint32_t m_thread_id{ 0 };
+		std::string m_thread_name; // guarded by g_registry_mutex
+	};
+
+	struct CounterEvent
+	{
+		char const * m_name{ nullptr };
+		std::int64_t m_time_ns{ 0 };
+		double m_value{ 0.0 };
+	};
+
+	// Single producer ring like ThreadBuffer, for all the counters
+	struct CounterBuffer
+	{
+		static constexpr std::uint64_t m_capacity = 1 << 15; // power of two
+
+		std::array<CounterEvent, m_capacity> m_events;
+		std::atomic<std::uint64_t> m_write_count{ 0 };
+	};
+
+	Clock::time_point const g_epoch = Clock::now();
+	std::atomic<bool> g_enabled{ false };
+
+	std::mutex g_registry_mutex;
+	std::vector<std::shared_ptr<ThreadBuffer>> g_thread_buffers;
+
+	CounterBuffer g_counter_buffer;
+
+	std::int64_t now_ns()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - g_epoch).count();
+	}
+
+	std::shared_ptr<ThreadBuffer> register_buffer(std::string const & name)
+	{
+		std::shared_ptr<ThreadBuffer> buffer = std::make_shared<ThreadBuffer>();
+
+		std::lock_guard lock(g_registry_mutex);
+		buffer->m_thread_id = static_cast<std::uint32_t>(g_thread_buffers.size() + 1);
+		buffer->m_thread_name = name.empty() ? std::format("thread {}", buffer->m_thread_id) : name;
+		g_thread_buffers.push_back(buffer);
+		return buffer;
+	}
+
+	ThreadBuffer & thread_buffer()
+	{
+		thread_local std::shared_ptr<ThreadBuffer> const buffer = register_buffer({});
+		return *buffer;
+	}
+
+	ThreadBuffer & gpu_buffer()
+	{
+		static std::shared_ptr<ThreadBuffer> const buffer = register_buffer("gpu");
+		return *buffer;
+	}
+
+	void push_event(ThreadBuffer & buffer, ZoneEvent const & event)
+	{
+		std::uint64_t const index = buffer.m_write_count.load(std::memory_order_relaxed);
+		buffer.m_events[index & (ThreadBuffer::m_capacity - 1)] = event;
+		buffer.m_write_count.store(index + 1, std::memory_order_release);
+	}
+
+	// Copies the events of a ring that pass the filter, oldest first. The owner keeps writing meanwhile, so the
+	// copies of any slot it may have reached during the read are dropped afterwards
+	template <typename EventT, std::size_t Capacity, typename FilterFn>
+	std::vector<EventT> copy_events(std::array<EventT, Capacity> const & events, std::atomic<std::uint64_t> const & write_count,
+		FilterFn filter)
+	{
+		std::uint64_t const end = write_count.load(std::memory_order_acquire);
+		std::uint64_t const first = end > Capacity ? end - Capacity : 0;
+
+		std::vector<std::uint64_t> indices;
+		std::vector<EventT> copied;
+		for (std::uint64_t i = first; i < end; ++i)
+		{
+			EventT const event = events[i & (Capacity - 1)];
+			if (filter(event))
+			{
+				indices.push_back(i);
+				copied.push_back(event);
+			}
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		std::uint64_t const end_after = write_count.load(std::memory_order_relaxed);
+		std::uint64_t const first_intact = end_after >= Capacity ? end_after - Capacity + 1 : 0;
+
+		std::size_t const overwritten = static_cast<std::size_t>(
+			std::lower_bound(indices.begin(), indices.end(), first_intact) - indices.begin());
+		copied.erase(copied.begin(), copied.begin() + overwritten);
+		return copied;
+	}
+}
+
+void Profiler::SetEnabled(bool enabled)
+{
+	g_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Profiler::IsEnabled()
+{
+	return g_enabled.load(std::memory_order_relaxed);
+}
+
+void Profiler::SetThreadName(std::string name)
+{
+	if (!IsEnabled())
+		return; // don't allocate a buffer for a thread that will never record
+
+	ThreadBuffer & buffer = thread_buffer();
+
+	std::lock_guard lock(g_registry_mutex);
+	buffer.m_thread_name = std::move(name);
+}
+
+std::int64_t Profiler::Now()
+{
+	return now_ns();
+}
+
+void Profiler::RecordGpuZone(char const * name, int detail, std::int64_t start_ns, std::int64_t end_ns)
+{
+	if (!IsEnabled())
+		return;
+
+	push_event(gpu_buffer(), ZoneEvent{
+		.m_name = name,
+		.m_detail = detail,
+		.m_start_ns = start_ns,
+		.m_end_ns = end_ns
+		});
+}
+
+void Profiler::RecordCounter(char const * name, double value)
+{
+	if (!IsEnabled())
+		return;
+
+	std::uint64_t const index = g_counter_buffer.m_write_count.load(std::memory_order_relaxed);
+	g_counter_buffer.m_events[index & (CounterBuffer::m_capacity - 1)] = CounterEvent{
+		.m_name = name,
+		.m_time_ns = now_ns(),
+		.m_value = value
+		};
+	g_counter_buffer.m_write_count.store(index + 1, std::memory_order_release);
+}
+
+bool Profiler::WriteChromeTrace(std::string const & path)
+{
+	return WriteChromeTrace(path, std::numeric_limits<std::int64_t>::min(), std::numeric_limits<std::int64_t>::max());
+}
+
+bool Profiler::WriteChromeTrace(std::string const & path, std::int64_t begin_ns, std::int64_t end_ns)
+{
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	std::lock_guard lock(g_registry_mutex);
+
+	// "X" complete events and "C" counter events with microsecond timestamps, plus one metadata event per thread for its name
+	file << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	bool first_event = true;
+	auto write_event = [&file, &first_event](std::string const & event)
+		{
+			file << (first_event ? "\t" : ",\n\t") << event;
+			first_event = false;
+		};
+
+	for (std::shared_ptr<ThreadBuffer> const & buffer : g_thread_buffers)
+	{
+		write_event(std::format(R"({{ "name": "thread_name", "ph": "M", "pid": 1, "tid": {}, "args": {{ "name": "{}" }} }})",
+			buffer->m_thread_id, EscapeJson(buffer->m_thread_name)));
+
+		std::vector<ZoneEvent> const events = copy_events(buffer->m_events, buffer->m_write_count,
+			[begin_ns, end_ns](ZoneEvent const & event) { return event.m_end_ns >= begin_ns && event.m_start_ns <= end_ns; });
+		for (ZoneEvent const & event : events)
+		{
+			std::string args = event.m_detail >= 0 ? std::format(R"(, "args": {{ "id": {} }})", event.m_detail) : std::string{};
+			write_event(std::format(R"({{ "name": "{}", "ph": "X", "pid": 1, "tid": {}, "ts": {:.3f}, "dur": {:.3f}{} }})",
+				event.m_name, buffer->m_thread_id,
+				static_cast<double>(event.m_start_ns) / 1000.0,
+				static_cast<double>(event.m_end_ns - event.m_start_ns) / 1000.0,
+				args));
+		}
+	}
+
+	std::vector<CounterEvent> const counters = copy_events(g_counter_buffer.m_events, g_counter_buffer.m_write_count,
+		[begin_ns, end_ns](CounterEvent const & event) { return event.m_time_ns >= begin_ns && event.m_time_ns <= end_ns; });
+	for (CounterEvent const & counter : counters)
+	{
+		write_event(std::format(R"({{ "name": "{}", "ph": "C", "pid": 1, "ts": {:.3f}, "args": {{ "value": {} }} }})",
+			counter.m_name, static_cast<double>(counter.m_time_ns) / 1000.0, counter.m_value));
+	}
+
+	file << "\n] }\n";
+	return file.good();
+}
+
+ProfileZone::ProfileZone(char const * name, int detail /*= -1*/)
+{
+	if (!g_enabled.load(std::memory_order_relaxed))
+		return;
+
+	m_name = name;
+	m_detail = detail;
+	m_start_ns = now_ns();
+}
+
+ProfileZone::~ProfileZone()
+{
+	if (!m_name)
+		return;
+
+	push_event(thread_buffer(), ZoneEvent{
+		.m_name = m_name,
+		.m_detail = m_detail,
+		.m_start_ns = m_start_ns,
+		.m_end_ns = now_ns()
+		});
+}
@@ -0,0 +1,28 @@
+// RedrawSignal.ixx
+
+module;
+
+#include <atomic>
+#include <cstdint>
+
+export module RedrawSignal;
+
+// Wakes a render loop that only draws when something changed. Anything that may need a new frame, an input event, a
+// resize or a simulation step that moved something, calls Request() from whichever thread it's on
+export class RedrawSignal
+{
+public:
+	void Request()
+	{
+		m_request_count.fetch_add(1, std::memory_order_release);
+		m_request_count.notify_all();
+	}
+
+	std::uint64_t GetRequestCount() const { return m_request_count.load(std::memory_order_acquire); }
+
+	// Blocks until a request arrives after the one that made GetRequestCount() return seen_count
+	void Wait(std::uint64_t seen_count) const { m_request_count.wait(seen_count, std::memory_order_acquire); }
+
+private:
+	std::atomic<std::uint64_t> m_request_count{ 0 };
+};
@@ -0,0 +1,95 @@
+// RenderStats.ixx
+
+module;
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <mutex>
+
+export module RenderStats;
+
+// What the renderer did during one frame
+export struct RenderStats
+{
+	std::uint64_t m_draw_calls{ 0 };
+	std::uint64_t m_instances{ 0 };
+	std::uint64_t m_triangles{ 0 };
+	std::uint64_t m_pipeline_binds{ 0 };
+	std::uint64_t m_texture_binds{ 0 };
+	std::uint64_t m_constant_bytes{ 0 }; // uniforms and push constants
+	std::uint64_t m_upload_bytes{ 0 }; // buffer and image data copied to the gpu
+	std::uint64_t m_objects_visible{ 0 };
+	std::uint64_t m_objects_culled{ 0 };
+
+	// frame pacing, in microseconds
+	std::uint64_t m_limiter_wait_us{ 0 }; // the frame limiter sleeping and spinning
+	std::uint64_t m_present_wait_us{ 0 }; // blocked on the gpu or the display, for a frame fence, a swap chain image or a swap
+	std::uint64_t m_latency_us{ 0 }; // from the frame sampling the scene to its present call returning
+};
+
+// Counters of the frame being recorded plus the last m_history_size frames for rolling averages.
+// Counting and EndFrame() belong to the render thread, the getters can be called from any thread.
+export class FrameStats
+{
+public:
+	constexpr static std::size_t m_history_size = 120;
+
+	static RenderStats & Current();
+	static void EndFrame();
+
+	static RenderStats GetLast();
+
+	// e.g. GetAverage(&RenderStats::m_draw_calls)
+	static double GetAverage(std::uint64_t RenderStats::* counter);
+};
+
+namespace
+{
+	RenderStats g_current;
+
+	std::mutex g_history_mutex;
+	std::array<RenderStats, FrameStats::m_history_size> g_history;
+	std::size_t g_history_count{ 0 };
+	std::size_t g_history_next{ 0 };
+}
+
+RenderStats & FrameStats::Current()
+{
+	return g_current;
+}
+
+void FrameStats::EndFrame()
+{
+	{
+		std::lock_guard lock(g_history_mutex);
+		g_history[g_history_next] = g_current;
+		g_history_next = (g_history_next + 1) % m_history_size;
+		g_history_count = std::min(g_history_count + 1, m_history_size);
+	}
+
+	g_current = RenderStats{};
+}
+
+RenderStats FrameStats::GetLast()
+{
+	std::lock_guard lock(g_history_mutex);
+	if (g_history_count == 0)
+		return RenderStats{};
+
+	return g_history[(g_history_next + m_history_size - 1) % m_history_size];
+}
+
+double FrameStats::GetAverage(std::uint64_t RenderStats::* counter)
+{
+	std::lock_guard lock(g_history_mutex);
+	if (g_history_count == 0)
+		return 0.0;
+
+	// the unused slots are zero until the history has filled up once
+	std::uint64_t sum = 0;
+	for (RenderStats const & stats : g_history)
+		sum += stats.*counter;
+
+	return static_cast<double>(sum) / static_cast<double>(g_history_count);
+}
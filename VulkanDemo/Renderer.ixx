@@ -2,13 +2,18 @@
 
 module;
 
+#include <array>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include <vulkan/vulkan.h>
 
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/ext/matrix_float4x4.hpp>
 
 export module Renderer;
 
@@ -16,6 +21,7 @@ import GraphicsApi;
 import GraphicsPipeline;
 import Mesh;
 import RenderObject;
+import RenderPacket;
 
 struct PipelineContainer
 {
@@ -26,10 +32,21 @@ struct PipelineContainer
 export class Renderer
 {
 public:
+	using OverlayCallback = std::function<void()>;
+
 	explicit Renderer(GraphicsApi const & graphics_api);
 
+	// Extraction stage: culls the render objects and copies what drawing them takes into the next packet of the ring.
+	// The packet submitted last stays untouched, so the next frame can be prepared before the current one is done with
+	void Extract();
+
+	// Submission stage: draws the last extracted packet, reading nothing else of the scene but the per-frame constants
 	void Render() const;
 
+	// Writes the per-frame constants of every pipeline again, after Render() has recorded the frame but before it's
+	// submitted, e.g. to late-latch the camera
+	void UpdatePerFrameConstants() const;
+
 	int AddPipeline(GraphicsPipeline && pipeline);
 	int AddMesh(Mesh && mesh_var);
 
@@ -37,6 +54,18 @@ public:
 
 	void SetClearColor(glm::vec3 const & color) { m_clear_color = color; }
 
+	int GetPipelineCount() const { return static_cast<int>(m_pipeline_containers.size()); }
+
+	// Called after every pipeline has drawn, to draw on top of the scene, e.g. the hud.
+	// Timed as one more pipeline, its index is GetPipelineCount()
+	void SetOverlayCallback(OverlayCallback callback) { m_overlay_callback = callback; }
+
+	// Objects whose bounding sphere is outside the frustum are skipped, nothing is culled until this is set
+	void SetViewProjTransform(glm::mat4 const & view_proj);
+
+private:
+	bool is_visible(RenderObject const & obj, Mesh const & mesh) const;
+
 private:
 	GraphicsApi const & m_graphics_api;
 
@@ -45,4 +74,13 @@ private:
 	std::vector<Mesh> m_meshes; // TODO: need asset manager
 
 	glm::vec3 m_clear_color;
+
+	OverlayCallback m_overlay_callback;
+
+	std::optional<std::array<glm::vec4, 6>> m_frustum_planes; // normalized, pointing inwards
+
+	// the packet being submitted and the one being extracted for the next frame
+	static constexpr std::size_t m_packet_count = 2;
+	std::array<FramePacket, m_packet_count> m_packets;
+	std::size_t m_extracted_packet{ 0 };
 };
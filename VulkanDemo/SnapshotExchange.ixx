@@ -0,0 +1,78 @@
+// SnapshotExchange.ixx
+
+module;
+
+#include <array>
+#include <mutex>
+
+export module SnapshotExchange;
+
+// Hands whole snapshots from one writer thread to one reader thread, keeping the last two published so the reader can
+// interpolate between them. A snapshot is never modified once published, the writer fills a slot nobody else looks at
+// and the mutex is only held to swap slot indices, never while copying or reading a snapshot.
+export template <typename T>
+class SnapshotExchange
+{
+public:
+	struct Snapshots
+	{
+		T const * m_previous{ nullptr }; // null until two snapshots were published
+		T const * m_latest{ nullptr }; // null until one was published
+	};
+
+	// Writer only. The slot to fill before Publish(), it still holds whatever was written to it last time
+	T & BeginWrite();
+	void Publish();
+
+	// Reader only. The last two published snapshots, they stay untouched until the next call
+	Snapshots AcquireLatest();
+
+private:
+	// one being written, the two published ones and the two the reader holds, when it hasn't caught up yet
+	static constexpr int m_slot_count = 5;
+
+	std::mutex m_mutex;
+	std::array<T, m_slot_count> m_slots;
+	int m_writing{ -1 };
+	int m_previous{ -1 };
+	int m_latest{ -1 };
+	int m_read_previous{ -1 };
+	int m_read_latest{ -1 };
+};
+
+template <typename T>
+T & SnapshotExchange<T>::BeginWrite()
+{
+	std::lock_guard lock(m_mutex);
+	for (int i = 0; i < m_slot_count; ++i)
+	{
+		if (i != m_previous && i != m_latest && i != m_read_previous && i != m_read_latest)
+		{
+			m_writing = i;
+			break;
+		}
+	}
+	return m_slots[m_writing];
+}
+
+template <typename T>
+void SnapshotExchange<T>::Publish()
+{
+	std::lock_guard lock(m_mutex);
+	m_previous = m_latest;
+	m_latest = m_writing;
+	m_writing = -1;
+}
+
+template <typename T>
+auto SnapshotExchange<T>::AcquireLatest() -> Snapshots
+{
+	std::lock_guard lock(m_mutex);
+	m_read_previous = m_previous;
+	m_read_latest = m_latest;
+
+	return Snapshots{
+		.m_previous = m_read_previous < 0 ? nullptr : &m_slots[m_read_previous],
+		.m_latest = m_read_latest < 0 ? nullptr : &m_slots[m_read_latest]
+	};
+}
@@ -5,6 +5,7 @@ module;
 #include <algorithm>
 #include <array>
 #include <iostream>
+#include <string>
 
 #include <vulkan/vulkan.h>
 
@@ -55,21 +56,22 @@ private:
 
 namespace
 {
-	VkSampler create_texture_sampler(GraphicsApi const & graphics_api)
+	VkSampler create_texture_sampler(GraphicsApi const & graphics_api, VkFilter filter, VkSamplerAddressMode address_mode)
 	{
 		VkPhysicalDeviceProperties const & props = graphics_api.GetPhysicalDeviceInfo().properties;
+		bool const anisotropy_supported = graphics_api.GetPhysicalDeviceInfo().features.samplerAnisotropy == VK_TRUE;
 
 		VkSamplerCreateInfo sampler_info{
 			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
-			.magFilter = VK_FILTER_LINEAR,
-			.minFilter = VK_FILTER_LINEAR,
+			.magFilter = filter,
+			.minFilter = filter,
 			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
-			.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-			.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-			.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+			.addressModeU = address_mode,
+			.addressModeV = address_mode,
+			.addressModeW = address_mode,
 			.mipLodBias = 0.0f,
-			.anisotropyEnable = VK_TRUE,
-			.maxAnisotropy = props.limits.maxSamplerAnisotropy,
+			.anisotropyEnable = anisotropy_supported ? VK_TRUE : VK_FALSE, // not all software devices support it
+			.maxAnisotropy = anisotropy_supported ? props.limits.maxSamplerAnisotropy : 1.0f,
 			.compareEnable = VK_FALSE,
 			.compareOp = VK_COMPARE_OP_ALWAYS,
 			.minLod = 0.0f,
@@ -86,6 +88,32 @@ namespace
 		return sampler;
 	}
 
+	VkResult copy_pixels_into_buffer(
+		GraphicsApi const & graphics_api,
+		void const * pixels,
+		VkDeviceSize size,
+		VkBuffer & out_buffer,
+		VkDeviceMemory & out_buffer_memory)
+	{
+		VkResult result = graphics_api.CreateBuffer(
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			out_buffer,
+			out_buffer_memory);
+		if (result != VK_SUCCESS)
+			return result;
+
+		VkDevice device = graphics_api.GetDevice();
+
+		void * data = nullptr;
+		vkMapMemory(device, out_buffer_memory, 0, size, 0, &data);
+		memcpy(data, pixels, static_cast<size_t>(size));
+		vkUnmapMemory(device, out_buffer_memory);
+
+		return VK_SUCCESS;
+	}
+
 	VkResult load_image_into_buffer(
 		GraphicsApi const & graphics_api,
 		std::filesystem::path const & filepath,
@@ -105,27 +133,14 @@ namespace
 			.height = static_cast<std::uint32_t>(image.GetHeight())
 		};
 
-		VkDeviceSize buffer_size = static_cast<VkDeviceSize>(image.GetSize());
-
-		VkResult result = graphics_api.CreateBuffer(
-			buffer_size,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			out_buffer,
-			out_buffer_memory);
+		VkResult result = copy_pixels_into_buffer(graphics_api,
+			image.GetData(), static_cast<VkDeviceSize>(image.GetSize()), out_buffer, out_buffer_memory);
 		if (result != VK_SUCCESS)
 		{
 			std::cout << "load_image_into_buffer() Failed to create staging buffer: " << filepath << std::endl;
 			return result;
 		}
 
-		VkDevice device = graphics_api.GetDevice();
-
-		void * data = nullptr;
-		vkMapMemory(device, out_buffer_memory, 0, buffer_size, 0, &data);
-		memcpy(data, image.GetData(), image.GetSize());
-		vkUnmapMemory(device, out_buffer_memory);
-
 		return VK_SUCCESS; // image goes out of scope and frees memory
 	}
 
@@ -194,6 +209,8 @@ Texture::Texture(GraphicsApi const & graphics_api, std::filesystem::path const &
 	VkResult result = load_image_into_buffer(graphics_api, filepath, staging_buffer, staging_buffer_memory, extents);
 	if (result != VK_SUCCESS)
 		return;
+	std::string const name = filepath.filename().string();
+	TrackedAllocation staging_allocation{ MemoryCategory::STAGING, name, m_graphics_api.GetMemorySize(staging_buffer) };
 
 	result = graphics_api.Create2dImage(
 		extents.width,
@@ -211,6 +228,7 @@ Texture::Texture(GraphicsApi const & graphics_api, std::filesystem::path const &
 		std::cout << "Texture() Failed to create image: " << filepath << std::endl;
 		return;
 	}
+	m_allocation = TrackedAllocation{ MemoryCategory::TEXTURE, name, m_graphics_api.GetMemorySize(m_image) };
 
 	m_graphics_api.TransitionImageLayout(
 		m_image,
@@ -244,7 +262,7 @@ Texture::Texture(GraphicsApi const & graphics_api, std::filesystem::path const &
 		return;
 	}
 
-	m_sampler = create_texture_sampler(m_graphics_api);
+	m_sampler = create_texture_sampler(m_graphics_api, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
 
 	vkDestroyBuffer(device, staging_buffer, nullptr);
 	vkFreeMemory(device, staging_buffer_memory, nullptr);
@@ -259,6 +277,8 @@ Texture::Texture(GraphicsApi const & graphics_api, std::array<std::filesystem::p
 	VkResult result = load_images_into_buffer(graphics_api, filepaths, staging_buffer, staging_buffer_memory, extents);
 	if (result != VK_SUCCESS)
 		return;
+	std::string const name = filepaths[0].parent_path().filename().string(); // the faces share a directory
+	TrackedAllocation staging_allocation{ MemoryCategory::STAGING, name, m_graphics_api.GetMemorySize(staging_buffer) };
 
 	result = graphics_api.Create2dImage(
 		extents.width,
@@ -276,6 +296,7 @@ Texture::Texture(GraphicsApi const & graphics_api, std::array<std::filesystem::p
 		std::cout << "Texture() Failed to create cubemap: " << filepaths[0] << std::endl;
 		return;
 	}
+	m_allocation = TrackedAllocation{ MemoryCategory::TEXTURE, name, m_graphics_api.GetMemorySize(m_image) };
 
 	m_graphics_api.TransitionImageLayout(
 		m_image,
@@ -311,7 +332,84 @@ Texture::Texture(GraphicsApi const & graphics_api, std::array<std::filesystem::p
 		return;
 	}
 
-	m_sampler = create_texture_sampler(m_graphics_api);
+	m_sampler = create_texture_sampler(m_graphics_api, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+
+	VkDevice device = m_graphics_api.GetDevice();
+	vkDestroyBuffer(device, staging_buffer, nullptr);
+	vkFreeMemory(device, staging_buffer_memory, nullptr);
+}
+
+Texture::Texture(GraphicsApi const & graphics_api, std::uint32_t width, std::uint32_t height, std::vector<std::uint8_t> const & rgba_pixels)
+	: m_graphics_api(graphics_api)
+{
+	if (width == 0 || height == 0 || rgba_pixels.size() != std::size_t{ 4 } * width * height)
+	{
+		std::cout << "Texture() Pixel data doesn't match the image size" << std::endl;
+		return;
+	}
+
+	VkBuffer staging_buffer = VK_NULL_HANDLE;
+	VkDeviceMemory staging_buffer_memory = VK_NULL_HANDLE;
+	VkResult result = copy_pixels_into_buffer(graphics_api,
+		rgba_pixels.data(), static_cast<VkDeviceSize>(rgba_pixels.size()), staging_buffer, staging_buffer_memory);
+	if (result != VK_SUCCESS)
+	{
+		std::cout << "Texture() Failed to create staging buffer" << std::endl;
+		return;
+	}
+	TrackedAllocation staging_allocation{ MemoryCategory::STAGING, "generated image", m_graphics_api.GetMemorySize(staging_buffer) };
+
+	result = graphics_api.Create2dImage(
+		width,
+		height,
+		1 /*layers*/,
+		VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		0 /*flags*/,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		m_image,
+		m_image_memory);
+	if (result != VK_SUCCESS)
+	{
+		std::cout << "Texture() Failed to create image from pixels" << std::endl;
+		return;
+	}
+	m_allocation = TrackedAllocation{ MemoryCategory::TEXTURE, "generated image", m_graphics_api.GetMemorySize(m_image) };
+
+	m_graphics_api.TransitionImageLayout(
+		m_image,
+		1 /*layers*/,
+		VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	m_graphics_api.CopyBufferToImage(
+		staging_buffer,
+		m_image,
+		width,
+		height,
+		1 /*layers*/);
+	m_graphics_api.TransitionImageLayout(
+		m_image,
+		1 /*layers*/,
+		VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	result = m_graphics_api.CreateImageView(
+		m_image,
+		VK_IMAGE_VIEW_TYPE_2D,
+		VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		1 /*layers*/,
+		m_image_view);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create vulkan image view for texture");
+		return;
+	}
+
+	m_sampler = create_texture_sampler(m_graphics_api, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
 
 	VkDevice device = m_graphics_api.GetDevice();
 	vkDestroyBuffer(device, staging_buffer, nullptr);
@@ -353,17 +451,27 @@ Texture::~Texture()
 
 void Texture::destroy_texture()
 {
-	VkDevice device = m_graphics_api.GetDevice();
+	if (m_sampler == VK_NULL_HANDLE && m_image_view == VK_NULL_HANDLE
+		&& m_image == VK_NULL_HANDLE && m_image_memory == VK_NULL_HANDLE)
+	{
+		return; // nothing to destroy, e.g. moved from
+	}
+
+	m_graphics_api.DestroyDeferred(
+		[sampler = m_sampler, image_view = m_image_view, image = m_image, image_memory = m_image_memory](VkDevice device)
+		{
+			vkDestroySampler(device, sampler, nullptr);
+			vkDestroyImageView(device, image_view, nullptr);
+
+			vkDestroyImage(device, image, nullptr);
+			vkFreeMemory(device, image_memory, nullptr);
+		});
 
-	vkDestroySampler(device, m_sampler, nullptr);
 	m_sampler = VK_NULL_HANDLE;
-	vkDestroyImageView(device, m_image_view, nullptr);
 	m_image_view = VK_NULL_HANDLE;
-
-	vkDestroyImage(device, m_image, nullptr);
 	m_image = VK_NULL_HANDLE;
-	vkFreeMemory(device, m_image_memory, nullptr);
 	m_image_memory = VK_NULL_HANDLE;
+	m_allocation.Reset();
 }
 
 Texture::Texture(Texture && other)
@@ -383,6 +491,7 @@ Texture & Texture::operator=(Texture && other)
 	m_image_memory = other.m_image_memory;
 	m_image_view = other.m_image_view;
 	m_sampler = other.m_sampler;
+	m_allocation = std::move(other.m_allocation);
 
 	other.m_image = VK_NULL_HANDLE;
 	other.m_image_memory = VK_NULL_HANDLE;
@@ -3,19 +3,24 @@
 module;
 
 #include <array>
+#include <cstdint>
 #include <filesystem>
+#include <vector>
 
 #include <vulkan/vulkan.h>
 
 export module Texture;
 
 import GraphicsApi;
+import MemoryLedger;
 
 export class Texture
 {
 public:
 	Texture(GraphicsApi const & graphics_api, std::filesystem::path const & filepath);
 	Texture(GraphicsApi const & graphics_api, std::array<std::filesystem::path, 6> const & filepaths); // cubemap
+	// Nearest filtered and clamped to the edge, for images generated at runtime such as the hud font
+	Texture(GraphicsApi const & graphics_api, std::uint32_t width, std::uint32_t height, std::vector<std::uint8_t> const & rgba_pixels);
 	~Texture();
 
 	Texture(Texture && other);
@@ -39,4 +44,6 @@ private:
 	VkDeviceMemory m_image_memory{ VK_NULL_HANDLE };
 	VkImageView m_image_view{ VK_NULL_HANDLE };
 	VkSampler m_sampler{ VK_NULL_HANDLE };
+
+	TrackedAllocation m_allocation;
 };
@@ -0,0 +1,50 @@
+// VersionedBlock.ixx
+
+module;
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+export module VersionedBlock;
+
+// Versions come from one counter shared by every block, so no two values ever get the same one and the newest of a
+// few blocks changes whenever any of them does. 0 is never handed out, it stands for "nothing uploaded yet"
+export std::uint64_t NextBlockVersion()
+{
+	static std::atomic<std::uint64_t> s_version{ 0 };
+	return s_version.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+// A block of shader constants and the version it got when it last changed. The pipelines remember the version
+// they uploaded last and skip the upload while it's still current, so constants that stay put cost nothing
+export template <typename T>
+class VersionedBlock
+{
+public:
+	VersionedBlock() = default;
+	explicit VersionedBlock(T const & value) : m_value(value) {}
+
+	// Only a different value gets a new version
+	void Set(T const & value)
+	{
+		if (value == m_value)
+			return;
+		m_value = value;
+		m_version = NextBlockVersion();
+	}
+
+	T const & Get() const { return m_value; }
+	std::uint64_t GetVersion() const { return m_version; }
+
+private:
+	T m_value{};
+	std::uint64_t m_version{ NextBlockVersion() }; // the initial value counts too
+};
+
+// The version of constants gathered from several blocks
+export template <typename... Blocks>
+std::uint64_t GetLatestVersion(Blocks const &... blocks)
+{
+	return std::max({ blocks.GetVersion()... });
+}
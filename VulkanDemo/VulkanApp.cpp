@@ -2,21 +2,101 @@
 
 module;
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <optional>
+#include <stop_token>
 #include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
 
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
 module VulkanApp;
 
+import AllocationTracker;
+import Benchmark;
+import FixedStepThread;
+import FrameLimiter;
 import GraphicsApi;
+import HitchMonitor;
+import Hud;
+import Input;
+import InputRecording;
+import Log;
+import MemoryLedger;
+import Profiler;
 import Renderer;
+import RenderStats;
 import Scene;
 
-VulkanApp::VulkanApp(WindowSize window_size, std::string title)
-	: m_title(title)
+namespace
 {
+	bool write_ppm(std::string const & path, std::uint32_t width, std::uint32_t height, std::vector<std::uint8_t> const & rgba_pixels)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+			return false;
+
+		file << "P6\n" << width << " " << height << "\n255\n";
+		for (size_t i = 0; i < rgba_pixels.size(); i += 4)
+			file.write(reinterpret_cast<char const *>(&rgba_pixels[i]), 3);
+
+		return file.good();
+	}
+
+	std::vector<GpuPipelineSample> to_pipeline_samples(std::vector<GpuPipelineTiming> const & timings)
+	{
+		std::vector<GpuPipelineSample> samples;
+		for (GpuPipelineTiming const & timing : timings)
+		{
+			GpuPipelineSample sample{
+				.m_pipeline_index = timing.m_pipeline_index,
+				.m_time_ms = timing.m_time_ms
+			};
+			if (timing.m_statistics.has_value())
+			{
+				sample.m_vertex_shader_invocations = timing.m_statistics->m_vertex_shader_invocations;
+				sample.m_clipping_primitives = timing.m_statistics->m_clipping_primitives;
+				sample.m_fragment_shader_invocations = timing.m_statistics->m_fragment_shader_invocations;
+			}
+			samples.push_back(sample);
+		}
+		return samples;
+	}
+}
+
+VulkanApp::VulkanApp(AppOptions const & options, std::string title)
+	: m_options(options)
+	, m_title(title)
+{
+	// Enabled before anything else so loading and the first frames show up in the trace too
+	if (!options.m_trace_path.empty() || !options.m_hitch.m_output_dir.empty())
+	{
+		Profiler::SetEnabled(true);
+		Profiler::SetThreadName("main");
+	}
+
+	MemoryLedger::SetBudget(static_cast<std::uint64_t>(options.m_memory_budget_mb * 1024.0 * 1024.0));
+
+	if (options.m_alloc_check)
+		AllocationTracker::EnableFrameCheck(options.m_warmup_frame_count);
+
+	WindowSize window_size{ options.m_width, options.m_height };
+
+	// Headless runs have no display to talk to, so glfw is never initialized
+	if (options.m_headless)
+	{
+		m_window_size.store(window_size);
+		m_intialized = true;
+		return;
+	}
+
 	glfwSetErrorCallback([](int error, const char * description)
 		{
 			std::cout << "GLFW Error: " << error << " " << description;
@@ -43,50 +123,201 @@ VulkanApp::VulkanApp(WindowSize window_size, std::string title)
 			VulkanApp * app = static_cast<VulkanApp *>(glfwGetWindowUserPointer(window));
 			app->OnKeyEvent(key, scan_code, action, mods);
 		});
+	glfwSetWindowRefreshCallback(m_window, [](GLFWwindow * window)
+		{
+			VulkanApp * app = static_cast<VulkanApp *>(glfwGetWindowUserPointer(window));
+			app->OnWindowRefresh();
+		});
 
 	m_window_size.store(window_size);
 }
 
 VulkanApp::~VulkanApp()
 {
-	if (IsInitialized())
+	// Run() has joined the render thread by now, so no zone is being recorded while the trace is written
+	if (!m_options.m_trace_path.empty())
+	{
+		Profiler::SetEnabled(false);
+		if (Profiler::WriteChromeTrace(m_options.m_trace_path))
+			std::cout << "Wrote trace: " << m_options.m_trace_path << std::endl;
+		else
+			std::cout << "Failed to write trace: " << m_options.m_trace_path << std::endl;
+	}
+
+	// the scene and the graphics api only live inside Run(), anything still in the ledger was never freed
+	MemoryLedger::ReportLeaks();
+
+	if (IsInitialized() && !IsHeadless())
 		glfwTerminate();
 }
 
 void VulkanApp::Run()
 {
+	if (IsInitialized() && IsHeadless())
+	{
+		run_headless();
+		return;
+	}
+
 	if (!IsInitialized() || !HasWindow())
 		return;
 
 	std::jthread update_render_loop([this](std::stop_token s_token)
 		{
+			Profiler::SetThreadName("render");
+
 			WindowSize size = m_window_size.load();
 			std::uint32_t extension_count = 0;
 			const char ** extensions = glfwGetRequiredInstanceExtensions(&extension_count);
 
 			GraphicsApi graphics_api{
 				m_window, size.m_width, size.m_height,
-				m_title, extension_count, extensions };
+				m_title, extension_count, extensions, m_options.m_pacing };
 
 			Scene scene{ graphics_api };
-			scene.Init();
+			scene.Init(m_options.m_stress_scene);
 			scene.OnViewportResized(size.m_width, size.m_height);
 
+			Hud hud{ graphics_api, "shaders" };
+			scene.SetOverlayCallback([&hud]() { hud.Render(); });
+
+			using Clock = std::chrono::steady_clock;
+			using Milliseconds = std::chrono::duration<double, std::milli>;
+			double cpu_time_ms = 0.0; // interpolating and recording the previous frame, shown by the hud
+
+			std::optional<HitchMonitor> hitch_monitor;
+			if (!m_options.m_hitch.m_output_dir.empty())
+				hitch_monitor.emplace(m_options.m_hitch);
+
+			std::optional<InputRecorder> recorder;
+			if (!m_options.m_record_path.empty())
+				recorder.emplace(m_options.m_record_path);
+
+			std::optional<InputReplayer> replayer;
+			Input replay_input;
+			if (!m_options.m_replay_path.empty())
+				replayer.emplace(m_options.m_replay_path);
+
+			// The simulation steps at a fixed rate on its own thread while this one renders, the frames are placed in
+			// between its snapshots so the animation stays smooth whatever the frame rate
+			Input input; // the key state as of the last step
+			FixedStepThread simulation{ m_options.m_simulation_rate, glfwGetTime,
+				[&](double step_time, double delta_time)
+				{
+					// the main thread only queues key events, a replay uses its own copy so the keyboard can't interfere
+					m_key_events.ApplyUntil(step_time, input);
+					Input const * step_input = &input;
+					if (replayer.has_value() && replayer->IsValid())
+					{
+						if (replayer->IsFinished())
+						{
+							glfwSetWindowShouldClose(m_window, true);
+							glfwPostEmptyEvent(); // wakes the main thread
+							return;
+						}
+						delta_time = replayer->NextFrame(replay_input);
+						step_input = &replay_input;
+					}
+
+					if (recorder.has_value())
+						recorder->RecordFrame(delta_time, *step_input);
+
+					if (scene.Simulate(step_time, delta_time, *step_input).Any())
+						m_redraw.Request();
+				} };
+
+			FrameLimiter frame_limiter{ m_options.m_pacing.m_max_fps };
 			double last_update_time = glfwGetTime();
 
+			// The camera is moved with the keys held right now rather than waiting for the simulation to step with them,
+			// once when the frame is extracted and again just before it's submitted. A replay shows the recorded camera
+			bool const predict_camera = !replayer.has_value() || !replayer->IsValid();
+			Clock::time_point input_sample_time; // the latency of the frame starts there
+			std::function<void()> late_latch_fn;
+			if (predict_camera)
+			{
+				late_latch_fn = [this, &scene, &input_sample_time]()
+					{
+						input_sample_time = Clock::now();
+						scene.PredictCamera(glfwGetTime(), m_live_keys.Load());
+						scene.LatchPerFrameConstants();
+					};
+			}
+
+			// On demand, a frame where nothing changed ends the drawing until something asks for a new one
+			bool const render_on_demand = m_options.m_pacing.m_render_on_demand;
+			bool scene_changed = true;
+			std::uint64_t drawn_redraw_requests = m_redraw.GetRequestCount();
+			std::stop_callback wake_on_stop{ s_token, [this]() { m_redraw.Request(); } };
+			if (render_on_demand)
+				LogInfo("Rendering on demand, P pauses the animation");
+
 			while (!s_token.stop_requested())
 			{
+				if (render_on_demand && !scene_changed && m_redraw.GetRequestCount() == drawn_redraw_requests)
+				{
+					{
+						ProfileZone idle_zone{ "wait for changes" };
+						m_redraw.Wait(drawn_redraw_requests);
+					}
+					last_update_time = glfwGetTime();
+					if (hitch_monitor.has_value())
+						hitch_monitor->RestartFrameClock();
+					continue;
+				}
+				drawn_redraw_requests = m_redraw.GetRequestCount();
+
+				// before the frame samples the scene, so the wait doesn't add to its latency
+				if (frame_limiter.IsEnabled())
+				{
+					ProfileZone limiter_zone{ "frame limiter" };
+					FrameStats::Current().m_limiter_wait_us += static_cast<std::uint64_t>(frame_limiter.Wait() * 1000.0);
+				}
+
+				ProfileZone frame_zone{ "frame" };
+				AllocationTracker::BeginFrame();
+				graphics_api.GetFrameArena().Reset();
+
 				double cur_time = glfwGetTime();
 				double delta_time = cur_time - last_update_time;
 				last_update_time = cur_time;
 
-				scene.Update(delta_time, m_input);
+				hud.SetVisible(m_show_hud.load());
+				hud.Update(delta_time * 1000.0, cpu_time_ms, scene.GetRenderer().GetPipelineCount());
+
+				Clock::time_point const update_start = Clock::now();
+				input_sample_time = update_start;
+				// a step behind the simulation, so the frame falls between the last two snapshots
+				scene.Interpolate(cur_time - simulation.GetStepDuration());
+				if (predict_camera)
+					scene.PredictCamera(cur_time, m_live_keys.Load());
+				scene_changed = scene.ConsumeChanges().Any();
+
+				// before DrawFrame() waits on the frame's fence, so preparing this frame overlaps the gpu running the previous ones
+				scene.Extract();
+				cpu_time_ms = Milliseconds(Clock::now() - update_start).count();
 
 				bool swap_chain_out_of_date = false;
 				if (graphics_api.SwapChainIsValid())
-					graphics_api.DrawFrame([&scene]() { scene.Render(); }, swap_chain_out_of_date);
+				{
+					// only the recording, DrawFrame also waits for the fence and presents
+					graphics_api.DrawFrame([&scene, &cpu_time_ms]()
+						{
+							Clock::time_point const render_start = Clock::now();
+							scene.Render();
+							cpu_time_ms += Milliseconds(Clock::now() - render_start).count();
+						}, late_latch_fn, swap_chain_out_of_date);
+					// from sampling the input to the present call returning, the display may still take a vertical blank
+					FrameStats::Current().m_latency_us = static_cast<std::uint64_t>(
+						std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - input_sample_time).count());
+				}
 				else
 					swap_chain_out_of_date = true;
+				FrameStats::EndFrame();
+				AllocationTracker::EndFrame();
+
+				if (hitch_monitor.has_value())
+					hitch_monitor->EndFrame(graphics_api.GetLastGpuFrameTime());
 
 				WindowSize new_size = m_window_size.load();
 				if (swap_chain_out_of_date || new_size != size)
@@ -94,19 +325,147 @@ void VulkanApp::Run()
 					graphics_api.RecreateSwapChain(new_size.m_width, new_size.m_height);
 					scene.OnViewportResized(new_size.m_width, new_size.m_height);
 					size = new_size;
+					AllocationTracker::RestartWarmup(); // the new swap chain's first frames fill caches again
 				}
 			}
 
 			graphics_api.WaitForLastFrame();
 		}); // the GraphicsApi and Scene are destroyed in the reverse order they were created
 
+	// Sleeps until an event arrives instead of spinning a core, the simulation thread posts an empty one when a replay finishes
 	while (!glfwWindowShouldClose(m_window))
-		glfwPollEvents(); // must only be called from main thread
+		glfwWaitEvents(); // must only be called from main thread
+}
+
+void VulkanApp::run_headless()
+{
+	WindowSize size = m_window_size.load();
+
+	GraphicsApi graphics_api{ size.m_width, size.m_height, m_title, m_options.m_pacing };
+	if (!graphics_api.SwapChainIsValid())
+	{
+		std::cout << "Failed to create headless graphics api" << std::endl;
+		return;
+	}
+
+	Scene scene{ graphics_api };
+	scene.Init(m_options.m_stress_scene);
+	scene.OnViewportResized(size.m_width, size.m_height);
+
+	// A fixed timestep keeps the rendered frames identical between runs, whatever the speed of the device.
+	// The simulation steps once per frame on this thread, the same step the windowed app runs at
+	double const fixed_delta_time = 1.0 / m_options.m_simulation_rate;
+
+	std::optional<HitchMonitor> hitch_monitor;
+	if (!m_options.m_hitch.m_output_dir.empty())
+		hitch_monitor.emplace(m_options.m_hitch);
+
+	std::optional<InputRecorder> recorder;
+	if (!m_options.m_record_path.empty())
+		recorder.emplace(m_options.m_record_path);
+
+	std::optional<InputReplayer> replayer;
+	if (!m_options.m_replay_path.empty())
+	{
+		replayer.emplace(m_options.m_replay_path);
+		if (!replayer->IsValid())
+			return;
+	}
+
+	// a replay renders every recorded frame and nothing more
+	int const frame_count = replayer.has_value() ? replayer->GetFrameCount() : m_options.m_frame_count;
+
+	using Clock = std::chrono::steady_clock;
+	using Milliseconds = std::chrono::duration<double, std::milli>;
+
+	int const warmup_frame_count = m_options.m_benchmark ? m_options.m_warmup_frame_count : 0;
+	BenchmarkReport report{ "Vulkan", graphics_api.GetPhysicalDeviceInfo().properties.deviceName,
+		size.m_width, size.m_height, warmup_frame_count };
+
+	Clock::time_point start_time = Clock::now();
+
+	for (int frame = 0; frame < warmup_frame_count + frame_count; ++frame)
+	{
+		ProfileZone frame_zone{ "frame", frame };
+		AllocationTracker::BeginFrame();
+		graphics_api.GetFrameArena().Reset();
+
+		if (frame == warmup_frame_count)
+			start_time = Clock::now();
+
+		bool const is_warmup = frame < warmup_frame_count;
+
+		// warm-up frames of a replay don't advance the scene, so the replay starts from the initial state
+		double delta_time = fixed_delta_time;
+		if (replayer.has_value())
+			delta_time = is_warmup ? 0.0 : replayer->NextFrame(m_input);
+
+		if (recorder.has_value() && !is_warmup)
+			recorder->RecordFrame(delta_time, m_input);
+
+		Clock::time_point const update_start = Clock::now();
+		scene.Update(delta_time, m_input);
+		Clock::time_point const render_start = Clock::now();
+
+		bool swap_chain_out_of_date = false; // never set when headless
+		graphics_api.DrawFrame([&scene]() { scene.Render(); }, nullptr /*late_latch_fn*/, swap_chain_out_of_date);
+		Clock::time_point const render_end = Clock::now();
+		FrameStats::EndFrame();
+		AllocationTracker::EndFrame();
+
+		if (hitch_monitor.has_value())
+			hitch_monitor->EndFrame(graphics_api.GetLastGpuFrameTime());
+
+		if (!is_warmup)
+		{
+			report.AddFrame(
+				Milliseconds(render_start - update_start).count(),
+				Milliseconds(render_end - render_start).count(),
+				graphics_api.GetLastGpuFrameTime());
+			report.AddGpuPipelineSamples(to_pipeline_samples(graphics_api.GetLastGpuPipelineTimings()));
+		}
+	}
+
+	graphics_api.WaitForLastFrame();
+
+	Milliseconds const elapsed = Clock::now() - start_time;
+	report.SetWallTime(elapsed.count());
+	report.CaptureMemory(graphics_api.GetMemoryHeapBudgets());
+
+	if (m_options.m_benchmark)
+	{
+		report.PrintTable();
+		if (m_options.m_benchmark_json_path.empty())
+			std::cout << report.ToJson();
+		else if (!report.WriteJson(m_options.m_benchmark_json_path))
+			std::cout << "Failed to write benchmark report: " << m_options.m_benchmark_json_path << std::endl;
+	}
+	else
+	{
+		std::cout << "Rendered " << frame_count << " frames in " << elapsed.count() << " ms ("
+			<< elapsed.count() / std::max(frame_count, 1) << " ms/frame)" << std::endl;
+	}
+
+	if (!m_options.m_capture_path.empty())
+	{
+		std::vector<std::uint8_t> pixels;
+		VkExtent2D const extent = graphics_api.GetSwapChainExtent();
+		if (graphics_api.ReadOffscreenImage(pixels) != VK_SUCCESS
+			|| !write_ppm(m_options.m_capture_path, extent.width, extent.height, pixels))
+		{
+			std::cout << "Failed to write capture: " << m_options.m_capture_path << std::endl;
+		}
+		else
+		{
+			std::cout << "Wrote capture: " << m_options.m_capture_path << std::endl;
+		}
+	}
 }
 
 void VulkanApp::OnWindowResize(WindowSize size)
 {
 	m_window_size.store(size);
+	m_redraw.Request();
 }
 
 void VulkanApp::OnKeyEvent(int key, int /*scan_code*/, int action, int /*mods*/)
@@ -114,8 +473,16 @@ void VulkanApp::OnKeyEvent(int key, int /*scan_code*/, int action, int /*mods*/)
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(m_window, true);
 
-	if (action == GLFW_PRESS)
-		m_input.SetKey(key, true /*pressed*/);
-	else if (action == GLFW_RELEASE)
-		m_input.SetKey(key, false /*pressed*/);
+	if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
+		m_show_hud.store(!m_show_hud.load()); // only the main thread writes it
+
+	if (action != GLFW_PRESS && action != GLFW_RELEASE)
+		return; // repeats don't change the key state
+
+	m_live_keys.SetKey(key, action == GLFW_PRESS);
+	m_redraw.Request();
+
+	KeyEvent const event{ .m_time = glfwGetTime(), .m_key = key, .m_pressed = action == GLFW_PRESS };
+	if (!m_key_events.Push(event))
+		LogWarning("Key event queue full, the simulation thread is not keeping up. Dropped key {}", key);
 }
@@ -11,7 +11,9 @@ module;
 
 export module VulkanApp;
 
+import AppOptions;
 import Input;
+import RedrawSignal;
 
 export struct WindowSize
 {
@@ -24,22 +26,33 @@ export struct WindowSize
 export class VulkanApp
 {
 public:
-	VulkanApp(WindowSize window_size, std::string title);
+	VulkanApp(AppOptions const & options, std::string title);
 	~VulkanApp();
 
 	void Run();
 
 	bool IsInitialized() const { return m_intialized; }
 	bool HasWindow() const { return m_window != nullptr; }
+	bool IsHeadless() const { return m_options.m_headless; }
 
 	void OnWindowResize(WindowSize size);
 	void OnKeyEvent(int key, int scan_code, int action, int mods);
+	void OnWindowRefresh() { m_redraw.Request(); } // the window was uncovered, or the system lost its contents
 
 private:
+	void run_headless();
+
+private:
+	AppOptions m_options;
+
 	bool m_intialized{ false };
 	GLFWwindow * m_window{ nullptr };
 	std::string m_title;
 
 	std::atomic<WindowSize> m_window_size;
-	Input m_input;
+	Input m_input; // headless only, the windowed render loop keeps its own snapshot
+	KeyEventQueue m_key_events; // from the main thread to the simulation thread
+	LiveKeyState m_live_keys; // from the main thread to the render thread, which moves the camera with them
+	RedrawSignal m_redraw; // wakes the render thread when it renders on demand
+	std::atomic<bool> m_show_hud{ false }; // toggled with F1
 };
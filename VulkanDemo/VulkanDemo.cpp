@@ -1,15 +1,27 @@
 // VulkanDemo.cpp
 
 #include <iostream>
+#include <optional>
 
+import AppOptions;
 import VulkanApp;
+import Log;
 
-int main()
+int main(int argc, char ** argv)
 {
+	std::optional<AppOptions> options = ParseAppOptions(argc, argv, GraphicsBackend::VULKAN);
+	if (!options.has_value())
+		return -1;
+
+	// destroyed last, so the app's destructor can still log
+	LogWriter log_writer;
+	if (options->m_verbose)
+		Log::SetMinLevel(LogLevel::VERBOSE);
+
 	std::cout << "Initializing app..." << std::endl;
 
-	VulkanApp app(WindowSize{ 1920, 1080 }, "Vulkan Demo");
-	if (!app.IsInitialized() || !app.HasWindow())
+	VulkanApp app(options.value(), "Vulkan Demo");
+	if (!app.IsInitialized() || (!app.IsHeadless() && !app.HasWindow()))
 		return -1;
 
 	std::cout << "Running app..." << std::endl;
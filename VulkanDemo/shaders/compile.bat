@@ -8,4 +8,6 @@ C:\VulkanSDK\1.4.304.0\Bin\glslc.exe skybox.vert -o skybox_vert.spv
 C:\VulkanSDK\1.4.304.0\Bin\glslc.exe skybox.frag -o skybox_frag.spv
 C:\VulkanSDK\1.4.304.0\Bin\glslc.exe reflection.vert -o reflection_vert.spv
 C:\VulkanSDK\1.4.304.0\Bin\glslc.exe reflection.frag -o reflection_frag.spv
+C:\VulkanSDK\1.4.304.0\Bin\glslc.exe hud.vert -o hud_vert.spv
+C:\VulkanSDK\1.4.304.0\Bin\glslc.exe hud.frag -o hud_frag.spv
 pause
\ No newline at end of file
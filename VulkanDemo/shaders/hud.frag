@@ -0,0 +1,14 @@
+#version 450
+
+layout(binding = 0) uniform sampler2D font_atlas;
+
+layout(location = 0) in vec2 in_tex_coord;
+layout(location = 1) in vec3 in_color;
+
+layout(location = 0) out vec4 out_frag_color;
+
+void main()
+{
+	// the atlas is white, its alpha is the coverage
+	out_frag_color = vec4(in_color, 1.0) * texture(font_atlas, in_tex_coord);
+}
@@ -0,0 +1,21 @@
+#version 450
+
+layout(push_constant) uniform HudData {
+	vec2 viewport_size;
+} hud_data;
+
+layout(location = 0) in vec3 in_pos;
+layout(location = 1) in vec2 in_tex_coord;
+layout(location = 2) in vec3 in_color;
+
+layout(location = 0) out vec2 out_tex_coord;
+layout(location = 1) out vec3 out_color;
+
+void main()
+{
+	out_tex_coord = in_tex_coord;
+	out_color = in_color;
+
+	// pixels from the top left to clip space, y points down in both
+	gl_Position = vec4(in_pos.xy / hud_data.viewport_size * 2.0 - 1.0, 0.0, 1.0);
+}